@@ -0,0 +1,695 @@
+#include "catalog.h"
+#include "sdcard.h"
+#include "waveform.h"
+#include "events.h"
+#include "wav.h"
+#include "audio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "catalog";
+
+// snap.bin holds the whole catalogue as of the last compaction, log.bin
+// every change since. Compaction renames log.bin to log.old first, so
+// changes keep going to a fresh log while the snapshot is written; log.old
+// is removed once the new snapshot is in place. Replaying a log over a
+// snapshot that already contains it is harmless.
+#define SNAP_PATH  CATALOG_DIR "/snap.bin"
+#define SNAP_TMP   CATALOG_DIR "/snap.tmp"
+#define LOG_PATH   CATALOG_DIR "/log.bin"
+#define LOG_OLD    CATALOG_DIR "/log.old"
+
+#define SNAP_MAGIC      "CATS"
+#define SNAP_VERSION    1
+#define COMPACT_RECORDS 512   // log records before a compaction is due
+#define INITIAL_CAP     256
+
+#define OP_PUT 1
+#define OP_DEL 2
+
+typedef struct {
+    char     magic[4];
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t count;
+} snap_hdr_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t reserved[7];
+    catalog_entry_t entry;  // DEL only uses the name
+} log_rec_t;
+
+// Entries live unordered in a PSRAM array; an open-addressing hash table of
+// (index + 1) finds them by name. Deletes swap the last entry into the hole.
+static catalog_entry_t *s_entries = NULL;
+static size_t s_count = 0;
+static size_t s_cap = 0;
+static uint32_t *s_hash = NULL;
+static size_t s_hash_cap = 0;         // power of two, >= 2 * s_cap
+
+static SemaphoreHandle_t s_lock = NULL;      // entries and hash
+static SemaphoreHandle_t s_log_lock = NULL;  // log files; taken before s_lock
+static uint32_t s_log_records = 0;
+static uint32_t s_deletions = 0;             // under s_lock, see catalog_missing_waveforms()
+static TaskHandle_t s_task = NULL;
+
+// --- In-memory index (callers hold s_lock) ---
+
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void hash_insert(size_t idx)
+{
+    size_t mask = s_hash_cap - 1;
+    size_t slot = name_hash(s_entries[idx].name) & mask;
+    while (s_hash[slot]) slot = (slot + 1) & mask;
+    s_hash[slot] = idx + 1;
+}
+
+static void hash_rebuild(void)
+{
+    memset(s_hash, 0, s_hash_cap * sizeof(uint32_t));
+    for (size_t i = 0; i < s_count; i++) hash_insert(i);
+}
+
+static int find(const char *name)
+{
+    if (!s_hash) return -1;
+    size_t mask = s_hash_cap - 1;
+    size_t slot = name_hash(name) & mask;
+    while (s_hash[slot]) {
+        size_t idx = s_hash[slot] - 1;
+        if (strcmp(s_entries[idx].name, name) == 0) return idx;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+static bool reserve(size_t want)
+{
+    if (want <= s_cap) return true;
+
+    size_t cap = s_cap ? s_cap : INITIAL_CAP;
+    while (cap < want) cap *= 2;
+
+    catalog_entry_t *e = heap_caps_realloc(s_entries, cap * sizeof(catalog_entry_t), MALLOC_CAP_SPIRAM);
+    if (!e) return false;
+    s_entries = e;
+    s_cap = cap;
+
+    if (s_hash_cap < 2 * cap) {
+        uint32_t *h = heap_caps_realloc(s_hash, 2 * cap * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+        if (!h) return false;
+        s_hash = h;
+        s_hash_cap = 2 * cap;
+        hash_rebuild();
+    }
+    return true;
+}
+
+static bool put(const catalog_entry_t *e)
+{
+    int idx = find(e->name);
+    if (idx >= 0) {
+        s_entries[idx] = *e;
+        return true;
+    }
+    if (!reserve(s_count + 1)) {
+        ESP_LOGE(TAG, "out of memory at %u entries", (unsigned)s_count);
+        return false;
+    }
+    s_entries[s_count] = *e;
+    hash_insert(s_count);
+    s_count++;
+    return true;
+}
+
+static bool del(const char *name)
+{
+    int idx = find(name);
+    if (idx < 0) return false;
+    s_entries[idx] = s_entries[--s_count];
+    hash_rebuild();
+    s_deletions++;
+    return true;
+}
+
+// --- Files ---
+
+// Size, duration, codec and mtime of a recording in the SD root
+static esp_err_t scan_file(const char *name, catalog_entry_t *e)
+{
+    if (strlen(name) >= CATALOG_NAME_LEN) return ESP_ERR_INVALID_ARG;
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, name);
+    struct stat st;
+    if (stat(path, &st) != 0) return ESP_ERR_NOT_FOUND;
+
+    memset(e, 0, sizeof(*e));
+    strcpy(e->name, name);
+    e->size = st.st_size;
+    e->mtime = st.st_mtime;
+    if (events_is_container(name)) e->flags |= CATALOG_F_CONTAINER;
+
+    uint8_t hdr[WAV_HEADER_SIZE];
+    FILE *f = fopen(path, "rb");
+    if (!f) return ESP_FAIL;
+    size_t got = fread(hdr, 1, sizeof(hdr), f);
+    fclose(f);
+
+    // Files that are not (yet) valid WAVs are still listed, with no duration
+    if (got == sizeof(hdr) && memcmp(hdr, "RIFF", 4) == 0 && memcmp(hdr + 8, "WAVE", 4) == 0) {
+        uint16_t format = hdr[20] | (hdr[21] << 8);
+        uint16_t block_align = hdr[32] | (hdr[33] << 8);
+        uint32_t data_size = hdr[40] | (hdr[41] << 8) | (hdr[42] << 16) | ((uint32_t)hdr[43] << 24);
+        if (data_size == 0 && e->size > WAV_HEADER_SIZE) data_size = e->size - WAV_HEADER_SIZE;
+        e->codec = (format == 7) ? CATALOG_CODEC_ULAW : CATALOG_CODEC_PCM16;
+        if (block_align) e->samples = data_size / block_align;
+    }
+
+    // Best guess until the recording path says otherwise
+    e->start_time = e->mtime - e->samples / AUDIO_SAMPLE_RATE;
+    return ESP_OK;
+}
+
+static void log_notify(void)
+{
+    if (++s_log_records == COMPACT_RECORDS && s_task) xTaskNotifyGive(s_task);
+}
+
+// Append one record to the log. Caller holds s_log_lock.
+static void log_append(uint8_t op, const catalog_entry_t *e)
+{
+    log_rec_t rec = { .op = op, .entry = *e };
+    FILE *f = fopen(LOG_PATH, "ab");
+    if (!f) {
+        ESP_LOGW(TAG, "cannot write %s", LOG_PATH);
+        return;
+    }
+    fwrite(&rec, sizeof(rec), 1, f);
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+    log_notify();
+}
+
+// Apply a log on top of what is loaded. A torn last record (power loss
+// mid-append) is dropped so later appends stay aligned.
+static uint32_t log_replay(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+
+    uint32_t n = 0;
+    log_rec_t rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        rec.entry.name[CATALOG_NAME_LEN - 1] = '\0';
+        if (rec.op == OP_PUT) {
+            put(&rec.entry);
+        } else if (rec.op == OP_DEL) {
+            del(rec.entry.name);
+        }
+        n++;
+    }
+    long size = ftell(f);
+    fclose(f);
+    if (size % sizeof(log_rec_t)) truncate(path, size - size % sizeof(log_rec_t));
+    return n;
+}
+
+static void snapshot_load(void)
+{
+    struct stat st;
+    if (stat(SNAP_PATH, &st) != 0 && stat(SNAP_TMP, &st) == 0) {
+        // Power was lost between removing the old snapshot and renaming
+        // the new one, which was already complete
+        rename(SNAP_TMP, SNAP_PATH);
+    } else {
+        unlink(SNAP_TMP);
+    }
+
+    FILE *f = fopen(SNAP_PATH, "rb");
+    if (!f) return;
+
+    snap_hdr_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, SNAP_MAGIC, 4) != 0 ||
+        hdr.version != SNAP_VERSION || hdr.entry_size != sizeof(catalog_entry_t)) {
+        ESP_LOGW(TAG, "ignoring unreadable snapshot");
+        fclose(f);
+        return;
+    }
+    if (!reserve(hdr.count)) {
+        ESP_LOGE(TAG, "no memory for %u entries", (unsigned)hdr.count);
+        fclose(f);
+        return;
+    }
+    s_count = fread(s_entries, sizeof(catalog_entry_t), hdr.count, f);
+    fclose(f);
+
+    for (size_t i = 0; i < s_count; i++) s_entries[i].name[CATALOG_NAME_LEN - 1] = '\0';
+    hash_rebuild();
+}
+
+// Fold the log into a new snapshot
+static esp_err_t compact(void)
+{
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+
+    // Copy under the lock, write without it
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t count = s_count;
+    catalog_entry_t *copy = NULL;
+    if (count) {
+        copy = heap_caps_malloc(count * sizeof(catalog_entry_t), MALLOC_CAP_SPIRAM);
+        if (copy) memcpy(copy, s_entries, count * sizeof(catalog_entry_t));
+    }
+    xSemaphoreGive(s_lock);
+    if (count && !copy) {
+        xSemaphoreGive(s_log_lock);
+        ESP_LOGW(TAG, "no memory to compact");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Set the current log aside; a leftover log.old from a failed
+    // compaction is covered by this snapshot too, so just extend it
+    struct stat st;
+    if (stat(LOG_OLD, &st) != 0) {
+        rename(LOG_PATH, LOG_OLD);
+    } else {
+        FILE *src = fopen(LOG_PATH, "rb");
+        FILE *dst = src ? fopen(LOG_OLD, "ab") : NULL;
+        if (dst) {
+            log_rec_t rec;
+            while (fread(&rec, sizeof(rec), 1, src) == 1) fwrite(&rec, sizeof(rec), 1, dst);
+            fflush(dst);
+            fsync(fileno(dst));
+            fclose(dst);
+        }
+        if (src) fclose(src);
+        if (dst) unlink(LOG_PATH);
+    }
+    s_log_records = 0;
+    xSemaphoreGive(s_log_lock);
+
+    esp_err_t ret = ESP_FAIL;
+    FILE *f = fopen(SNAP_TMP, "wb");
+    if (f) {
+        snap_hdr_t hdr = {
+            .magic = SNAP_MAGIC,
+            .version = SNAP_VERSION,
+            .entry_size = sizeof(catalog_entry_t),
+            .count = count,
+        };
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                  fwrite(copy, sizeof(catalog_entry_t), count, f) == count;
+        fflush(f);
+        fsync(fileno(f));
+        fclose(f);
+        if (ok) {
+            unlink(SNAP_PATH);
+            if (rename(SNAP_TMP, SNAP_PATH) == 0) {
+                unlink(LOG_OLD);
+                ret = ESP_OK;
+            }
+        } else {
+            unlink(SNAP_TMP);
+        }
+    }
+    heap_caps_free(copy);
+
+    if (ret == ESP_OK)
+        ESP_LOGI(TAG, "compacted %u entries", (unsigned)count);
+    else
+        ESP_LOGW(TAG, "compaction failed, keeping the log");
+    return ret;
+}
+
+static void catalog_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        compact();
+    }
+}
+
+// --- Boot-time consistency check ---
+
+// One pass over the SD root: add recordings the catalogue does not know
+// (copied by hand, or written by an older firmware) and forget the ones
+// that are gone. Known files are not stat'ed.
+static int reconcile_root(void)
+{
+    DIR *dir = opendir(SD_MOUNT_POINT);
+    if (!dir) return 0;
+
+    size_t known = s_count;
+    uint8_t *seen = known ? heap_caps_calloc(known, 1, MALLOC_CAP_SPIRAM) : NULL;
+    if (known && !seen) {
+        closedir(dir);
+        return 0;
+    }
+
+    int changes = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        char *ext = strrchr(ent->d_name, '.');
+        if (!ext || strcasecmp(ext, ".wav") != 0) continue;
+
+        int idx = find(ent->d_name);
+        if (idx >= 0) {
+            if ((size_t)idx < known) seen[idx] = 1;
+            continue;
+        }
+        catalog_entry_t e;
+        if (scan_file(ent->d_name, &e) == ESP_OK && put(&e)) changes++;
+    }
+    closedir(dir);
+
+    // Drop entries whose file has disappeared, keeping the new ones
+    size_t out = 0;
+    for (size_t i = 0; i < s_count; i++) {
+        if (i < known && !seen[i]) {
+            changes++;
+            continue;
+        }
+        s_entries[out++] = s_entries[i];
+    }
+    s_count = out;
+    hash_rebuild();
+    heap_caps_free(seen);
+    return changes;
+}
+
+// Waveform flags from one pass over the cache directory
+static int reconcile_waveforms(void)
+{
+    uint8_t *has = s_count ? heap_caps_calloc(s_count, 1, MALLOC_CAP_SPIRAM) : NULL;
+    if (s_count && !has) return 0;
+
+    DIR *dir = opendir(WAVEFORM_CACHE_DIR);
+    if (dir) {
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+            size_t len = strlen(ent->d_name);
+            if (len <= 4 || len - 4 >= CATALOG_NAME_LEN || strcmp(ent->d_name + len - 4, ".bin") != 0) continue;
+            char name[CATALOG_NAME_LEN];
+            memcpy(name, ent->d_name, len - 4);
+            name[len - 4] = '\0';
+            int idx = find(name);
+            if (idx >= 0) has[idx] = 1;
+        }
+        closedir(dir);
+    }
+
+    int changes = 0;
+    for (size_t i = 0; i < s_count; i++) {
+        bool flag = (s_entries[i].flags & CATALOG_F_WAVEFORM) != 0;
+        if (flag == (bool)has[i]) continue;
+        s_entries[i].flags ^= CATALOG_F_WAVEFORM;
+        changes++;
+    }
+    heap_caps_free(has);
+    return changes;
+}
+
+esp_err_t catalog_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_log_lock = xSemaphoreCreateMutex();
+    if (!s_lock || !s_log_lock) return ESP_ERR_NO_MEM;
+    if (!reserve(INITIAL_CAP)) return ESP_ERR_NO_MEM;
+
+    mkdir(CATALOG_DIR, 0755);
+
+    int64_t t0 = esp_timer_get_time();
+    snapshot_load();
+    size_t loaded = s_count;
+    uint32_t replayed = log_replay(LOG_OLD) + log_replay(LOG_PATH);
+    // Nothing is being recorded yet; an active entry was caught by a
+    // compaction and is refreshed by writer_recover()
+    for (size_t i = 0; i < s_count; i++) s_entries[i].flags &= ~CATALOG_F_ACTIVE;
+    int changes = reconcile_root();
+    changes += reconcile_waveforms();
+
+    ESP_LOGI(TAG, "%u recordings (%u from snapshot, %u log records, %d fixed) in %lld ms",
+             (unsigned)s_count, (unsigned)loaded, (unsigned)replayed, changes,
+             (long long)(esp_timer_get_time() - t0) / 1000);
+
+    if (replayed || changes) compact();
+
+    xTaskCreatePinnedToCore(catalog_task, "catalog", 3072, NULL, 1, &s_task, 0);
+    return ESP_OK;
+}
+
+// --- Updates ---
+
+void catalog_add_file(const char *name, uint16_t peak, uint16_t rms, int64_t start_time)
+{
+    catalog_entry_t e;
+    if (scan_file(name, &e) != ESP_OK) {
+        ESP_LOGW(TAG, "cannot catalogue %s", name);
+        return;
+    }
+
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find(name);
+    const catalog_entry_t *old = idx >= 0 ? &s_entries[idx] : NULL;
+
+    if (old && old->start_time && (e.flags & CATALOG_F_CONTAINER))
+        e.start_time = old->start_time;  // a container starts with its first event
+    else if (start_time)
+        e.start_time = start_time;
+
+    if (e.flags & CATALOG_F_CONTAINER)
+        e.peak = (old && old->peak > peak) ? old->peak : peak;
+    else
+        e.peak = peak ? peak : (old ? old->peak : 0);
+    e.rms = rms ? rms : (old ? old->rms : 0);
+    if (old) e.flags |= old->flags & CATALOG_F_WAVEFORM;
+
+    bool ok = put(&e);
+    xSemaphoreGive(s_lock);
+    if (ok) log_append(OP_PUT, &e);
+    xSemaphoreGive(s_log_lock);
+}
+
+void catalog_set_active(const char *name, uint32_t samples, bool ulaw,
+                        uint16_t peak, int64_t start_time)
+{
+    catalog_entry_t e = { 0 };
+    if (strlen(name) >= CATALOG_NAME_LEN) return;
+    strcpy(e.name, name);
+    e.samples = samples;
+    e.size = WAV_HEADER_SIZE + samples * (ulaw ? 1 : 2);
+    e.mtime = time(NULL);
+    e.start_time = start_time;
+    e.peak = peak;
+    e.codec = ulaw ? CATALOG_CODEC_ULAW : CATALOG_CODEC_PCM16;
+    e.flags = CATALOG_F_ACTIVE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    put(&e);
+    xSemaphoreGive(s_lock);
+}
+
+void catalog_remove(const char *name)
+{
+    catalog_entry_t e = { 0 };
+    strncpy(e.name, name, CATALOG_NAME_LEN - 1);
+
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = del(e.name);
+    xSemaphoreGive(s_lock);
+    if (found) log_append(OP_DEL, &e);
+    xSemaphoreGive(s_log_lock);
+}
+
+void catalog_set_waveform(const char *name, bool has_waveform)
+{
+    if (!s_lock) return;  // waveform caches touched before catalog_init
+
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find(name);
+    bool changed = false;
+    catalog_entry_t e;
+    if (idx >= 0 && ((s_entries[idx].flags & CATALOG_F_WAVEFORM) != 0) != has_waveform) {
+        s_entries[idx].flags ^= CATALOG_F_WAVEFORM;
+        e = s_entries[idx];
+        changed = true;
+    }
+    xSemaphoreGive(s_lock);
+    if (changed) log_append(OP_PUT, &e);
+    xSemaphoreGive(s_log_lock);
+}
+
+// --- Queries ---
+
+bool catalog_get(const char *name, catalog_entry_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find(name);
+    if (idx >= 0) *out = s_entries[idx];
+    xSemaphoreGive(s_lock);
+    return idx >= 0;
+}
+
+size_t catalog_count(void)
+{
+    return s_count;
+}
+
+size_t catalog_snapshot(catalog_entry_t **out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t count = s_count;
+    *out = count ? heap_caps_malloc(count * sizeof(catalog_entry_t), MALLOC_CAP_SPIRAM) : NULL;
+    if (*out)
+        memcpy(*out, s_entries, count * sizeof(catalog_entry_t));
+    else
+        count = 0;
+    xSemaphoreGive(s_lock);
+    return count;
+}
+
+// name_pN.wav with a name.wav in the catalogue. Lock held.
+static bool is_later_part(const char *name)
+{
+    const char *p = strrchr(name, '_');
+    if (!p || p[1] != 'p' || !isdigit((unsigned char)p[2])) return false;
+    const char *q = p + 2;
+    while (isdigit((unsigned char)*q)) q++;
+    if (strcasecmp(q, ".wav") != 0) return false;
+
+    char first[CATALOG_NAME_LEN];
+    snprintf(first, sizeof(first), "%.*s.wav", (int)(p - name), name);
+    return find(first) >= 0;
+}
+
+static bool query_match(const catalog_query_t *q, const catalog_entry_t *e)
+{
+    if (q->from && e->start_time < q->from) return false;
+    if (q->to && e->start_time >= q->to) return false;
+    if (q->groups && is_later_part(e->name)) return false;
+    return true;
+}
+
+// qsort has no context argument; only used with s_lock held
+static const catalog_query_t *s_sort_q;
+
+static int64_t sort_key(const catalog_entry_t *e)
+{
+    switch (s_sort_q->sort) {
+    case CATALOG_SORT_SIZE:     return e->size;
+    case CATALOG_SORT_DURATION: return e->samples;
+    case CATALOG_SORT_PEAK:     return e->peak;
+    case CATALOG_SORT_RMS:      return e->rms;
+    default:                    return e->start_time;
+    }
+}
+
+static int sort_cmp(const void *pa, const void *pb)
+{
+    const catalog_entry_t *a = &s_entries[*(const uint32_t *)pa];
+    const catalog_entry_t *b = &s_entries[*(const uint32_t *)pb];
+    int c;
+    if (s_sort_q->sort == CATALOG_SORT_NAME) {
+        c = strcmp(a->name, b->name);
+    } else {
+        int64_t ka = sort_key(a), kb = sort_key(b);
+        c = (ka > kb) - (ka < kb);
+        if (c == 0) c = strcmp(a->name, b->name);  // stable pages
+    }
+    return s_sort_q->descending ? -c : c;
+}
+
+size_t catalog_query(const catalog_query_t *q, size_t offset,
+                     catalog_entry_t *out, size_t max, size_t *total)
+{
+    size_t matches = 0, copied = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    if (q->sort == CATALOG_SORT_NONE) {
+        for (size_t i = 0; i < s_count; i++) {
+            if (!query_match(q, &s_entries[i])) continue;
+            if (matches >= offset && copied < max) out[copied++] = s_entries[i];
+            matches++;
+        }
+    } else {
+        uint32_t *idx = s_count ? heap_caps_malloc(s_count * sizeof(uint32_t), MALLOC_CAP_SPIRAM) : NULL;
+        if (idx) {
+            for (size_t i = 0; i < s_count; i++) {
+                if (query_match(q, &s_entries[i])) idx[matches++] = i;
+            }
+            s_sort_q = q;
+            qsort(idx, matches, sizeof(uint32_t), sort_cmp);
+            for (size_t i = offset; i < matches && copied < max; i++) {
+                out[copied++] = s_entries[idx[i]];
+            }
+            heap_caps_free(idx);
+        } else if (s_count) {
+            ESP_LOGW(TAG, "no memory to sort %u entries", (unsigned)s_count);
+        }
+    }
+
+    xSemaphoreGive(s_lock);
+    if (total) *total = matches;
+    return copied;
+}
+
+int catalog_max_rec_number(void)
+{
+    int max_num = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < s_count; i++) {
+        const char *name = s_entries[i].name;
+        int n;
+        if (name[0] == 'r' && sscanf(name, "rec_%d.wav", &n) == 1 && n > max_num) max_num = n;
+    }
+    xSemaphoreGive(s_lock);
+    return max_num;
+}
+
+int catalog_missing_waveforms(catalog_cursor_t *cursor, char (*names)[CATALOG_NAME_LEN], int max)
+{
+    int n = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (cursor->deletions != s_deletions) {
+        // The last entry was swapped into a hole, possibly from behind the cursor
+        cursor->deletions = s_deletions;
+        cursor->index = 0;
+    }
+    size_t i = cursor->index;
+    for (; i < s_count && n < max; i++) {
+        if (s_entries[i].flags & (CATALOG_F_WAVEFORM | CATALOG_F_ACTIVE)) continue;
+        strcpy(names[n++], s_entries[i].name);
+    }
+    cursor->index = i;
+    xSemaphoreGive(s_lock);
+    return n;
+}
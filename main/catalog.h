@@ -0,0 +1,101 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Catalogue of the recordings in the SD root, kept in PSRAM so listing,
+// numbering and waveform backlog checks never scan the directory.
+// Persisted in CATALOG_DIR as a snapshot plus an append-only change log;
+// the log is folded into a new snapshot in the background once it grows.
+
+#define CATALOG_DIR       "/sdcard/.catalog"
+#define CATALOG_NAME_LEN  48
+
+#define CATALOG_CODEC_PCM16  0
+#define CATALOG_CODEC_ULAW   1
+
+#define CATALOG_F_WAVEFORM   0x01   // waveform cache exists
+#define CATALOG_F_CONTAINER  0x02   // event container (see events.h)
+#define CATALOG_F_ACTIVE     0x04   // still being recorded, not finalised
+
+typedef struct {
+    char     name[CATALOG_NAME_LEN];
+    uint32_t size;          // file size in bytes
+    uint32_t samples;       // duration in samples
+    int64_t  start_time;    // unix time of the first sample, 0 if unknown
+    int64_t  mtime;         // unix time of the last change
+    uint16_t peak;          // max |sample|, 0 if unknown
+    uint16_t rms;           // RMS over the file, 0 if unknown
+    uint8_t  codec;         // CATALOG_CODEC_*
+    uint8_t  flags;         // CATALOG_F_*
+    uint16_t reserved;
+} catalog_entry_t;
+
+// Load the catalogue and reconcile it with the SD root and the waveform
+// cache directory. Call once after sdcard_init(), before recording starts.
+esp_err_t catalog_init(void);
+
+// Add or refresh a recording after it was written: size, duration and codec
+// come from the file itself. peak/rms/start_time of 0 mean unknown; for an
+// existing entry unknown values and the waveform flag are kept.
+void catalog_add_file(const char *name, uint16_t peak, uint16_t rms, int64_t start_time);
+
+// List or update the part the writer is recording, flagged active, from
+// what the writer knows instead of the file. Not logged: the entry lives in
+// RAM until catalog_add_file() finalises it; after a power loss the boot
+// reconciliation and writer_recover() catalogue the file.
+void catalog_set_active(const char *name, uint32_t samples, bool ulaw,
+                        uint16_t peak, int64_t start_time);
+
+void catalog_remove(const char *name);
+
+void catalog_set_waveform(const char *name, bool has_waveform);
+
+bool catalog_get(const char *name, catalog_entry_t *out);
+
+size_t catalog_count(void);
+
+// Copy of every entry in a PSRAM buffer the caller frees. Returns the count
+// (0 with *out NULL if empty or out of memory).
+size_t catalog_snapshot(catalog_entry_t **out);
+
+typedef enum {
+    CATALOG_SORT_NONE = 0,  // catalogue order, no allocation
+    CATALOG_SORT_TIME,      // start_time
+    CATALOG_SORT_SIZE,
+    CATALOG_SORT_DURATION,
+    CATALOG_SORT_PEAK,
+    CATALOG_SORT_RMS,
+    CATALOG_SORT_NAME,
+} catalog_sort_t;
+
+typedef struct {
+    catalog_sort_t sort;
+    bool descending;
+    int64_t from;           // start_time >= from (0: no lower bound)
+    int64_t to;             // start_time < to (0: no upper bound)
+    bool groups;            // one entry per split recording: leave out name_pN.wav
+                            // parts whose name.wav is listed (see group.h)
+} catalog_query_t;
+
+// Filter and sort the catalogue, then copy results [offset, offset + max)
+// into out. Returns the number copied; total (optional) receives the number
+// of matches. Sorting needs a temporary index of 4 bytes per entry.
+size_t catalog_query(const catalog_query_t *q, size_t offset,
+                     catalog_entry_t *out, size_t max, size_t *total);
+
+// Highest N of any rec_NNN.wav, 0 if none.
+int catalog_max_rec_number(void);
+
+typedef struct {
+    size_t index;
+    uint32_t deletions;     // catalogue deletions seen when index was taken
+} catalog_cursor_t;
+
+// Up to max names of finalised recordings without a waveform cache,
+// continuing from *cursor (start zeroed). A deletion moves entries around,
+// so the walk starts over after one. Returns 0 once the whole catalogue
+// has been seen.
+int catalog_missing_waveforms(catalog_cursor_t *cursor, char (*names)[CATALOG_NAME_LEN], int max);
@@ -0,0 +1,59 @@
+#include "cmdq.h"
+
+// Bounded MPSC queue after Vyukov: each cell carries a sequence number
+// telling producers and the consumer whose turn it is. Producers claim a
+// position with one CAS on s_head; the consumer owns s_tail outright.
+
+typedef struct {
+    uint32_t seq;
+    cmd_t cmd;
+} cell_t;
+
+static cell_t s_cells[CMDQ_SIZE];
+static uint32_t s_head;   // next position to claim (producers)
+static uint32_t s_tail;   // next position to read (consumer)
+
+void cmdq_init(void)
+{
+    for (uint32_t i = 0; i < CMDQ_SIZE; i++) {
+        __atomic_store_n(&s_cells[i].seq, i, __ATOMIC_RELAXED);
+    }
+    s_tail = 0;
+    __atomic_store_n(&s_head, 0, __ATOMIC_RELEASE);
+}
+
+bool cmdq_push(const cmd_t *cmd)
+{
+    uint32_t pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    cell_t *cell;
+    for (;;) {
+        cell = &s_cells[pos & (CMDQ_SIZE - 1)];
+        uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&s_head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            // pos was reloaded by the failed CAS
+        } else if (diff < 0) {
+            return false;  // full: the consumer has not freed this cell yet
+        } else {
+            pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+        }
+    }
+    cell->cmd = *cmd;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool cmdq_pop(cmd_t *out)
+{
+    cell_t *cell = &s_cells[s_tail & (CMDQ_SIZE - 1)];
+    uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    if ((int32_t)(seq - (s_tail + 1)) < 0) return false;  // empty, or still being filled
+    *out = cell->cmd;
+    __atomic_store_n(&cell->seq, s_tail + CMDQ_SIZE, __ATOMIC_RELEASE);
+    s_tail++;
+    return true;
+}
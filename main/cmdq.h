@@ -0,0 +1,44 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Commands from the web tasks to the audio task. Producers on any task
+// push into a bounded lock-free queue (no mutex, never waits); the audio
+// task drains it between frames, so the web server never waits on SD
+// writes or waveform scans done there.
+
+#define CMDQ_SIZE 16  // power of two
+
+typedef enum {
+    CMD_REC_START = 0,
+    CMD_REC_STOP,
+    CMD_SET_AUTO,       // a: enabled
+    CMD_SET_THRESHOLD,  // a: RMS threshold
+    CMD_SET_CODEC,      // a: u-law
+    CMD_SET_FILTER,     // a: high-pass Hz, b: low-pass Hz (0 = off)
+    CMD_SET_VAD,        // a: TRIGGER_MODE_*
+    CMD_SET_TIMING,     // a: silence s, b: minimum event ms
+    CMD_SET_PREROLL,    // a: pre-roll s
+    CMD_SET_CONTAINER,  // a: events go to a daily container
+} cmd_type_t;
+
+// Completion, called on the audio task once the command was applied.
+// Must not block: hand the result on (e.g. httpd_queue_work) and return.
+typedef void (*cmd_done_fn)(void *ctx, esp_err_t result);
+
+typedef struct {
+    cmd_type_t type;
+    int32_t a, b;
+    cmd_done_fn done;   // optional
+    void *ctx;
+} cmd_t;
+
+void cmdq_init(void);
+
+// Any task. Returns false if the queue is full.
+bool cmdq_push(const cmd_t *cmd);
+
+// Consumer (audio task) only. Returns false if empty.
+bool cmdq_pop(cmd_t *out);
@@ -0,0 +1,156 @@
+#include "codec.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+uint8_t codec_ulaw(int16_t sample)
+{
+    const int16_t BIAS = 0x84;   // 132
+    const int16_t CLIP = 32635;
+    uint8_t sign = 0;
+    if (sample < 0) {
+        sign = 0x80;
+        sample = -sample;
+    }
+    if (sample > CLIP) sample = CLIP;
+    sample += BIAS;
+
+    // Find segment (exponent)
+    int seg = 0;
+    int shifted = sample >> 8;
+    while (shifted > 0) {
+        seg++;
+        shifted >>= 1;
+    }
+    // Build µ-law byte: sign(1) | exponent(3) | mantissa(4)
+    uint8_t uval = (uint8_t)(sign | ((uint8_t)seg << 4) |
+                              ((sample >> (seg + 3)) & 0x0F));
+    return ~uval;  // complement per standard
+}
+
+void codec_ulaw_encode(const int16_t *in, size_t n, uint8_t *out)
+{
+    for (size_t i = 0; i < n; i++) out[i] = codec_ulaw(in[i]);
+}
+
+// --- IMA ADPCM ---
+
+static const int16_t s_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+
+static const int8_t s_index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static uint8_t adpcm_sample(codec_adpcm_t *st, int16_t sample)
+{
+    int step = s_step_table[st->index];
+    int diff = sample - st->predictor;
+    uint8_t nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    // Quantize and reconstruct exactly as the decoder will
+    int delta = step >> 3;
+    if (diff >= step) { nibble |= 4; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { nibble |= 2; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { nibble |= 1; delta += step; }
+
+    int pred = st->predictor + ((nibble & 8) ? -delta : delta);
+    if (pred > 32767) pred = 32767;
+    if (pred < -32768) pred = -32768;
+    st->predictor = (int16_t)pred;
+
+    int index = st->index + s_index_table[nibble & 7];
+    if (index < 0) index = 0;
+    if (index > 88) index = 88;
+    st->index = (uint8_t)index;
+    return nibble;
+}
+
+size_t codec_adpcm_encode(codec_adpcm_t *st, const int16_t *in, size_t n, uint8_t *out)
+{
+    out[0] = (uint8_t)st->predictor;
+    out[1] = (uint8_t)((uint16_t)st->predictor >> 8);
+    out[2] = st->index;
+    out[3] = 0;
+    uint8_t *p = out + CODEC_ADPCM_HDR;
+    for (size_t i = 0; i + 1 < n; i += 2) {
+        uint8_t lo = adpcm_sample(st, in[i]);
+        uint8_t hi = adpcm_sample(st, in[i + 1]);
+        *p++ = lo | (hi << 4);
+    }
+    return p - out;
+}
+
+// --- 20 kHz -> 8 kHz ---
+// Upsample by 2 (zero-stuffing), low-pass at 3.2 kHz, keep every 5th
+// sample. Only every other tap meets a non-zero input, so each output is a
+// 24-tap dot product over the original samples.
+
+#define DECIM_HIST (CODEC_DECIM_TAPS / 2 - 1)
+
+static float s_taps[CODEC_DECIM_TAPS];
+static bool s_taps_ready = false;
+
+static void design_taps(void)
+{
+    const float fc = 3200.0f / 40000.0f;  // cutoff at the 40 kHz upsampled rate
+    const float mid = (CODEC_DECIM_TAPS - 1) / 2.0f;
+    float sum = 0;
+    for (int j = 0; j < CODEC_DECIM_TAPS; j++) {
+        float t = j - mid;
+        float sinc = 2 * fc * sinf(2 * (float)M_PI * fc * t) / (2 * (float)M_PI * fc * t);
+        float win = 0.54f - 0.46f * cosf(2 * (float)M_PI * j / (CODEC_DECIM_TAPS - 1));
+        s_taps[j] = sinc * win;
+        sum += s_taps[j];
+    }
+    // Unity DC gain after zero-stuffing halves the signal
+    for (int j = 0; j < CODEC_DECIM_TAPS; j++) s_taps[j] *= 2 / sum;
+    s_taps_ready = true;
+}
+
+void codec_decim_reset(codec_decim_t *st)
+{
+    if (!s_taps_ready) design_taps();
+    memset(st, 0, sizeof(*st));
+}
+
+size_t codec_decim_8k(codec_decim_t *st, const int16_t *in, size_t n, int16_t *out)
+{
+    size_t count = 0;
+    unsigned k = st->next;  // position at 40 kHz; input sample k/2 is the newest tap
+    for (; k < 2 * n; k += 5) {
+        const float *h = &s_taps[k & 1];
+        int newest = k >> 1;
+        float acc = 0;
+        for (int i = 0; i < CODEC_DECIM_TAPS / 2; i++) {
+            int idx = newest - i;
+            int16_t x = idx >= 0 ? in[idx] : st->hist[DECIM_HIST + idx];
+            acc += h[2 * i] * x;
+        }
+        if (acc > 32767) acc = 32767;
+        if (acc < -32768) acc = -32768;
+        out[count++] = (int16_t)lrintf(acc);
+    }
+    st->next = (uint8_t)(k - 2 * n);
+
+    // Keep the newest DECIM_HIST inputs for the next frame
+    if (n >= DECIM_HIST) {
+        memcpy(st->hist, in + n - DECIM_HIST, DECIM_HIST * sizeof(int16_t));
+    } else {
+        memmove(st->hist, st->hist + n, (DECIM_HIST - n) * sizeof(int16_t));
+        memcpy(st->hist + DECIM_HIST - n, in, n * sizeof(int16_t));
+    }
+    return count;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Sample encoders shared by the WAV writer and the live stream. Stateful
+// ones keep their state in a caller-owned struct so the stream task can run
+// one instance per format.
+
+// ITU-T G.711 µ-law: 16-bit linear PCM -> 8-bit µ-law
+uint8_t codec_ulaw(int16_t sample);
+void codec_ulaw_encode(const int16_t *in, size_t n, uint8_t *out);
+
+// IMA ADPCM, 4 bits per sample
+#define CODEC_ADPCM_HDR 4
+
+typedef struct {
+    int16_t predictor;
+    uint8_t index;
+} codec_adpcm_t;
+
+// Encode n samples (n even) as a self-contained block: a 4-byte header with
+// the state before the block (predictor int16 LE, step index, 0), then n/2
+// bytes, first sample in the low nibble. A decoder can start on any block.
+// Returns bytes written.
+size_t codec_adpcm_encode(codec_adpcm_t *st, const int16_t *in, size_t n, uint8_t *out);
+
+// 20 kHz -> 8 kHz (2/5) polyphase low-pass resampler
+#define CODEC_DECIM_TAPS 48
+
+typedef struct {
+    int16_t hist[CODEC_DECIM_TAPS / 2 - 1];  // last input samples
+    uint8_t next;                            // next output, in 40 kHz steps past the frame start
+} codec_decim_t;
+
+void codec_decim_reset(codec_decim_t *st);
+
+// Returns output samples written (n * 2 / 5, give or take one across frames).
+size_t codec_decim_8k(codec_decim_t *st, const int16_t *in, size_t n, int16_t *out);
@@ -0,0 +1,599 @@
+#include "dashcam.h"
+#include "wav.h"
+#include "sdcard.h"
+#include "audio.h"
+#include "waveform.h"
+#include "catalog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "dashcam";
+
+#define SEG_SAMPLES    (DASHCAM_SEG_SECONDS * AUDIO_SAMPLE_RATE)
+#define SEG_FILE_SIZE  (44 + SEG_SAMPLES * sizeof(int16_t))
+#define MAX_SLOTS      (DASHCAM_MAX_MINUTES * 60 / DASHCAM_SEG_SECONDS)
+#define BLOCK_SAMPLES  4000  // 8KB = 200ms @ 20kHz
+#define POOL_BLOCKS    4
+#define SPARE_SLOTS    6     // preallocated files that replace saved-out slots
+#define INDEX_PATH     DASHCAM_DIR "/index.bin"
+
+// Ring index on the card: header followed by one entry per slot
+typedef struct __attribute__((packed)) {
+    char     magic[4];      // "DCIX"
+    uint16_t version;
+    uint16_t num_slots;
+    uint32_t seg_samples;
+    uint32_t session;       // bumped every time the ring is (re)opened
+} dc_index_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;           // 0 = empty
+    uint32_t session;       // slots are contiguous only within a session
+    uint32_t samples;       // valid samples in the slot
+    int64_t  start_time;    // wall clock of the first sample
+} dc_slot_t;
+
+typedef struct {
+    uint32_t seconds;
+    char *name_out;
+    size_t name_size;
+    int parts;
+    esp_err_t result;
+    SemaphoreHandle_t done;
+} dc_save_req_t;
+
+typedef enum {
+    DMSG_DATA = 0,
+    DMSG_CONFIG,
+    DMSG_SAVE,
+} dmsg_type_t;
+
+typedef struct {
+    dmsg_type_t type;
+    int16_t *block;         // DATA
+    size_t count;           // DATA
+    dc_save_req_t *save;    // SAVE
+} dmsg_t;
+
+static QueueHandle_t s_msg_queue = NULL;
+static QueueHandle_t s_free_queue = NULL;
+
+// Settings (written by web handlers, read by audio task)
+static volatile bool s_enabled = false;
+static volatile int s_minutes = DASHCAM_DEF_MINUTES;
+static volatile uint32_t s_dropped = 0;
+static volatile uint32_t s_available = 0;  // samples
+
+// Producer side -- only touched by the audio task
+static int16_t *s_fill = NULL;
+static size_t s_fill_pos = 0;
+
+// Ring state -- dashcam task only
+static dc_index_hdr_t s_hdr;
+static dc_slot_t s_slots[MAX_SLOTS];
+static bool s_ready = false;
+static FILE *s_cur = NULL;
+static int s_cur_slot = 0;
+static uint32_t s_next_seq = 1;
+static bool s_waiting = false;     // current slot was saved out and no spare is ready
+static TaskHandle_t s_spare_task = NULL;
+
+static void slot_path(int slot, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%s/seg_%03d.wav", DASHCAM_DIR, slot);
+}
+
+static void index_write(void)
+{
+    FILE *f = fopen(INDEX_PATH, "r+b");
+    if (!f) f = fopen(INDEX_PATH, "wb");
+    if (!f) {
+        ESP_LOGW(TAG, "cannot write index");
+        return;
+    }
+    fwrite(&s_hdr, sizeof(s_hdr), 1, f);
+    fwrite(s_slots, sizeof(dc_slot_t), s_hdr.num_slots, f);
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+}
+
+static void spare_path(int spare, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%s/spare_%d.wav", DASHCAM_DIR, spare);
+}
+
+// Preallocate a slot file: a PCM16 WAV whose header already covers a full
+// segment
+static bool file_create(const char *path)
+{
+    static const int16_t zeros[512];
+    FILE *f = wav_open(path, AUDIO_SAMPLE_RATE, 16, 1);
+    if (!f) return false;
+    for (size_t n = 0; n < SEG_SAMPLES; n += 512) {
+        if (wav_write(f, zeros, 512) != 512) {
+            fclose(f);
+            unlink(path);
+            return false;
+        }
+    }
+    wav_close(f);
+    return true;
+}
+
+static bool file_ready(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && st.st_size == SEG_FILE_SIZE;
+}
+
+static bool slot_create(int slot)
+{
+    char path[64];
+    slot_path(slot, path, sizeof(path));
+    return file_create(path);
+}
+
+static bool slot_exists(int slot)
+{
+    char path[64];
+    slot_path(slot, path, sizeof(path));
+    return file_ready(path);
+}
+
+// Put a ready spare where a saved-out slot was: a rename, not a 400 KB write
+// on the task that drains the audio blocks. The spare task refills it.
+static bool slot_from_spare(int slot)
+{
+    char src[64], dst[64];
+    slot_path(slot, dst, sizeof(dst));
+    for (int i = 0; i < SPARE_SLOTS; i++) {
+        spare_path(i, src, sizeof(src));
+        if (rename(src, dst) == 0) {
+            xTaskNotifyGive(s_spare_task);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lowest priority: keep SPARE_SLOTS spare files on the card while the ring
+// is in use. Each is written under a temporary name, so a spare_N.wav is
+// always whole.
+static void spare_task(void *arg)
+{
+    char path[64], tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s/spare.tmp", DASHCAM_DIR);
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (int i = 0; i < SPARE_SLOTS && s_enabled; i++) {
+            spare_path(i, path, sizeof(path));
+            if (file_ready(path)) continue;
+            if (!file_create(tmp) || rename(tmp, path) != 0) {
+                ESP_LOGW(TAG, "cannot prepare spare slot %d", i);
+                unlink(tmp);
+                break;
+            }
+        }
+    }
+}
+
+// Walk back from the newest slot over contiguous, full segments (the newest
+// may be partial). Fills list[] oldest-first; returns the slot count.
+static int collect_newest(uint32_t want_samples, int *list, uint32_t *total_out)
+{
+    int n = s_hdr.num_slots;
+    int tmp[MAX_SLOTS];
+    int count = 0;
+    uint32_t total = 0;
+
+    int i = s_cur_slot;
+    if (s_slots[i].seq == 0 || s_slots[i].samples == 0) i = (i - 1 + n) % n;
+
+    while (count < n && total < want_samples) {
+        const dc_slot_t *e = &s_slots[i];
+        if (e->seq == 0 || e->samples == 0) break;
+        if (count > 0) {
+            const dc_slot_t *newer = &s_slots[tmp[count - 1]];
+            if (e->seq + 1 != newer->seq || e->session != newer->session ||
+                e->samples != SEG_SAMPLES) break;
+        }
+        tmp[count++] = i;
+        total += e->samples;
+        i = (i - 1 + n) % n;
+    }
+
+    for (int k = 0; k < count; k++) list[k] = tmp[count - 1 - k];
+    if (total_out) *total_out = total;
+    return count;
+}
+
+static void update_available(void)
+{
+    int list[MAX_SLOTS];
+    uint32_t total = 0;
+    collect_newest(UINT32_MAX, list, &total);
+    s_available = total;
+}
+
+static void slot_begin(void)
+{
+    char path[64];
+    slot_path(s_cur_slot, path, sizeof(path));
+
+    // A slot moved out by a save takes a spare. With none ready the ring
+    // pauses (audio is dropped and counted) until the spare task has one.
+    if (!slot_exists(s_cur_slot) && !slot_from_spare(s_cur_slot)) {
+        if (!s_waiting) ESP_LOGW(TAG, "no spare for slot %d yet, pausing", s_cur_slot);
+        s_waiting = true;
+        xTaskNotifyGive(s_spare_task);
+        return;
+    }
+    if (s_waiting) {
+        // The gap ends contiguity with the slots before it
+        s_waiting = false;
+        s_hdr.session++;
+    }
+
+    s_cur = fopen(path, "r+b");
+    if (!s_cur) {
+        ESP_LOGE(TAG, "cannot open slot %d", s_cur_slot);
+        s_ready = false;
+        return;
+    }
+    fseek(s_cur, 44, SEEK_SET);
+
+    dc_slot_t *e = &s_slots[s_cur_slot];
+    e->seq = s_next_seq++;
+    e->session = s_hdr.session;
+    e->samples = 0;
+    e->start_time = time(NULL);
+    index_write();
+}
+
+static void slot_end(void)
+{
+    if (!s_cur) return;
+    fclose(s_cur);
+    s_cur = NULL;
+    index_write();
+    update_available();
+}
+
+static void ring_close(void)
+{
+    slot_end();
+    s_ready = false;
+    s_waiting = false;
+}
+
+static void ring_open(void)
+{
+    int n = s_minutes * 60 / DASHCAM_SEG_SECONDS;
+    mkdir(DASHCAM_DIR, 0755);
+
+    bool valid = false;
+    FILE *f = fopen(INDEX_PATH, "rb");
+    if (f) {
+        valid = fread(&s_hdr, sizeof(s_hdr), 1, f) == 1 &&
+                memcmp(s_hdr.magic, "DCIX", 4) == 0 && s_hdr.version == 1 &&
+                s_hdr.num_slots == n && s_hdr.seg_samples == SEG_SAMPLES &&
+                fread(s_slots, sizeof(dc_slot_t), n, f) == (size_t)n;
+        fclose(f);
+    }
+    if (!valid) {
+        ESP_LOGI(TAG, "new ring: %d slots x %ds", n, DASHCAM_SEG_SECONDS);
+        memcpy(s_hdr.magic, "DCIX", 4);
+        s_hdr.version = 1;
+        s_hdr.num_slots = n;
+        s_hdr.seg_samples = SEG_SAMPLES;
+        s_hdr.session = 0;
+        memset(s_slots, 0, sizeof(s_slots));
+    }
+    s_hdr.session++;
+
+    // Drop slots from a previously larger ring
+    for (int i = n; i < MAX_SLOTS; i++) {
+        char path[64];
+        slot_path(i, path, sizeof(path));
+        unlink(path);
+    }
+
+    // Preallocate once; afterwards slots are only overwritten in place (or
+    // replaced by spares after a save)
+    int created = 0;
+    for (int i = 0; i < n; i++) {
+        if (slot_exists(i)) continue;
+        if (!slot_from_spare(i) && !slot_create(i)) {
+            ESP_LOGE(TAG, "preallocation failed at slot %d", i);
+            return;
+        }
+        s_slots[i].seq = 0;
+        created++;
+        vTaskDelay(1);
+    }
+    if (created) ESP_LOGI(TAG, "preallocated %d slots", created);
+
+    // Continue after the newest segment so history is kept
+    uint32_t max_seq = 0;
+    int newest = n - 1;
+    for (int i = 0; i < n; i++) {
+        if (s_slots[i].seq > max_seq) {
+            max_seq = s_slots[i].seq;
+            newest = i;
+        }
+    }
+    s_next_seq = max_seq + 1;
+    s_cur_slot = (newest + 1) % n;
+    s_ready = true;
+    slot_begin();
+    update_available();
+    xTaskNotifyGive(s_spare_task);
+}
+
+static void handle_data(const dmsg_t *m)
+{
+    const int16_t *p = m->block;
+    size_t remaining = m->count;
+
+    if (s_ready && s_waiting) slot_begin();
+    if (s_ready && !s_cur) s_dropped += remaining;
+
+    while (s_ready && s_cur && remaining > 0) {
+        dc_slot_t *e = &s_slots[s_cur_slot];
+        size_t n = SEG_SAMPLES - e->samples;
+        if (n > remaining) n = remaining;
+        fwrite(p, sizeof(int16_t), n, s_cur);
+        e->samples += n;
+        p += n;
+        remaining -= n;
+
+        if (e->samples >= SEG_SAMPLES) {
+            slot_end();
+            s_cur_slot = (s_cur_slot + 1) % s_hdr.num_slots;
+            slot_begin();
+        }
+    }
+    xQueueSend(s_free_queue, &m->block, portMAX_DELAY);
+}
+
+static void saved_name(const char *base, int part, char *out, size_t out_size)
+{
+    if (part <= 1)
+        snprintf(out, out_size, "%s.wav", base);
+    else
+        snprintf(out, out_size, "%s_p%d.wav", base, part);
+}
+
+static void handle_save(dc_save_req_t *req)
+{
+    if (!s_hdr.num_slots) {
+        req->result = ESP_ERR_INVALID_STATE;
+        xSemaphoreGive(req->done);
+        return;
+    }
+
+    // Finish the slot being written so it can be included
+    bool was_writing = (s_cur != NULL);
+    if (s_cur) {
+        fflush(s_cur);
+        fclose(s_cur);
+        s_cur = NULL;
+    }
+
+    int list[MAX_SLOTS];
+    uint64_t want = (uint64_t)req->seconds * AUDIO_SAMPLE_RATE;
+    int count = collect_newest(want > UINT32_MAX ? UINT32_MAX : (uint32_t)want, list, NULL);
+    if (count == 0) {
+        req->result = ESP_ERR_NOT_FOUND;
+        xSemaphoreGive(req->done);
+        if (was_writing) slot_begin();
+        return;
+    }
+
+    // Name after the first sample's wall clock, like regular recordings
+    char base[48];
+    struct tm ti;
+    time_t t0 = (time_t)s_slots[list[0]].start_time;
+    localtime_r(&t0, &ti);
+    if (ti.tm_year + 1900 >= 2024) {
+        snprintf(base, sizeof(base), "%04d-%02d-%02d_%02d-%02d-%02d_dc",
+                 ti.tm_year + 1900, ti.tm_mon + 1, ti.tm_mday,
+                 ti.tm_hour, ti.tm_min, ti.tm_sec);
+    } else {
+        snprintf(base, sizeof(base), "dc_%05u", (unsigned)s_slots[list[0]].seq);
+    }
+
+    int parts = 0;
+    for (int k = 0; k < count; k++) {
+        dc_slot_t *e = &s_slots[list[k]];
+        char src[64], name[64], dst[128];
+        slot_path(list[k], src, sizeof(src));
+        saved_name(base, k + 1, name, sizeof(name));
+        snprintf(dst, sizeof(dst), "%s/%s", SD_MOUNT_POINT, name);
+
+        // A partial (newest) slot: cut off the stale tail, fix the header
+        if (e->samples < SEG_SAMPLES) {
+            truncate(src, 44 + e->samples * sizeof(int16_t));
+            wav_repair(src, NULL);
+        }
+        if (rename(src, dst) != 0) {
+            ESP_LOGE(TAG, "cannot move slot %d to %s", list[k], name);
+            break;
+        }
+        catalog_add_file(name, 0, 0, e->start_time);
+        memset(e, 0, sizeof(*e));
+        parts++;
+    }
+    index_write();
+    update_available();
+
+    if (parts > 0) {
+        saved_name(base, 1, req->name_out, req->name_size);
+        req->parts = parts;
+        req->result = ESP_OK;
+        ESP_LOGI(TAG, "saved %d segment(s) as %s", parts, req->name_out);
+    } else {
+        req->result = ESP_FAIL;
+    }
+    xSemaphoreGive(req->done);  // req is invalid from here on
+
+    // Resume in the next slot; the moved ones are recreated on wrap
+    if (was_writing) {
+        s_cur_slot = (s_cur_slot + 1) % s_hdr.num_slots;
+        slot_begin();
+    }
+
+    // Caches are a scan of every part; on this task that would stall the
+    // ring and drop audio for as long
+    for (int k = 1; k <= parts; k++) {
+        char name[64];
+        saved_name(base, k, name, sizeof(name));
+        waveform_request(name);
+    }
+}
+
+static void dashcam_task(void *arg)
+{
+    if (s_enabled) ring_open();
+
+    dmsg_t m;
+    while (1) {
+        if (xQueueReceive(s_msg_queue, &m, portMAX_DELAY) != pdTRUE) continue;
+
+        switch (m.type) {
+        case DMSG_DATA:
+            handle_data(&m);
+            break;
+        case DMSG_CONFIG:
+            ring_close();
+            if (s_enabled) ring_open();
+            break;
+        case DMSG_SAVE:
+            handle_save(m.save);
+            break;
+        }
+    }
+}
+
+static void save_settings(void)
+{
+    nvs_handle_t h;
+    if (nvs_open("settings", NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_u8(h, "dc_on", s_enabled);
+        nvs_set_u8(h, "dc_min", (uint8_t)s_minutes);
+        nvs_commit(h);
+        nvs_close(h);
+    }
+}
+
+esp_err_t dashcam_init(void)
+{
+    nvs_handle_t h;
+    if (nvs_open("settings", NVS_READONLY, &h) == ESP_OK) {
+        uint8_t u8;
+        if (nvs_get_u8(h, "dc_min", &u8) == ESP_OK &&
+            u8 >= 1 && u8 <= DASHCAM_MAX_MINUTES) s_minutes = u8;
+        if (nvs_get_u8(h, "dc_on", &u8) == ESP_OK) s_enabled = u8;
+        nvs_close(h);
+    }
+
+    s_msg_queue = xQueueCreate(POOL_BLOCKS + 4, sizeof(dmsg_t));
+    s_free_queue = xQueueCreate(POOL_BLOCKS, sizeof(int16_t *));
+    if (!s_msg_queue || !s_free_queue) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < POOL_BLOCKS; i++) {
+        int16_t *blk = heap_caps_malloc(BLOCK_SAMPLES * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        if (!blk) {
+            ESP_LOGE(TAG, "Failed to allocate ring block in PSRAM");
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(s_free_queue, &blk, 0);
+    }
+
+    ESP_LOGI(TAG, "dashcam %s, %d min ring", s_enabled ? "on" : "off", s_minutes);
+    xTaskCreatePinnedToCore(spare_task, "dc_spare", 3072, NULL, 1, &s_spare_task, 0);
+    xTaskCreatePinnedToCore(dashcam_task, "dashcam", 6144, NULL, 3, NULL, 0);
+    return ESP_OK;
+}
+
+void dashcam_feed(const int16_t *samples, size_t num_samples)
+{
+    if (!s_enabled) return;
+
+    while (num_samples > 0) {
+        if (!s_fill) {
+            if (xQueueReceive(s_free_queue, &s_fill, 0) != pdTRUE) {
+                s_fill = NULL;
+                s_dropped += num_samples;
+                return;
+            }
+            s_fill_pos = 0;
+        }
+
+        size_t n = BLOCK_SAMPLES - s_fill_pos;
+        if (n > num_samples) n = num_samples;
+        memcpy(&s_fill[s_fill_pos], samples, n * sizeof(int16_t));
+        s_fill_pos += n;
+        samples += n;
+        num_samples -= n;
+
+        if (s_fill_pos >= BLOCK_SAMPLES) {
+            dmsg_t m = { .type = DMSG_DATA, .block = s_fill, .count = s_fill_pos };
+            if (xQueueSend(s_msg_queue, &m, 0) != pdTRUE) {
+                xQueueSend(s_free_queue, &s_fill, 0);
+                s_dropped += s_fill_pos;
+            }
+            s_fill = NULL;
+        }
+    }
+}
+
+void dashcam_configure(bool enabled, int minutes)
+{
+    if (minutes < 1) minutes = 1;
+    if (minutes > DASHCAM_MAX_MINUTES) minutes = DASHCAM_MAX_MINUTES;
+    if (enabled == s_enabled && minutes == s_minutes) return;
+
+    s_enabled = enabled;
+    s_minutes = minutes;
+    save_settings();
+
+    dmsg_t m = { .type = DMSG_CONFIG };
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+}
+
+esp_err_t dashcam_save(uint32_t seconds, char *name_out, size_t name_size, int *parts_out)
+{
+    dc_save_req_t req = {
+        .seconds = seconds,
+        .name_out = name_out,
+        .name_size = name_size,
+        .done = xSemaphoreCreateBinary(),
+    };
+    if (!req.done) return ESP_ERR_NO_MEM;
+
+    dmsg_t m = { .type = DMSG_SAVE, .save = &req };
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+    xSemaphoreTake(req.done, portMAX_DELAY);
+    vSemaphoreDelete(req.done);
+
+    if (parts_out) *parts_out = req.parts;
+    return req.result;
+}
+
+bool dashcam_enabled(void) { return s_enabled; }
+int dashcam_minutes(void) { return s_minutes; }
+uint32_t dashcam_available_seconds(void) { return s_available / AUDIO_SAMPLE_RATE; }
+uint32_t dashcam_dropped_samples(void) { return s_dropped; }
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DASHCAM_DIR          "/sdcard/.dashcam"
+#define DASHCAM_SEG_SECONDS  10    // one ring slot = one preallocated WAV
+#define DASHCAM_MAX_MINUTES  30
+#define DASHCAM_DEF_MINUTES  5
+
+// Load settings from NVS and start the dashcam task (core 0). If enabled,
+// the ring on the card is prepared in the background.
+esp_err_t dashcam_init(void);
+
+// Feed captured PCM. Never blocks: if the ring writer falls behind, the
+// samples are dropped and counted.
+void dashcam_feed(const int16_t *samples, size_t num_samples);
+
+// Enable/disable continuous capture and set the ring length (persisted).
+// Changing the length rebuilds the ring and discards its contents.
+void dashcam_configure(bool enabled, int minutes);
+
+// Move the newest <seconds> of the ring out as a normal recording:
+// <name>.wav, <name>_p2.wav, ... (whole segments, renamed, not copied).
+// name_out receives the first file name. Blocks until the ring task is done,
+// so not for the web server task itself (see workers.h).
+esp_err_t dashcam_save(uint32_t seconds, char *name_out, size_t name_size, int *parts_out);
+
+bool dashcam_enabled(void);
+int dashcam_minutes(void);
+// Seconds of contiguous audio currently held in the ring.
+uint32_t dashcam_available_seconds(void);
+// Samples dropped because the ring writer fell behind.
+uint32_t dashcam_dropped_samples(void);
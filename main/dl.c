@@ -0,0 +1,155 @@
+#include "dl.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+static const char *TAG = "dl";
+
+typedef struct {
+    uint8_t *buf[2];
+    QueueHandle_t done;     // reader -> sender: bytes read into the requested buffer
+} slot_t;
+
+typedef struct {
+    FILE *f;
+    long off;
+    uint8_t *buf;
+    size_t len;
+    QueueHandle_t done;
+} read_req_t;
+
+static slot_t s_slots[DL_SLOTS];
+static QueueHandle_t s_free_slots = NULL;
+static QueueHandle_t s_read_queue = NULL;
+static uint8_t *s_bounce = NULL;
+
+// One reader for all transfers: the card serves one request at a time anyway,
+// and whole-buffer requests keep it on long multi-sector reads.
+static void reader_task(void *arg)
+{
+    read_req_t r;
+    while (1) {
+        xQueueReceive(s_read_queue, &r, portMAX_DELAY);
+
+        size_t got = 0;
+        if (ftell(r.f) == r.off || fseek(r.f, r.off, SEEK_SET) == 0) {
+            while (got < r.len) {
+                size_t want = r.len - got;
+                if (want > DL_BOUNCE_SIZE) want = DL_BOUNCE_SIZE;
+                size_t n = fread(s_bounce, 1, want, r.f);
+                memcpy(r.buf + got, s_bounce, n);
+                got += n;
+                if (n < want) break;
+            }
+        }
+        xQueueSend(r.done, &got, portMAX_DELAY);
+    }
+}
+
+esp_err_t dl_init(void)
+{
+    s_free_slots = xQueueCreate(DL_SLOTS, sizeof(slot_t *));
+    s_read_queue = xQueueCreate(DL_SLOTS, sizeof(read_req_t));
+    s_bounce = heap_caps_malloc(DL_BOUNCE_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!s_free_slots || !s_read_queue || !s_bounce) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < DL_SLOTS; i++) {
+        slot_t *s = &s_slots[i];
+        s->buf[0] = heap_caps_malloc(DL_BUF_SIZE, MALLOC_CAP_SPIRAM);
+        s->buf[1] = heap_caps_malloc(DL_BUF_SIZE, MALLOC_CAP_SPIRAM);
+        s->done = xQueueCreate(1, sizeof(size_t));
+        if (!s->buf[0] || !s->buf[1] || !s->done) return ESP_ERR_NO_MEM;
+        xQueueSend(s_free_slots, &s, 0);
+    }
+
+    if (xTaskCreatePinnedToCore(reader_task, "dl_read", 3072, NULL, 4, NULL, 0) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Download engine: %d x 2 x %d KB", DL_SLOTS, DL_BUF_SIZE / 1024);
+    return ESP_OK;
+}
+
+static void read_async(slot_t *s, int which, FILE *f, long off, size_t len)
+{
+    read_req_t r = { .f = f, .off = off, .buf = s->buf[which], .len = len, .done = s->done };
+    xQueueSend(s_read_queue, &r, portMAX_DELAY);
+}
+
+esp_err_t dl_stream(const char *path, long offset, long len,
+                    const void *head, size_t head_len, dl_send_fn send, void *ctx)
+{
+    slot_t *s;
+    if (xQueueReceive(s_free_slots, &s, pdMS_TO_TICKS(DL_SLOT_WAIT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        xQueueSend(s_free_slots, &s, 0);
+        return ESP_ERR_NOT_FOUND;
+    }
+    // Reads are whole buffers; stdio's own small buffer would only add a copy
+    setvbuf(f, NULL, _IONBF, 0);
+
+    long next = offset;         // next file offset to request
+    long left = len;            // bytes still to send
+    int cur = 0;
+    bool pending = false;
+    if (left > 0) {
+        size_t n = left < DL_BUF_SIZE ? (size_t)left : DL_BUF_SIZE;
+        read_async(s, cur, f, next, n);
+        next += n;
+        pending = true;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (head_len > 0 && send(ctx, head, head_len) != 0) err = ESP_FAIL;
+
+    while (err == ESP_OK && left > 0) {
+        size_t got;
+        xQueueReceive(s->done, &got, portMAX_DELAY);
+        pending = false;
+        size_t want = left < DL_BUF_SIZE ? (size_t)left : DL_BUF_SIZE;
+        if (got < want) {
+            ESP_LOGW(TAG, "%s ended %ld bytes early", path, left - (long)got);
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        left -= got;
+
+        // Read the next block into the other buffer while this one goes out
+        long ahead = offset + len - next;
+        if (ahead > 0) {
+            size_t n = ahead < DL_BUF_SIZE ? (size_t)ahead : DL_BUF_SIZE;
+            read_async(s, cur ^ 1, f, next, n);
+            next += n;
+            pending = true;
+        }
+        if (send(ctx, s->buf[cur], got) != 0) err = ESP_FAIL;
+        cur ^= 1;
+    }
+
+    // The reader must be done with the buffers before they go back
+    if (pending) {
+        size_t got;
+        xQueueReceive(s->done, &got, portMAX_DELAY);
+    }
+    fclose(f);
+    xQueueSend(s_free_slots, &s, 0);
+    return err;
+}
+
+bool dl_overlap(uint64_t seg, uint64_t len, uint64_t start, uint64_t end,
+                uint64_t *skip, uint64_t *n)
+{
+    uint64_t a = seg > start ? seg : start;
+    uint64_t b = seg + len < end ? seg + len : end;
+    if (a >= b) return false;
+    *skip = a - seg;
+    *n = b - a;
+    return true;
+}
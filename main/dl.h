@@ -0,0 +1,35 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Download engine: sends a byte range of a file on the card out of two large
+// PSRAM buffers. A reader task fills one buffer while the caller sends the
+// other, so SD reads overlap socket sends instead of taking turns with them.
+
+#define DL_BUF_SIZE     (32 * 1024)  // each of the two buffers of a transfer
+#define DL_SLOTS        2            // transfers at once
+#define DL_BOUNCE_SIZE  (8 * 1024)   // DMA-capable staging: the card cannot read into PSRAM
+#define DL_SLOT_WAIT_MS 3000
+
+// Write all of data to the client. Returns 0, or -1 to abort the transfer.
+typedef int (*dl_send_fn)(void *ctx, const uint8_t *data, size_t len);
+
+esp_err_t dl_init(void);
+
+// Send head (response headers, a synthesized WAV header; may be empty), then
+// len bytes of the file at path starting at offset, all through send.
+// ESP_ERR_TIMEOUT: no transfer slot freed up in time; ESP_ERR_NOT_FOUND:
+// the file did not open -- nothing was sent on either, so the caller can
+// still answer with an error. ESP_ERR_INVALID_SIZE: the file ended early;
+// ESP_FAIL: send gave up.
+esp_err_t dl_stream(const char *path, long offset, long len,
+                    const void *head, size_t head_len, dl_send_fn send, void *ctx);
+
+// For responses assembled from pieces: where the piece at [seg, seg + len)
+// of the body meets the requested [start, end). *skip: bytes into the piece,
+// *n: bytes of it to send. False if none.
+bool dl_overlap(uint64_t seg, uint64_t len, uint64_t start, uint64_t end,
+                uint64_t *skip, uint64_t *n);
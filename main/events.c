@@ -0,0 +1,89 @@
+#include "events.h"
+#include "sdcard.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+
+static const char *TAG = "events";
+
+// ev_2024-05-01.wav -> /sdcard/ev_2024-05-01.idx
+static void index_path_for(const char *wav_name, char *out, size_t out_size)
+{
+    size_t len = strlen(wav_name);
+    if (len > 4) len -= 4;  // strip ".wav"
+    snprintf(out, out_size, "%s/%.*s.idx", SD_MOUNT_POINT, (int)len, wav_name);
+}
+
+void events_container_name(bool ulaw, char *out, size_t out_size)
+{
+    time_t now;
+    time(&now);
+    struct tm ti;
+    localtime_r(&now, &ti);
+    snprintf(out, out_size, EVENTS_PREFIX "%04d-%02d-%02d%s.wav",
+             ti.tm_year + 1900, ti.tm_mon + 1, ti.tm_mday, ulaw ? "_ulaw" : "");
+}
+
+bool events_is_container(const char *wav_name)
+{
+    return strncmp(wav_name, EVENTS_PREFIX, strlen(EVENTS_PREFIX)) == 0;
+}
+
+esp_err_t events_append(const char *wav_name, const event_rec_t *rec)
+{
+    char path[128];
+    index_path_for(wav_name, path, sizeof(path));
+
+    FILE *f = fopen(path, "ab");
+    if (!f) {
+        ESP_LOGW(TAG, "cannot open %s", path);
+        return ESP_FAIL;
+    }
+    // Drop a torn record left by a power loss so records stay aligned
+    long size = ftell(f);
+    if (size % sizeof(event_rec_t)) {
+        fclose(f);
+        truncate(path, size - size % sizeof(event_rec_t));
+        f = fopen(path, "ab");
+        if (!f) return ESP_FAIL;
+    }
+
+    size_t n = fwrite(rec, sizeof(*rec), 1, f);
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+    return n == 1 ? ESP_OK : ESP_FAIL;
+}
+
+int events_count(const char *wav_name)
+{
+    char path[128];
+    index_path_for(wav_name, path, sizeof(path));
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    return st.st_size / sizeof(event_rec_t);
+}
+
+int events_read(const char *wav_name, int first, event_rec_t *out, int max)
+{
+    char path[128];
+    index_path_for(wav_name, path, sizeof(path));
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, (long)first * sizeof(event_rec_t), SEEK_SET);
+    int n = fread(out, sizeof(event_rec_t), max, f);
+    fclose(f);
+    return n;
+}
+
+void events_delete_index(const char *wav_name)
+{
+    char path[128];
+    index_path_for(wav_name, path, sizeof(path));
+    unlink(path);
+}
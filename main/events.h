@@ -0,0 +1,38 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Event container mode: auto-triggered events are appended to one WAV per
+// day (ev_YYYY-MM-DD.wav, or ev_YYYY-MM-DD_ulaw.wav) instead of creating a
+// file each. A sidecar index (same name, .idx) holds one fixed-size record
+// per event, so single events can be listed and served as byte ranges.
+
+#define EVENTS_PREFIX "ev_"
+
+typedef struct __attribute__((packed)) {
+    uint32_t start_sample;  // offset into the container's data chunk
+    uint32_t num_samples;
+    int64_t  wall_time;     // unix time of the trigger
+    uint16_t peak;          // max |sample| over the event
+    uint16_t reserved;
+} event_rec_t;
+
+// Container for events starting now
+void events_container_name(bool ulaw, char *out, size_t out_size);
+
+bool events_is_container(const char *wav_name);
+
+// Append one record to the container's index (fsynced).
+esp_err_t events_append(const char *wav_name, const event_rec_t *rec);
+
+// Number of indexed events, 0 if there is no index.
+int events_count(const char *wav_name);
+
+// Read up to max records starting at index first. Returns the number read.
+int events_read(const char *wav_name, int first, event_rec_t *out, int max);
+
+// Remove the index along with its container.
+void events_delete_index(const char *wav_name);
@@ -0,0 +1,183 @@
+#include "export.h"
+#include "sdcard.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "export";
+
+static const uint8_t s_zeros[EXPORT_BLOCK];
+
+static uint64_t padded(uint32_t size)
+{
+    return ((uint64_t)size + EXPORT_BLOCK - 1) / EXPORT_BLOCK * EXPORT_BLOCK;
+}
+
+esp_err_t export_manifest(const char *names, int64_t from, int64_t to,
+                          catalog_entry_t **out, size_t *count)
+{
+    *out = NULL;
+    *count = 0;
+
+    if (!names) {
+        catalog_query_t q = { .sort = CATALOG_SORT_NONE, .from = from, .to = to };
+        size_t total = 0;
+        catalog_query(&q, 0, NULL, 0, &total);  // count only
+        q.sort = CATALOG_SORT_TIME;
+        if (total > EXPORT_MAX_FILES) return ESP_ERR_INVALID_SIZE;
+        if (total == 0) return ESP_OK;
+        catalog_entry_t *files = heap_caps_malloc(total * sizeof(catalog_entry_t), MALLOC_CAP_SPIRAM);
+        if (!files) return ESP_ERR_NO_MEM;
+        *count = catalog_query(&q, 0, files, total, NULL);
+        *out = files;
+        return ESP_OK;
+    }
+
+    size_t max = 1;
+    for (const char *p = names; *p; p++) max += *p == ',';
+    if (max > EXPORT_MAX_FILES) return ESP_ERR_INVALID_SIZE;
+    catalog_entry_t *files = heap_caps_malloc(max * sizeof(catalog_entry_t), MALLOC_CAP_SPIRAM);
+    if (!files) return ESP_ERR_NO_MEM;
+
+    size_t n = 0;
+    const char *p = names;
+    while (*p) {
+        const char *comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+        if (len > 0) {
+            char name[CATALOG_NAME_LEN];
+            bool found = false;
+            if (len < sizeof(name)) {
+                memcpy(name, p, len);
+                name[len] = '\0';
+                found = catalog_get(name, &files[n]);
+            }
+            if (!found) {
+                heap_caps_free(files);
+                return ESP_ERR_NOT_FOUND;
+            }
+            n++;
+        }
+        p += comma ? len + 1 : len;
+    }
+
+    // Same order as a time range, so a selection reads like one
+    for (size_t i = 1; i < n; i++) {
+        catalog_entry_t e = files[i];
+        size_t j = i;
+        for (; j > 0 && files[j - 1].start_time > e.start_time; j--) files[j] = files[j - 1];
+        files[j] = e;
+    }
+    *out = files;
+    *count = n;
+    return ESP_OK;
+}
+
+uint64_t export_size(const catalog_entry_t *files, size_t n)
+{
+    uint64_t total = 2 * EXPORT_BLOCK;  // end-of-archive marker
+    for (size_t i = 0; i < n; i++) total += EXPORT_BLOCK + padded(files[i].size);
+    return total;
+}
+
+uint32_t export_tag(const catalog_entry_t *files, size_t n)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *fields[3] = { (const uint8_t *)files[i].name, (const uint8_t *)&files[i].size,
+                                     (const uint8_t *)&files[i].mtime };
+        size_t lens[3] = { strlen(files[i].name) + 1, sizeof(files[i].size), sizeof(files[i].mtime) };
+        for (int f = 0; f < 3; f++) {
+            for (size_t k = 0; k < lens[f]; k++) {
+                h ^= fields[f][k];
+                h *= 16777619u;
+            }
+        }
+    }
+    return h;
+}
+
+static void octal(char *out, size_t width, uint64_t v)
+{
+    // width - 1 digits and a NUL, as every tar reader accepts
+    out[width - 1] = '\0';
+    for (size_t i = width - 1; i > 0; i--) {
+        out[i - 1] = '0' + (v & 7);
+        v >>= 3;
+    }
+}
+
+static void tar_header(uint8_t hdr[EXPORT_BLOCK], const catalog_entry_t *e)
+{
+    memset(hdr, 0, EXPORT_BLOCK);
+    char *h = (char *)hdr;
+    snprintf(h, 100, "%s", e->name);
+    octal(h + 100, 8, 0644);                // mode
+    octal(h + 108, 8, 0);                   // uid
+    octal(h + 116, 8, 0);                   // gid
+    octal(h + 124, 12, e->size);
+    octal(h + 136, 12, e->mtime > 0 ? (uint64_t)e->mtime : 0);
+    h[156] = '0';                           // regular file
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+
+    // Checksum over the header with its own field read as spaces
+    memset(h + 148, ' ', 8);
+    uint32_t sum = 0;
+    for (int i = 0; i < EXPORT_BLOCK; i++) sum += hdr[i];
+    octal(h + 148, 7, sum);
+    h[155] = ' ';
+}
+
+esp_err_t export_send(const catalog_entry_t *files, size_t n, uint64_t start, uint64_t end,
+                      dl_send_fn send, void *ctx)
+{
+    uint8_t hdr[EXPORT_BLOCK];
+    uint64_t pos = 0;
+    uint64_t skip, len;
+
+    for (size_t i = 0; i < n && pos < end; i++) {
+        const catalog_entry_t *e = &files[i];
+        uint64_t member = EXPORT_BLOCK + padded(e->size);
+        if (pos + member <= start) {
+            pos += member;
+            continue;
+        }
+
+        // Header slice goes out in front of the data
+        const uint8_t *head = NULL;
+        size_t head_len = 0;
+        if (dl_overlap(pos, EXPORT_BLOCK, start, end, &skip, &len)) {
+            tar_header(hdr, e);
+            head = hdr + skip;
+            head_len = len;
+        }
+        if (dl_overlap(pos + EXPORT_BLOCK, e->size, start, end, &skip, &len)) {
+            char path[96];
+            snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, e->name);
+            esp_err_t err = dl_stream(path, (long)skip, (long)len, head, head_len, send, ctx);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "%s: %s", e->name, esp_err_to_name(err));
+                return err;
+            }
+        } else if (head_len > 0 && send(ctx, head, head_len) != 0) {
+            return ESP_FAIL;
+        }
+        if (dl_overlap(pos + EXPORT_BLOCK + e->size, padded(e->size) - e->size, start, end, &skip, &len) &&
+            send(ctx, s_zeros, len) != 0) {
+            return ESP_FAIL;
+        }
+        pos += member;
+    }
+
+    // End-of-archive: two zero blocks
+    for (int b = 0; b < 2; b++, pos += EXPORT_BLOCK) {
+        if (dl_overlap(pos, EXPORT_BLOCK, start, end, &skip, &len) && send(ctx, s_zeros, len) != 0)
+            return ESP_FAIL;
+    }
+    return ESP_OK;
+}
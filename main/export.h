@@ -0,0 +1,36 @@
+#pragma once
+
+#include "esp_err.h"
+#include "catalog.h"
+#include "dl.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Bulk export: a set of recordings as one uncompressed tar (ustar), for
+// pulling a day's recordings or a whole card in a single transfer. Member
+// headers are synthesized from the catalogue, so the archive's size and
+// every byte offset are known before the first byte goes out; a client can
+// resume an interrupted export with a Range request for the same selection.
+
+#define EXPORT_MAX_FILES 1024
+#define EXPORT_BLOCK     512
+
+// Recordings to export, in start-time order. names: comma-separated file
+// names (as stored), or NULL for everything with start_time in [from, to)
+// (0 = unbounded). Fills a PSRAM array the caller frees; returns the count.
+// ESP_ERR_NOT_FOUND: a named file is not in the catalogue; ESP_ERR_INVALID_SIZE:
+// more than EXPORT_MAX_FILES.
+esp_err_t export_manifest(const char *names, int64_t from, int64_t to,
+                          catalog_entry_t **out, size_t *count);
+
+// Archive size in bytes, trailer included
+uint64_t export_size(const catalog_entry_t *files, size_t n);
+
+// Stable tag for the archive's contents (names, sizes, change times), for
+// ETag / If-Range: a resumed request only continues if it still matches.
+uint32_t export_tag(const catalog_entry_t *files, size_t n);
+
+// Send archive bytes [start, end) through send, file data via the download
+// engine. Any error (see dl_stream) leaves the transfer cut short.
+esp_err_t export_send(const catalog_entry_t *files, size_t n, uint64_t start, uint64_t end,
+                      dl_send_fn send, void *ctx);
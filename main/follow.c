@@ -0,0 +1,198 @@
+#include "follow.h"
+#include "writer.h"
+#include "wav.h"
+#include "sdcard.h"
+#include "audio.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "follow";
+
+#define FOLLOW_BUF_SIZE (16 * 1024)
+#define FOLLOW_POLL_MS  200
+// Largest sizes a RIFF header can state; players read on until the end
+#define OPEN_ENDED_DATA (0xFFFFFFFFu - (WAV_HEADER_SIZE - 8))
+
+// Followers hold a worker for as long as the recording lasts
+_Static_assert(FOLLOW_MAX_CLIENTS < WORKERS_COUNT, "followers would take every worker");
+
+static volatile int s_clients = 0;
+
+typedef struct {
+    httpd_req_t *req;
+    uint8_t *buf;
+    FILE *f;
+    uint8_t session;
+    bool ulaw;
+    bool event;
+    char basename[48];
+    char first[64];         // file name of part 1, for X-Recording
+    int part;
+    uint32_t off;           // data bytes of `part` already sent
+} follower_t;
+
+static bool open_part(follower_t *fw)
+{
+    char name[64];
+    char path[128];
+    if (fw->event)
+        snprintf(name, sizeof(name), "%s", fw->basename);
+    else
+        writer_part_name(fw->basename, fw->part, name, sizeof(name));
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, name);
+
+    fw->f = fopen(path, "rb");
+    if (!fw->f) return false;
+    fseek(fw->f, WAV_HEADER_SIZE + fw->off, SEEK_SET);
+    return true;
+}
+
+static void close_part(follower_t *fw)
+{
+    if (fw->f) fclose(fw->f);
+    fw->f = NULL;
+}
+
+// Send up to end - off bytes of the current part. Returns the bytes sent,
+// 0 if the card does not show them yet, -1 if the client went away.
+static int send_part(follower_t *fw, uint32_t end)
+{
+    if (!fw->f && !open_part(fw)) return 0;
+
+    size_t want = end - fw->off;
+    if (want > FOLLOW_BUF_SIZE) want = FOLLOW_BUF_SIZE;
+    size_t n = fread(fw->buf, 1, want, fw->f);
+    if (n < want) {
+        // A handle only sees the file size from when it was opened
+        close_part(fw);
+    }
+    if (n == 0) return 0;
+    if (httpd_resp_send_chunk(fw->req, (const char *)fw->buf, n) != ESP_OK) return -1;
+    fw->off += n;
+    return (int)n;
+}
+
+static void follow_run(follower_t *fw)
+{
+    writer_follow_t st;
+    while (1) {
+        writer_follow_state(&st);
+
+        if (st.session != fw->session) {
+            // Stopped and restarted between two polls: the old parts are
+            // closed, so read each to its end
+            if (fw->event) return;
+            int n = send_part(fw, UINT32_MAX);
+            if (n < 0) return;
+            if (n > 0) continue;
+            close_part(fw);
+            fw->part++;
+            fw->off = 0;
+            if (!open_part(fw)) return;
+            continue;
+        }
+
+        uint32_t end;
+        if (fw->part < st.part) {
+            if (st.part - fw->part >= WRITER_FOLLOW_PARTS) {
+                ESP_LOGW(TAG, "Follower fell %d parts behind, ending", st.part - fw->part);
+                return;
+            }
+            end = st.part_bytes[fw->part % WRITER_FOLLOW_PARTS];
+        } else {
+            end = st.synced;
+        }
+
+        if (fw->off < end) {
+            int n = send_part(fw, end);
+            if (n < 0) return;
+            if (n == 0) vTaskDelay(pdMS_TO_TICKS(FOLLOW_POLL_MS));
+            continue;
+        }
+
+        close_part(fw);  // reopen later to see what the writer syncs next
+        if (fw->part < st.part) {
+            fw->part++;
+            fw->off = 0;
+            continue;
+        }
+        if (!st.active) return;  // all of it sent
+        vTaskDelay(pdMS_TO_TICKS(FOLLOW_POLL_MS));
+    }
+}
+
+static esp_err_t follow_job(httpd_req_t *req, void *arg)
+{
+    follower_t *fw = *(follower_t **)arg;
+    fw->req = req;
+
+    uint8_t hdr[WAV_HEADER_SIZE];
+    wav_build_header(hdr, AUDIO_SAMPLE_RATE, fw->ulaw, OPEN_ENDED_DATA);
+    if (httpd_resp_send_chunk(fw->req, (const char *)hdr, sizeof(hdr)) == ESP_OK) {
+        follow_run(fw);
+    }
+    ESP_LOGI(TAG, "Follower done at part %d, %lu bytes", fw->part, (unsigned long)fw->off);
+
+    close_part(fw);
+    httpd_resp_send_chunk(fw->req, NULL, 0);
+    writer_follow(false);
+    heap_caps_free(fw->buf);
+    free(fw);
+    __atomic_sub_fetch(&s_clients, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t follow_begin(httpd_req_t *req)
+{
+    writer_follow_t st;
+    writer_follow_state(&st);
+    if (!st.active) return ESP_ERR_NOT_FOUND;
+
+    if (__atomic_add_fetch(&s_clients, 1, __ATOMIC_RELAXED) > FOLLOW_MAX_CLIENTS) {
+        __atomic_sub_fetch(&s_clients, 1, __ATOMIC_RELAXED);
+        return ESP_ERR_NO_MEM;
+    }
+
+    follower_t *fw = calloc(1, sizeof(follower_t));
+    if (fw) fw->buf = heap_caps_malloc(FOLLOW_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (!fw || !fw->buf) {
+        free(fw);
+        __atomic_sub_fetch(&s_clients, 1, __ATOMIC_RELAXED);
+        return ESP_ERR_NO_MEM;
+    }
+    fw->session = st.session;
+    fw->ulaw = st.ulaw;
+    fw->event = st.event;
+    snprintf(fw->basename, sizeof(fw->basename), "%s", st.basename);
+    fw->part = 1;
+    fw->off = st.base;
+
+    // Header values must outlive this handler: they go out with the first chunk
+    if (st.event)
+        snprintf(fw->first, sizeof(fw->first), "%s", st.basename);
+    else
+        writer_part_name(st.basename, 1, fw->first, sizeof(fw->first));
+    httpd_resp_set_type(req, "audio/wav");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_set_hdr(req, "X-Recording", fw->first);
+
+    // Logged first: once submitted, the job may finish and free fw at any time
+    ESP_LOGI(TAG, "Following %s", fw->first);
+    writer_follow(true);
+    esp_err_t err = workers_submit(req, follow_job, &fw, sizeof(fw));
+    if (err != ESP_OK) {
+        writer_follow(false);
+        heap_caps_free(fw->buf);
+        free(fw);
+        __atomic_sub_fetch(&s_clients, 1, __ATOMIC_RELAXED);
+        return err;
+    }
+    return ESP_OK;
+}
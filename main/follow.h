@@ -0,0 +1,17 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// GET /api/follow: the recording in progress as one open-ended WAV. The
+// response starts with a header whose sizes say "unknown", then everything
+// already on the card, then each block as the writer syncs it, across part
+// splits, until the recording stops. Each follower keeps a worker (see
+// workers.h) for the hours a recording may last.
+
+#define FOLLOW_MAX_CLIENTS 2
+
+// Take over req. ESP_ERR_NOT_FOUND: nothing is being recorded;
+// ESP_ERR_NO_MEM: all follower slots or the worker queue are busy. On error
+// req is untouched.
+esp_err_t follow_begin(httpd_req_t *req);
@@ -0,0 +1,147 @@
+#include "group.h"
+#include "writer.h"
+#include "wav.h"
+#include "sdcard.h"
+#include "audio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "esp_log.h"
+
+static const char *TAG = "group";
+
+#define GROUP_HEAD_MAX 512   // response headers that ride in front of the WAV header
+
+// Samples of an entry that are really on the card
+static uint32_t entry_samples(const catalog_entry_t *e)
+{
+    uint32_t bps = e->codec == CATALOG_CODEC_ULAW ? 1 : 2;
+    uint32_t on_card = e->size > WAV_HEADER_SIZE ? (e->size - WAV_HEADER_SIZE) / bps : 0;
+    return e->samples < on_card ? e->samples : on_card;
+}
+
+esp_err_t group_resolve(const char *name, group_t *out)
+{
+    catalog_entry_t e;
+    if (!catalog_get(name, &e)) return ESP_ERR_NOT_FOUND;
+
+    memset(out, 0, sizeof(*out));
+    size_t len = strlen(name);
+    if (len > 4 && strcasecmp(name + len - 4, ".wav") == 0) len -= 4;
+    snprintf(out->basename, sizeof(out->basename), "%.*s", (int)len, name);
+
+    // name_pN.wav belongs to name.wav, if that is in the catalogue
+    char *p = strrchr(out->basename, '_');
+    if (p && p[1] == 'p' && isdigit((unsigned char)p[2])) {
+        char *q = p + 2;
+        while (isdigit((unsigned char)*q)) q++;
+        if (*q == '\0') {
+            char first[CATALOG_NAME_LEN];
+            snprintf(first, sizeof(first), "%.*s.wav", (int)(p - out->basename), out->basename);
+            if (catalog_get(first, &e)) *p = '\0';
+        }
+    }
+
+    char part[CATALOG_NAME_LEN];
+    group_part_name(out, 1, part, sizeof(part));
+    if (!catalog_get(part, &e)) return ESP_ERR_NOT_FOUND;
+    out->ulaw = e.codec == CATALOG_CODEC_ULAW;
+
+    double sq = 0;           // sum of rms^2 * samples, for the overall RMS
+    bool rms_known = true;
+    while (out->parts < GROUP_MAX_PARTS) {
+        if (out->parts > 0) {
+            group_part_name(out, out->parts + 1, part, sizeof(part));
+            if (!catalog_get(part, &e)) break;
+            if ((e.codec == CATALOG_CODEC_ULAW) != out->ulaw) {
+                ESP_LOGW(TAG, "%s: format differs from part 1, group ends before it", part);
+                break;
+            }
+        }
+        uint32_t n = entry_samples(&e);
+        out->samples[out->parts++] = n;
+        out->total += n;
+        out->size += e.size;
+        if (e.peak > out->peak) out->peak = e.peak;
+        if (e.rms == 0 && n > 0) rms_known = false;
+        sq += (double)e.rms * e.rms * n;
+    }
+    if (rms_known && out->total > 0) out->rms = (uint16_t)lrint(sqrt(sq / out->total));
+    return ESP_OK;
+}
+
+int group_block_align(const group_t *g)
+{
+    return g->ulaw ? 1 : 2;
+}
+
+void group_part_name(const group_t *g, int part, char *out, size_t out_size)
+{
+    writer_part_name(g->basename, part, out, out_size);
+}
+
+uint64_t group_wav_size(const group_t *g, uint64_t count)
+{
+    return WAV_HEADER_SIZE + count * group_block_align(g);
+}
+
+esp_err_t group_send_wav(const group_t *g, uint64_t first, uint64_t count,
+                         uint64_t start, uint64_t end,
+                         const void *head, size_t head_len, dl_send_fn send, void *ctx)
+{
+    int align = group_block_align(g);
+    uint64_t data = count * align;
+    uint8_t hdr[WAV_HEADER_SIZE];
+    // A RIFF size field cannot say more; players read to the end anyway
+    wav_build_header(hdr, AUDIO_SAMPLE_RATE, g->ulaw,
+                     data > UINT32_MAX - 36 ? UINT32_MAX - 36 : (uint32_t)data);
+
+    // Response headers and the WAV header slice go out with the first data
+    uint8_t pre[GROUP_HEAD_MAX + WAV_HEADER_SIZE];
+    size_t pre_len = 0;
+    bool sent = false;
+    if (head_len > GROUP_HEAD_MAX) {
+        if (send(ctx, head, head_len) != 0) return ESP_FAIL;
+        sent = true;
+    } else if (head_len > 0) {
+        memcpy(pre, head, head_len);
+        pre_len = head_len;
+    }
+    uint64_t skip, n;
+    if (dl_overlap(0, WAV_HEADER_SIZE, start, end, &skip, &n)) {
+        memcpy(pre + pre_len, hdr + skip, n);
+        pre_len += n;
+    }
+
+    // Sample s of the group sits in the WAV at WAV_HEADER_SIZE + (s - first) * align
+    uint64_t part_start = 0;
+    for (int i = 0; i < g->parts; i++) {
+        uint64_t a = first > part_start ? first : part_start;
+        uint64_t b = first + count < part_start + g->samples[i] ? first + count : part_start + g->samples[i];
+        if (a < b && dl_overlap(WAV_HEADER_SIZE + (a - first) * align, (b - a) * align,
+                                start, end, &skip, &n)) {
+            char name[CATALOG_NAME_LEN];
+            char path[96];
+            group_part_name(g, i + 1, name, sizeof(name));
+            snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, name);
+            long off = WAV_HEADER_SIZE + (long)((a - part_start) * align + skip);
+            esp_err_t err = dl_stream(path, off, (long)n, pre, pre_len, send, ctx);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "%s: %s", name, esp_err_to_name(err));
+                if (sent && (err == ESP_ERR_TIMEOUT || err == ESP_ERR_NOT_FOUND)) return ESP_ERR_INVALID_SIZE;
+                return err;
+            }
+            pre_len = 0;
+            sent = true;
+        }
+        part_start += g->samples[i];
+        if (part_start >= first + count) break;
+    }
+
+    if (pre_len > 0 && send(ctx, pre, pre_len) != 0) return ESP_FAIL;
+    return ESP_OK;
+}
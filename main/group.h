@@ -0,0 +1,48 @@
+#pragma once
+
+#include "esp_err.h"
+#include "catalog.h"
+#include "dl.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Split recordings read as one. The writer starts a new part every
+// WRITER_PART_SAMPLES (name.wav, name_p2.wav, ...); a group is those parts
+// back to back, addressed by sample from the start of part 1. Parts are
+// found in the catalogue, so resolving a group never touches the card.
+
+#define GROUP_MAX_PARTS 128   // >10 h at 5 min per part
+
+typedef struct {
+    char basename[CATALOG_NAME_LEN];
+    int parts;
+    bool ulaw;
+    uint32_t samples[GROUP_MAX_PARTS];  // per part, in order
+    uint64_t total;                     // samples in all parts
+    uint32_t size;                      // bytes of all part files
+    uint16_t peak;                      // over all parts, 0 if unknown
+    uint16_t rms;                       // over all parts, 0 if unknown
+} group_t;
+
+// Group holding the recording `name` (any of its parts). Parts follow part 1
+// for as long as the catalogue has the next one. ESP_ERR_NOT_FOUND: name is
+// not a recording in the catalogue.
+esp_err_t group_resolve(const char *name, group_t *out);
+
+// Bytes per sample frame in the data chunk: 2 for PCM16, 1 for µ-law
+int group_block_align(const group_t *g);
+
+// File name of part (1-based)
+void group_part_name(const group_t *g, int part, char *out, size_t out_size);
+
+// Size of samples [first, first + count) served as one WAV file
+uint64_t group_wav_size(const group_t *g, uint64_t count);
+
+// Send bytes [start, end) of that WAV (synthesized header, then the samples
+// read across parts), after head (may be empty). Errors as dl_stream:
+// ESP_ERR_TIMEOUT and ESP_ERR_NOT_FOUND only come back while nothing has
+// been sent, so the caller can still answer; on others it must hang up.
+esp_err_t group_send_wav(const group_t *g, uint64_t first, uint64_t count,
+                         uint64_t start, uint64_t end,
+                         const void *head, size_t head_len, dl_send_fn send, void *ctx);
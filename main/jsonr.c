@@ -0,0 +1,248 @@
+#include "jsonr.h"
+
+#include <limits.h>
+#include <string.h>
+
+#define NESTED_MAX_DEPTH 16
+
+static char *skip_ws(char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return p;
+}
+
+static int hex4(const char *p)
+{
+    int v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')      v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return -1;
+    }
+    return v;
+}
+
+static char *put_utf8(char *out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *out++ = cp;
+    } else if (cp < 0x800) {
+        *out++ = 0xc0 | (cp >> 6);
+        *out++ = 0x80 | (cp & 0x3f);
+    } else if (cp < 0x10000) {
+        *out++ = 0xe0 | (cp >> 12);
+        *out++ = 0x80 | ((cp >> 6) & 0x3f);
+        *out++ = 0x80 | (cp & 0x3f);
+    } else {
+        *out++ = 0xf0 | (cp >> 18);
+        *out++ = 0x80 | ((cp >> 12) & 0x3f);
+        *out++ = 0x80 | ((cp >> 6) & 0x3f);
+        *out++ = 0x80 | (cp & 0x3f);
+    }
+    return out;
+}
+
+// p points at the opening quote. Unescapes in place (the result is never
+// longer than the source) and returns the position after the closing
+// quote, or NULL. *out receives the NUL-terminated string.
+static char *parse_string(char *p, const char **out)
+{
+    char *dst = ++p;
+    *out = dst;
+    while (*p != '"') {
+        unsigned char c = *p;
+        if (c == '\0' || c < 0x20) return NULL;
+        if (c != '\\') {
+            *dst++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case '"':  *dst++ = '"';  break;
+        case '\\': *dst++ = '\\'; break;
+        case '/':  *dst++ = '/';  break;
+        case 'b':  *dst++ = '\b'; break;
+        case 'f':  *dst++ = '\f'; break;
+        case 'n':  *dst++ = '\n'; break;
+        case 'r':  *dst++ = '\r'; break;
+        case 't':  *dst++ = '\t'; break;
+        case 'u': {
+            int cp = hex4(p + 1);
+            if (cp < 0) return NULL;
+            p += 4;
+            if (cp >= 0xd800 && cp < 0xdc00 && p[1] == '\\' && p[2] == 'u') {
+                int lo = hex4(p + 3);
+                if (lo >= 0xdc00 && lo < 0xe000) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    p += 6;
+                }
+            }
+            dst = put_utf8(dst, cp);
+            break;
+        }
+        default:
+            return NULL;
+        }
+        p++;
+    }
+    char *next = p + 1;
+    *dst = '\0';  // may overwrite the closing quote; next is already past it
+    return next;
+}
+
+// Strict JSON number. Hand-rolled because strtod may allocate.
+static char *parse_number(char *p, double *out)
+{
+    bool neg = (*p == '-');
+    if (neg) p++;
+    if (*p < '0' || *p > '9') return NULL;
+
+    double v = 0;
+    while (*p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+    if (*p == '.') {
+        p++;
+        if (*p < '0' || *p > '9') return NULL;
+        double scale = 0.1;
+        while (*p >= '0' && *p <= '9') {
+            v += (*p++ - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        bool eneg = (*p == '-');
+        if (*p == '-' || *p == '+') p++;
+        if (*p < '0' || *p > '9') return NULL;
+        int e = 0;
+        while (*p >= '0' && *p <= '9') {
+            if (e < 400) e = e * 10 + (*p - '0');
+            p++;
+        }
+        while (e-- > 0) v = eneg ? v / 10 : v * 10;
+    }
+    *out = neg ? -v : v;
+    return p;
+}
+
+static char *match(char *p, const char *word)
+{
+    size_t n = strlen(word);
+    return strncmp(p, word, n) == 0 ? p + n : NULL;
+}
+
+// Skip a nested object or array, checking brackets and strings
+static char *skip_nested(char *p)
+{
+    char stack[NESTED_MAX_DEPTH];
+    int depth = 0;
+    for (;;) {
+        char c = *p;
+        if (c == '\0') return NULL;
+        if (c == '"') {
+            const char *s;
+            p = parse_string(p, &s);
+            if (!p) return NULL;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            if (depth == NESTED_MAX_DEPTH) return NULL;
+            stack[depth++] = (c == '{') ? '}' : ']';
+        } else if (c == '}' || c == ']') {
+            if (depth == 0 || stack[--depth] != c) return NULL;
+            if (depth == 0) return p + 1;
+        }
+        p++;
+    }
+}
+
+int jsonr_parse(jsonr_t *r, char *buf)
+{
+    r->count = 0;
+    char *p = skip_ws(buf);
+    if (*p++ != '{') return -1;
+    p = skip_ws(p);
+    if (*p == '}') return *skip_ws(p + 1) ? -1 : 0;
+
+    for (;;) {
+        if (*p != '"' || r->count == JSONR_MAX_FIELDS) return -1;
+        jsonr_field_t *f = &r->fields[r->count];
+        memset(f, 0, sizeof(*f));
+        p = parse_string(p, &f->key);
+        if (!p) return -1;
+        p = skip_ws(p);
+        if (*p++ != ':') return -1;
+        p = skip_ws(p);
+
+        char c = *p;
+        if (c == '"') {
+            f->type = JSONR_STRING;
+            p = parse_string(p, &f->str);
+        } else if (c == '{' || c == '[') {
+            f->type = JSONR_NESTED;
+            p = skip_nested(p);
+        } else if (c == 't') {
+            f->type = JSONR_BOOL;
+            f->b = true;
+            p = match(p, "true");
+        } else if (c == 'f') {
+            f->type = JSONR_BOOL;
+            p = match(p, "false");
+        } else if (c == 'n') {
+            f->type = JSONR_NULL;
+            p = match(p, "null");
+        } else {
+            f->type = JSONR_NUMBER;
+            p = parse_number(p, &f->num);
+        }
+        if (!p) return -1;
+        r->count++;
+
+        p = skip_ws(p);
+        if (*p == ',') {
+            p = skip_ws(p + 1);
+            continue;
+        }
+        if (*p != '}') return -1;
+        return *skip_ws(p + 1) ? -1 : 0;
+    }
+}
+
+const jsonr_field_t *jsonr_get(const jsonr_t *r, const char *key)
+{
+    for (int i = 0; i < r->count; i++) {
+        if (strcmp(r->fields[i].key, key) == 0) return &r->fields[i];
+    }
+    return NULL;
+}
+
+bool jsonr_get_bool(const jsonr_t *r, const char *key, bool *out)
+{
+    const jsonr_field_t *f = jsonr_get(r, key);
+    if (!f || f->type != JSONR_BOOL) return false;
+    *out = f->b;
+    return true;
+}
+
+bool jsonr_get_int(const jsonr_t *r, const char *key, int *out)
+{
+    const jsonr_field_t *f = jsonr_get(r, key);
+    if (!f || f->type != JSONR_NUMBER) return false;
+    if (f->num >= INT_MAX)
+        *out = INT_MAX;
+    else if (f->num <= INT_MIN)
+        *out = INT_MIN;
+    else
+        *out = (int)f->num;
+    return true;
+}
+
+bool jsonr_get_string(const jsonr_t *r, const char *key, const char **out)
+{
+    const jsonr_field_t *f = jsonr_get(r, key);
+    if (!f || f->type != JSONR_STRING) return false;
+    *out = f->str;
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Minimal in-place JSON reader for the small flat objects the API and the
+// WebSocket accept ({"enabled":true,"threshold":2000}). Strings are
+// unescaped inside the input buffer and members are recorded in a fixed
+// table, so parsing allocates nothing. Nested objects and arrays are
+// validated and skipped. Pure C, shared with tools/json_bench.
+
+#define JSONR_MAX_FIELDS 16
+
+typedef enum {
+    JSONR_NULL = 0,
+    JSONR_BOOL,
+    JSONR_NUMBER,
+    JSONR_STRING,
+    JSONR_NESTED,   // object or array, not decoded
+} jsonr_type_t;
+
+typedef struct {
+    const char *key;
+    const char *str;        // JSONR_STRING: NUL-terminated, inside the input
+    double num;             // JSONR_NUMBER
+    bool b;                 // JSONR_BOOL
+    jsonr_type_t type;
+} jsonr_field_t;
+
+typedef struct {
+    jsonr_field_t fields[JSONR_MAX_FIELDS];
+    int count;
+} jsonr_t;
+
+// Parse one object from the NUL-terminated buf, modifying it. Returns 0,
+// or -1 if it is not a valid object or has too many members.
+int jsonr_parse(jsonr_t *r, char *buf);
+
+const jsonr_field_t *jsonr_get(const jsonr_t *r, const char *key);
+
+// Typed lookups: false if the member is missing or has another type.
+// jsonr_get_int truncates and saturates like cJSON's valueint.
+bool jsonr_get_bool(const jsonr_t *r, const char *key, bool *out);
+bool jsonr_get_int(const jsonr_t *r, const char *key, int *out);
+bool jsonr_get_string(const jsonr_t *r, const char *key, const char **out);
@@ -0,0 +1,249 @@
+#include "jsonw.h"
+
+#include <math.h>
+#include <string.h>
+
+// Numbers are formatted by hand: printf's float path may allocate
+
+void jsonw_init(jsonw_t *w, char *buf, size_t size, jsonw_flush_fn flush, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->size = size;
+    w->flush = flush;
+    w->ctx = ctx;
+}
+
+int jsonw_flush(jsonw_t *w)
+{
+    if (w->len && !w->err) {
+        w->err = w->flush ? w->flush(w->ctx, w->buf, w->len) : -1;
+        w->flushed += w->len;
+    }
+    w->len = 0;
+    return w->err;
+}
+
+static void put(jsonw_t *w, const char *s, size_t n)
+{
+    while (n > 0 && !w->err) {
+        if (w->len == w->size) jsonw_flush(w);
+        size_t k = w->size - w->len;
+        if (k > n) k = n;
+        memcpy(w->buf + w->len, s, k);
+        w->len += k;
+        s += k;
+        n -= k;
+    }
+}
+
+static inline void putc_(jsonw_t *w, char c)
+{
+    if (w->len == w->size) jsonw_flush(w);
+    if (!w->err) w->buf[w->len++] = c;
+}
+
+// Separator before a value or key at the current level
+static void begin_value(jsonw_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    uint8_t bit = 1u << w->depth;
+    if (w->has_member & bit) putc_(w, ',');
+    w->has_member |= bit;
+}
+
+static void open_level(jsonw_t *w, char c)
+{
+    begin_value(w);
+    putc_(w, c);
+    if (w->depth + 1 < JSONW_MAX_DEPTH) {
+        w->depth++;
+        w->has_member &= ~(1u << w->depth);
+    } else {
+        w->err = -1;
+    }
+}
+
+static void close_level(jsonw_t *w, char c)
+{
+    putc_(w, c);
+    if (w->depth > 0) w->depth--;
+}
+
+void jsonw_object_begin(jsonw_t *w) { open_level(w, '{'); }
+void jsonw_object_end(jsonw_t *w)   { close_level(w, '}'); }
+void jsonw_array_begin(jsonw_t *w)  { open_level(w, '['); }
+void jsonw_array_end(jsonw_t *w)    { close_level(w, ']'); }
+
+static void put_escaped(jsonw_t *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    putc_(w, '"');
+    const char *run = s;  // copy unescaped runs in one go
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        put(w, run, s - run);
+        run = s + 1;
+        switch (c) {
+        case '"':  put(w, "\\\"", 2); break;
+        case '\\': put(w, "\\\\", 2); break;
+        case '\n': put(w, "\\n", 2); break;
+        case '\r': put(w, "\\r", 2); break;
+        case '\t': put(w, "\\t", 2); break;
+        default: {
+            char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+            put(w, u, 6);
+        }
+        }
+    }
+    put(w, run, s - run);
+    putc_(w, '"');
+}
+
+void jsonw_key(jsonw_t *w, const char *key)
+{
+    begin_value(w);
+    put_escaped(w, key);
+    putc_(w, ':');
+    w->after_key = true;
+}
+
+void jsonw_string(jsonw_t *w, const char *s)
+{
+    begin_value(w);
+    put_escaped(w, s ? s : "");
+}
+
+static size_t format_uint(char *end, uint64_t v)
+{
+    char *p = end;
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    return end - p;
+}
+
+void jsonw_int(jsonw_t *w, int64_t v)
+{
+    char tmp[21];
+    uint64_t u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+    size_t n = format_uint(tmp + sizeof(tmp), u);
+    begin_value(w);
+    if (v < 0) putc_(w, '-');
+    put(w, tmp + sizeof(tmp) - n, n);
+}
+
+static void put_fixed(jsonw_t *w, double v, int decimals, bool trim)
+{
+    static const uint32_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    if (decimals < 0) decimals = 0;
+    if (decimals > 6) decimals = 6;
+
+    bool neg = v < 0;
+    if (neg) v = -v;
+    uint64_t scaled = (uint64_t)(v * pow10[decimals] + 0.5);
+    uint64_t ip = scaled / pow10[decimals];
+    uint32_t fp = scaled % pow10[decimals];
+
+    char tmp[32];
+    char *end = tmp + sizeof(tmp);
+    size_t n = 0;
+    if (decimals > 0) {
+        int d = decimals;
+        if (trim) {
+            while (d > 0 && fp % 10 == 0) {
+                fp /= 10;
+                d--;
+            }
+        }
+        for (int i = 0; i < d; i++) {
+            *(end - 1 - n) = '0' + fp % 10;
+            fp /= 10;
+            n++;
+        }
+        if (d > 0) {
+            *(end - 1 - n) = '.';
+            n++;
+        }
+    }
+    n += format_uint(end - n, ip);
+    if (neg && scaled) putc_(w, '-');
+    put(w, end - n, n);
+}
+
+void jsonw_fixed(jsonw_t *w, double v, int decimals)
+{
+    begin_value(w);
+    if (isnan(v) || isinf(v)) {
+        put(w, "null", 4);
+        return;
+    }
+    put_fixed(w, v, fabs(v) >= 1e12 ? 0 : decimals, false);
+}
+
+void jsonw_double(jsonw_t *w, double v)
+{
+    begin_value(w);
+    if (isnan(v) || isinf(v)) {
+        put(w, "null", 4);
+        return;
+    }
+    // Six decimals, trailing zeros dropped; plenty for sensor values
+    put_fixed(w, v, fabs(v) >= 1e12 ? 0 : 6, true);
+}
+
+void jsonw_bool(jsonw_t *w, bool v)
+{
+    begin_value(w);
+    if (v)
+        put(w, "true", 4);
+    else
+        put(w, "false", 5);
+}
+
+void jsonw_null(jsonw_t *w)
+{
+    begin_value(w);
+    put(w, "null", 4);
+}
+
+void jsonw_field_string(jsonw_t *w, const char *key, const char *s)
+{
+    jsonw_key(w, key);
+    jsonw_string(w, s);
+}
+
+void jsonw_field_int(jsonw_t *w, const char *key, int64_t v)
+{
+    jsonw_key(w, key);
+    jsonw_int(w, v);
+}
+
+void jsonw_field_double(jsonw_t *w, const char *key, double v)
+{
+    jsonw_key(w, key);
+    jsonw_double(w, v);
+}
+
+void jsonw_field_fixed(jsonw_t *w, const char *key, double v, int decimals)
+{
+    jsonw_key(w, key);
+    jsonw_fixed(w, v, decimals);
+}
+
+void jsonw_field_bool(jsonw_t *w, const char *key, bool v)
+{
+    jsonw_key(w, key);
+    jsonw_bool(w, v);
+}
+
+int jsonw_finish(jsonw_t *w)
+{
+    if (!w->err && w->depth != 0) w->err = -1;  // unbalanced
+    return w->err;
+}
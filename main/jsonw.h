@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Streaming JSON writer over a caller-provided buffer (usually on the
+// stack). Output is handed to flush() whenever the buffer fills, so the
+// document size is not limited by the buffer and nothing is allocated.
+// Commas between members are inserted automatically. Pure C like
+// trigger.c, so tools/json_bench can run it on the host.
+
+#define JSONW_MAX_DEPTH 8
+
+// Returns 0 on success. After a failure the writer drops further output
+// and jsonw_finish() reports the error.
+typedef int (*jsonw_flush_fn)(void *ctx, const char *data, size_t len);
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;             // bytes waiting in buf
+    size_t flushed;         // bytes already handed to flush()
+    jsonw_flush_fn flush;
+    void *ctx;
+    int err;
+    uint8_t depth;
+    uint8_t has_member;     // bit per depth: a value was written at this level
+    bool after_key;         // next value belongs to the key just written
+} jsonw_t;
+
+void jsonw_init(jsonw_t *w, char *buf, size_t size, jsonw_flush_fn flush, void *ctx);
+
+void jsonw_object_begin(jsonw_t *w);
+void jsonw_object_end(jsonw_t *w);
+void jsonw_array_begin(jsonw_t *w);
+void jsonw_array_end(jsonw_t *w);
+
+void jsonw_key(jsonw_t *w, const char *key);
+
+void jsonw_string(jsonw_t *w, const char *s);
+void jsonw_int(jsonw_t *w, int64_t v);
+void jsonw_double(jsonw_t *w, double v);                 // NaN/Inf become null
+void jsonw_fixed(jsonw_t *w, double v, int decimals);    // fixed-point, e.g. 1.25
+void jsonw_bool(jsonw_t *w, bool v);
+void jsonw_null(jsonw_t *w);
+
+// key + value in one call
+void jsonw_field_string(jsonw_t *w, const char *key, const char *s);
+void jsonw_field_int(jsonw_t *w, const char *key, int64_t v);
+void jsonw_field_double(jsonw_t *w, const char *key, double v);
+void jsonw_field_fixed(jsonw_t *w, const char *key, double v, int decimals);
+void jsonw_field_bool(jsonw_t *w, const char *key, bool v);
+
+// Hand any buffered output to flush(). Returns the first error, or 0.
+int jsonw_flush(jsonw_t *w);
+
+// End of document: returns the first error, or 0. Output still in the
+// buffer is NOT flushed, so a caller can send a document that never
+// overflowed (w->flushed == 0) in one piece; call jsonw_flush() otherwise.
+int jsonw_finish(jsonw_t *w);
@@ -1,24 +1,31 @@
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include <time.h>
 #include <sys/time.h>
-#include <dirent.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_heap_caps.h"
 #include "esp_netif_sntp.h"
+#include "esp_timer.h"
 
 #include "wifi.h"
 #include "audio.h"
 #include "sdcard.h"
-#include "wav.h"
 #include "webserver.h"
 #include "waveform.h"
+#include "writer.h"
+#include "dashcam.h"
+#include "pcm_ring.h"
+#include "trigger.h"
+#include "vad.h"
+#include "events.h"
+#include "catalog.h"
+#include "status.h"
+#include "cmdq.h"
+#include "stream.h"
 
 static const char *TAG = "main";
 
@@ -29,70 +36,75 @@ typedef enum {
     REC_SOURCE_AUTO,
 } rec_source_t;
 
-// --- Auto-record states ---
-enum { AUTO_IDLE = 0, AUTO_RECORDING };
-
-// Recording state -- protected by mutex
-static SemaphoreHandle_t s_rec_mutex;
+// Recording state -- owned by the audio task; other tasks send commands
+// (cmdq.h) and read the published snapshot (status.h)
 static volatile bool s_recording = false;
-static volatile bool s_rec_request_start = false;
-static volatile bool s_rec_request_stop = false;
-static FILE *s_wav_file = NULL;
 static char s_rec_filename[96];
 static char s_rec_start_time[80];
 static rec_source_t s_rec_source = REC_SOURCE_NONE;
 
-// Auto-record state -- protected by mutex
+// Auto-record state
 static volatile bool     s_auto_mode = false;
 static uint16_t          s_auto_threshold = 2000;
-static int               s_auto_state = AUTO_IDLE;
-static uint32_t          s_silence_chunks = 0;
+static trigger_t         s_trigger;     // see trigger.c
 static volatile uint16_t s_current_rms = 0;
 
 // µ-law compression toggle
 static volatile bool s_use_ulaw = false;
 
-// File splitting state
-static uint32_t s_samples_written = 0;
-static int s_file_part = 1;
-static char s_rec_basename[48];  // base name without .wav extension
-#define MAX_FILE_SAMPLES (5 * 60 * AUDIO_SAMPLE_RATE)  // 6,000,000
-
-// Smoothed RMS and adaptive noise floor
-static float s_rms_smooth = 0;          // fast EMA of per-chunk RMS
-static float s_noise_floor = 0;         // slow EMA tracking ambient level
-static uint32_t s_loud_streak = 0;      // consecutive loud chunks
-
-// Zero-crossing rate for auto-record
-static float s_zcr_smooth = 0;          // smoothed ZCR
-static volatile float s_current_zcr = 0;  // exposed to status API
-#define ZCR_SMOOTH_ALPHA 0.3f
-
-// EMA coefficients (alpha): higher = more responsive
-#define RMS_SMOOTH_ALPHA    0.3f   // ~3 chunks to settle
-#define NOISE_FLOOR_ALPHA   0.005f // ~200 chunks (~4s) to settle
-// Trigger requires smoothed RMS to exceed BOTH:
-//   1) noise_floor * NOISE_MULT (relative to ambient)
-//   2) s_auto_threshold (absolute minimum, user-configurable)
-#define NOISE_MULT          3.0f
-// Need this many consecutive loud chunks to trigger (~100ms)
-#define TRIGGER_STREAK      5
-// Silence uses lower bar: just below threshold (hysteresis)
-#define SILENCE_FRAC        0.7f
-
-// Pre-buffer ring (1 second = 20000 samples @ 20kHz)
-#define PRE_BUF_SAMPLES 20000
-static int16_t *s_pre_buf = NULL;
-static size_t    s_pre_buf_head = 0;
-static size_t    s_pre_buf_count = 0;
-
-// Write buffer -- accumulate PCM in PSRAM, flush to SD in larger chunks
-#define WRITE_BUF_SAMPLES  8000  // 8000 samples = 16KB = ~400ms @ 20kHz
-static int16_t *s_write_buf = NULL;
-static size_t s_write_buf_pos = 0;
-
-// Silence timeout: ~2 minutes at 20ms/chunk = 6000 chunks
-#define SILENCE_TIMEOUT_CHUNKS 6000
+// Settings as last requested (and persisted) by the web server; the audio
+// task's copies follow through the command queue
+static volatile bool     s_cfg_auto_mode = false;
+static volatile uint16_t s_cfg_auto_threshold = 2000;
+static volatile bool     s_cfg_use_ulaw = false;
+static volatile bool     s_cfg_ev_container = false;
+
+// Append auto-triggered events to a daily container instead of new files
+static bool s_ev_container = false;
+
+// Base name without .wav extension; split parts are handled by writer.c
+static char s_rec_basename[48];
+
+// Zero-crossing rate of the last chunk, exposed to status API
+static volatile float s_current_zcr = 0;
+
+// Spectral VAD (owned by the audio task; only runs in spectral mode)
+static vad_t s_vad;
+static uint8_t           s_vad_mode = TRIGGER_MODE_RMS;
+static volatile uint8_t  s_cfg_vad_mode = TRIGGER_MODE_RMS;  // as last requested
+static volatile bool     s_vad_voice = false;
+static volatile uint32_t s_vad_us = 0;      // smoothed CPU time per frame
+static volatile uint32_t s_vad_us_max = 0;  // worst frame since mode change
+
+// Auto-record timing, applied to the detector by the audio task
+#define SILENCE_DEFAULT_S   120
+#define SILENCE_MAX_S       3600
+#define MIN_EVENT_DEFAULT_MS 100
+#define MIN_EVENT_MAX_MS    10000
+static uint16_t s_silence_s = SILENCE_DEFAULT_S;
+static uint16_t s_min_event_ms = MIN_EVENT_DEFAULT_MS;
+// As last requested
+static volatile uint16_t s_cfg_silence_s = SILENCE_DEFAULT_S;
+static volatile uint16_t s_cfg_min_event_ms = MIN_EVENT_DEFAULT_MS;
+
+// Free-space check while recording
+#define SPACE_CHECK_INTERVAL_US (5 * 1000 * 1000)
+
+// Pre-trigger ring in PSRAM, sized at runtime (owned by the audio task)
+#define PREROLL_DEFAULT_S  1
+#define PREROLL_MAX_S      30
+static pcm_ring_t s_pre_ring;
+static uint8_t s_preroll_s = PREROLL_DEFAULT_S;           // requested length
+static volatile uint8_t s_cfg_preroll_s = PREROLL_DEFAULT_S;  // as last requested
+static uint8_t s_preroll_alloc_s = 0;                     // current ring length
+
+// A long pre-roll takes the writer a while (30 s is 1.2 MB, 1-2 s on SDSPI).
+// Live audio meanwhile is parked in the ring behind it rather than in the
+// writer's block pool, which only covers ~1.6 s; the ring gets a quarter of
+// its length plus PREROLL_CATCHUP_S extra storage for that.
+#define PREROLL_CATCHUP_S  2
+static bool s_pre_catchup = false;  // live audio goes to the ring, not the writer
+static size_t s_pre_held = 0;       // ring position the writer still reads from
 
 // --- SNTP time sync ---
 static void init_sntp(void)
@@ -120,21 +132,15 @@ static void init_sntp(void)
 }
 
 // --- Filename generation ---
+// The recording being written is only catalogued once it is finalised, so the
+// catalogue alone would hand a quick stop/start the same number again. Seeded
+// from it on first use, then counted here. Audio task only.
+static int s_next_rec_num = 0;
+
 static int next_rec_number(void)
 {
-    int max_num = 0;
-    DIR *dir = opendir(SD_MOUNT_POINT);
-    if (!dir) return 1;
-
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-        int n;
-        if (sscanf(ent->d_name, "rec_%d.wav", &n) == 1) {
-            if (n > max_num) max_num = n;
-        }
-    }
-    closedir(dir);
-    return max_num + 1;
+    if (s_next_rec_num == 0) s_next_rec_num = catalog_max_rec_number() + 1;
+    return s_next_rec_num++;
 }
 
 static void generate_rec_filename(void)
@@ -162,49 +168,82 @@ static void generate_rec_filename(void)
     }
 }
 
-// --- Pre-buffer ring ---
-static void pre_buf_write(const int16_t *samples, size_t count)
+// --- Pre-trigger ring ---
+// (Re)size the ring when the setting changed. Audio task only.
+static void pre_ring_apply_size(void)
 {
-    for (size_t i = 0; i < count; i++) {
-        s_pre_buf[s_pre_buf_head] = samples[i];
-        s_pre_buf_head = (s_pre_buf_head + 1) % PRE_BUF_SAMPLES;
-        if (s_pre_buf_count < PRE_BUF_SAMPLES) s_pre_buf_count++;
+    if (s_preroll_alloc_s == s_preroll_s) return;
+    if (writer_refs_pending() || s_pre_catchup) return;  // writer still reads the old ring
+
+    pcm_ring_free(&s_pre_ring);
+    uint8_t sec = s_preroll_s;
+    size_t cap = (size_t)sec * AUDIO_SAMPLE_RATE;
+    if (pcm_ring_init(&s_pre_ring, cap, cap / 4 + PREROLL_CATCHUP_S * AUDIO_SAMPLE_RATE) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot allocate %us pre-roll, falling back to %us",
+                 sec, PREROLL_DEFAULT_S);
+        sec = PREROLL_DEFAULT_S;
+        cap = (size_t)sec * AUDIO_SAMPLE_RATE;
+        pcm_ring_init(&s_pre_ring, cap, cap / 4 + PREROLL_CATCHUP_S * AUDIO_SAMPLE_RATE);
     }
+    s_preroll_alloc_s = sec;
+    ESP_LOGI(TAG, "Pre-roll ring: %us (%u samples)", sec, (unsigned)s_pre_ring.size);
 }
 
-static void pre_buf_flush_to_wav(void)
+// Hand the ring contents to the writer without copying. The ring is not
+// written again until the writer is done with it (see pre_ring_feed), except
+// for live audio parked behind it (see record_samples).
+static void pre_ring_flush_to_wav(void)
 {
-    if (!s_wav_file || s_pre_buf_count == 0) return;
-
-    // Start reading from oldest sample
-    size_t start;
-    if (s_pre_buf_count < PRE_BUF_SAMPLES) {
-        start = 0;
-    } else {
-        start = s_pre_buf_head; // head points to oldest when full
-    }
+    if (!s_recording) return;
+    if (!writer_refs_pending()) s_pre_held = s_pre_ring.head - s_pre_ring.count;
+
+    const int16_t *a, *b;
+    size_t na, nb;
+    if (pcm_ring_peek(&s_pre_ring, &a, &na, &b, &nb) == 0) return;
+    writer_write_ref(a, na);
+    writer_write_ref(b, nb);
+    pcm_ring_clear(&s_pre_ring);
+    s_pre_catchup = true;
+}
 
-    // Flush in one or two segments (ring buffer wrap)
-    if (start + s_pre_buf_count <= PRE_BUF_SAMPLES) {
-        if (s_use_ulaw)
-            wav_write_ulaw(s_wav_file, &s_pre_buf[start], s_pre_buf_count);
-        else
-            wav_write(s_wav_file, &s_pre_buf[start], s_pre_buf_count);
-        s_samples_written += s_pre_buf_count;
-    } else {
-        size_t first = PRE_BUF_SAMPLES - start;
-        if (s_use_ulaw) {
-            wav_write_ulaw(s_wav_file, &s_pre_buf[start], first);
-            wav_write_ulaw(s_wav_file, &s_pre_buf[0], s_pre_buf_count - first);
+// Recorded audio to the writer. After a pre-roll flush it is parked in the
+// ring and handed over by reference each time the writer has finished the
+// previous hand-over, until less than a block has piled up: that is copied
+// to the writer and from then on audio goes straight to it. No block waits
+// on the card in between.
+static void record_samples(const int16_t *samples, size_t count)
+{
+    if (s_pre_catchup && !writer_refs_pending()) {
+        if (s_pre_ring.count > WRITER_BLOCK_SAMPLES) {
+            pre_ring_flush_to_wav();
         } else {
-            wav_write(s_wav_file, &s_pre_buf[start], first);
-            wav_write(s_wav_file, &s_pre_buf[0], s_pre_buf_count - first);
+            const int16_t *a, *b;
+            size_t na, nb;
+            pcm_ring_peek(&s_pre_ring, &a, &na, &b, &nb);
+            writer_write(a, na);
+            writer_write(b, nb);
+            pcm_ring_clear(&s_pre_ring);
+            s_pre_catchup = false;
         }
-        s_samples_written += s_pre_buf_count;
+    }
+    if (!s_pre_catchup) {
+        writer_write(samples, count);
+        return;
     }
 
-    s_pre_buf_head = 0;
-    s_pre_buf_count = 0;
+    size_t held = s_pre_ring.head - s_pre_ring.count - s_pre_held;
+    if (!pcm_ring_append(&s_pre_ring, samples, count, held)) {
+        // Card slower than the headroom allows: the block pool is the last
+        // resort, after what is parked (the writer's queue keeps the order)
+        pre_ring_flush_to_wav();
+        writer_write(samples, count);
+    }
+}
+
+static void pre_ring_feed(const int16_t *samples, size_t count)
+{
+    if (writer_refs_pending()) return;
+    pcm_ring_write(&s_pre_ring, samples, count);
 }
 
 // --- NVS helpers ---
@@ -239,89 +278,121 @@ static void load_settings_from_nvs(void)
     if (nvs_get_u16(h, "auto_thr", &u16) == ESP_OK) s_auto_threshold = u16;
     if (nvs_get_u8(h, "auto_mode", &u8) == ESP_OK) s_auto_mode = u8;
     if (nvs_get_u8(h, "use_ulaw", &u8) == ESP_OK) s_use_ulaw = u8;
+    if (nvs_get_u8(h, "ev_cont", &u8) == ESP_OK) s_ev_container = u8;
+    if (nvs_get_u8(h, "preroll_s", &u8) == ESP_OK && u8 <= PREROLL_MAX_S) s_preroll_s = u8;
+    if (nvs_get_u8(h, "vad_mode", &u8) == ESP_OK && u8 <= TRIGGER_MODE_SPECTRAL) s_vad_mode = u8;
+    if (nvs_get_u16(h, "silence_s", &u16) == ESP_OK && u16 >= 1 && u16 <= SILENCE_MAX_S) s_silence_s = u16;
+    if (nvs_get_u16(h, "min_ev_ms", &u16) == ESP_OK && u16 <= MIN_EVENT_MAX_MS) s_min_event_ms = u16;
 
     uint16_t hp = 0, lp = 0;
     nvs_get_u16(h, "filter_hp", &hp);
     nvs_get_u16(h, "filter_lp", &lp);
     if (hp || lp) audio_set_filter(hp, lp);
 
+    s_cfg_auto_mode = s_auto_mode;
+    s_cfg_auto_threshold = s_auto_threshold;
+    s_cfg_use_ulaw = s_use_ulaw;
+    s_cfg_vad_mode = s_vad_mode;
+    s_cfg_silence_s = s_silence_s;
+    s_cfg_min_event_ms = s_min_event_ms;
+    s_cfg_preroll_s = s_preroll_s;
+    s_cfg_ev_container = s_ev_container;
+
     nvs_close(h);
-    ESP_LOGI(TAG, "NVS: thr=%u auto=%d ulaw=%d hp=%u lp=%u",
-             s_auto_threshold, s_auto_mode, s_use_ulaw, hp, lp);
+    ESP_LOGI(TAG, "NVS: thr=%u auto=%d vad=%u silence=%us min_ev=%ums ulaw=%d preroll=%us hp=%u lp=%u",
+             s_auto_threshold, s_auto_mode, s_vad_mode, s_silence_s, s_min_event_ms,
+             s_use_ulaw, s_preroll_s, hp, lp);
 }
 
 // --- Getters for webserver ---
-bool main_is_recording(void) { return s_recording; }
-const char *main_rec_filename(void) { return s_rec_filename; }
-const char *main_rec_start_time(void) { return s_rec_start_time; }
-uint16_t main_current_rms(void) { return s_current_rms; }
-bool main_auto_mode(void) { return s_auto_mode; }
-uint16_t main_auto_threshold(void) { return s_auto_threshold; }
-bool main_use_ulaw(void) { return s_use_ulaw; }
-void main_set_use_ulaw(bool v) { s_use_ulaw = v; nvs_save_u8("use_ulaw", v); }
-float main_current_zcr(void) { return s_current_zcr; }
-
-const char *main_rec_source_str(void)
+// (live recorder state is published as a snapshot, see publish_status)
+bool main_auto_mode(void) { return s_cfg_auto_mode; }
+uint16_t main_auto_threshold(void) { return s_cfg_auto_threshold; }
+bool main_use_ulaw(void) { return s_cfg_use_ulaw; }
+uint8_t main_preroll_seconds(void) { return s_cfg_preroll_s; }
+const char *main_vad_mode_str(void) { return s_cfg_vad_mode == TRIGGER_MODE_SPECTRAL ? "spectral" : "rms"; }
+uint16_t main_silence_seconds(void) { return s_cfg_silence_s; }
+uint16_t main_min_event_ms(void) { return s_cfg_min_event_ms; }
+bool main_event_container(void) { return s_cfg_ev_container; }
+
+// Settings that touch audio-task state are persisted here and applied by
+// the audio task at the next frame. False if the command queue is full.
+static bool submit(cmd_type_t type, int32_t a, int32_t b)
 {
-    switch (s_rec_source) {
-    case REC_SOURCE_MANUAL: return "manual";
-    case REC_SOURCE_AUTO:   return "auto";
-    default:                return "none";
-    }
+    cmd_t c = { .type = type, .a = a, .b = b };
+    if (cmdq_push(&c)) return true;
+    ESP_LOGW(TAG, "Command queue full, dropping command %d", type);
+    return false;
 }
 
-void main_set_auto_mode(bool enabled)
+bool main_set_auto_mode(bool enabled)
 {
-    if (enabled && !s_auto_mode) {
-        // Reset adaptive state on fresh enable
-        s_noise_floor = 0;
-        s_rms_smooth = 0;
-        s_zcr_smooth = 0;
-        s_loud_streak = 0;
-        s_auto_state = AUTO_IDLE;
-        s_silence_chunks = 0;
-    }
-    s_auto_mode = enabled;
+    s_cfg_auto_mode = enabled;
     nvs_save_u8("auto_mode", enabled);
+    return submit(CMD_SET_AUTO, enabled, 0);
 }
-void main_set_auto_threshold(uint16_t thr)
+bool main_set_auto_threshold(uint16_t thr)
 {
     if (thr < 100) thr = 100;
     if (thr > 10000) thr = 10000;
-    s_auto_threshold = thr;
+    s_cfg_auto_threshold = thr;
     nvs_save_u16("auto_thr", thr);
+    return submit(CMD_SET_THRESHOLD, thr, 0);
 }
-
-// --- Flush write buffer to SD (with file splitting) ---
-static void flush_write_buf(void)
+bool main_set_use_ulaw(bool v)
 {
-    if (s_write_buf_pos > 0 && s_wav_file) {
-        if (s_use_ulaw)
-            wav_write_ulaw(s_wav_file, s_write_buf, s_write_buf_pos);
-        else
-            wav_write(s_wav_file, s_write_buf, s_write_buf_pos);
-        s_samples_written += s_write_buf_pos;
-        s_write_buf_pos = 0;
-
-        // File splitting at MAX_FILE_SAMPLES
-        if (s_samples_written >= MAX_FILE_SAMPLES) {
-            wav_close(s_wav_file);
-            s_file_part++;
-            snprintf(s_rec_filename, sizeof(s_rec_filename),
-                     "%s_p%d.wav", s_rec_basename, s_file_part);
-            char path[128];
-            snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, s_rec_filename);
-            if (s_use_ulaw)
-                s_wav_file = wav_open_ulaw(path, AUDIO_SAMPLE_RATE, 1);
-            else
-                s_wav_file = wav_open(path, AUDIO_SAMPLE_RATE, 16, 1);
-            s_samples_written = 0;
-            ESP_LOGI(TAG, "File split: now recording %s", s_rec_filename);
-        }
-    }
+    s_cfg_use_ulaw = v;
+    nvs_save_u8("use_ulaw", v);
+    return submit(CMD_SET_CODEC, v, 0);
+}
+bool main_set_filter(uint16_t hp, uint16_t lp)
+{
+    nvs_save_u16("filter_hp", hp);
+    nvs_save_u16("filter_lp", lp);
+    return submit(CMD_SET_FILTER, hp, lp);
+}
+// "rms" or "spectral". False for anything else, or if the queue is full.
+bool main_set_vad_mode(const char *mode)
+{
+    uint8_t m;
+    if (strcmp(mode, "rms") == 0) m = TRIGGER_MODE_RMS;
+    else if (strcmp(mode, "spectral") == 0) m = TRIGGER_MODE_SPECTRAL;
+    else return false;
+    s_cfg_vad_mode = m;
+    nvs_save_u8("vad_mode", m);
+    return submit(CMD_SET_VAD, m, 0);
+}
+bool main_set_silence_seconds(uint16_t sec)
+{
+    if (sec < 1) sec = 1;
+    if (sec > SILENCE_MAX_S) sec = SILENCE_MAX_S;
+    s_cfg_silence_s = sec;
+    nvs_save_u16("silence_s", sec);
+    return submit(CMD_SET_TIMING, sec, s_cfg_min_event_ms);
+}
+bool main_set_min_event_ms(uint16_t ms)
+{
+    if (ms > MIN_EVENT_MAX_MS) ms = MIN_EVENT_MAX_MS;
+    s_cfg_min_event_ms = ms;
+    nvs_save_u16("min_ev_ms", ms);
+    return submit(CMD_SET_TIMING, s_cfg_silence_s, ms);
+}
+// The ring is resized once the audio task is idle
+bool main_set_preroll_seconds(uint8_t sec)
+{
+    if (sec > PREROLL_MAX_S) sec = PREROLL_MAX_S;
+    s_cfg_preroll_s = sec;
+    nvs_save_u8("preroll_s", sec);
+    return submit(CMD_SET_PREROLL, sec, 0);
+}
+bool main_set_event_container(bool v)
+{
+    s_cfg_ev_container = v;
+    nvs_save_u8("ev_cont", v);
+    return submit(CMD_SET_CONTAINER, v, 0);
 }
 
-// --- Start/stop recording helpers (must be called under mutex) ---
+// --- Start/stop recording helpers (audio task) ---
 static bool start_recording(rec_source_t source)
 {
     uint64_t free_space = sdcard_free_bytes();
@@ -330,21 +401,19 @@ static bool start_recording(rec_source_t source)
         return false;
     }
 
-    generate_rec_filename();
-    char path[128];
-    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, s_rec_filename);
-
-    if (s_use_ulaw)
-        s_wav_file = wav_open_ulaw(path, AUDIO_SAMPLE_RATE, 1);
-    else
-        s_wav_file = wav_open(path, AUDIO_SAMPLE_RATE, 16, 1);
-    if (!s_wav_file) return false;
+    if (source == REC_SOURCE_AUTO && s_ev_container) {
+        char container[48];
+        events_container_name(s_use_ulaw, container, sizeof(container));
+        if (writer_start_event(container, s_use_ulaw) != ESP_OK) return false;
+        snprintf(s_rec_filename, sizeof(s_rec_filename), "%s", container);
+        s_rec_start_time[0] = '\0';
+    } else {
+        generate_rec_filename();
+        if (writer_start(s_rec_basename, s_use_ulaw) != ESP_OK) return false;
+    }
 
     s_recording = true;
     s_rec_source = source;
-    s_write_buf_pos = 0;
-    s_samples_written = 0;
-    s_file_part = 1;
     ESP_LOGI(TAG, "Recording started (%s): %s",
              source == REC_SOURCE_AUTO ? "auto" : "manual", s_rec_filename);
     return true;
@@ -352,27 +421,119 @@ static bool start_recording(rec_source_t source)
 
 static void stop_recording(void)
 {
-    flush_write_buf();
+    // Close happens on the writer task, the waveform cache on the background one
+    char name[48];
+    writer_current_name(name, sizeof(name));
+    if (s_pre_catchup) {
+        pre_ring_flush_to_wav();  // audio still parked in the pre-roll ring
+        s_pre_catchup = false;
+    }
+    writer_stop();
     s_recording = false;
-    wav_close(s_wav_file);
-    s_wav_file = NULL;
     ESP_LOGI(TAG, "Recording stopped (%s): %s",
-             s_rec_source == REC_SOURCE_AUTO ? "auto" : "manual", s_rec_filename);
-    // Generate waveform cache for the completed recording
-    waveform_generate(s_rec_filename);
+             s_rec_source == REC_SOURCE_AUTO ? "auto" : "manual", name);
     s_rec_source = REC_SOURCE_NONE;
 }
 
-// --- WebSocket command callback (runs in httpd task context) ---
-static void on_ws_command(const char *cmd)
+// --- Live status snapshot ---
+// Built from state the audio task owns and published as one unit, so readers never see a file name from one
+// recording next to the state of another.
+static void publish_status(void)
 {
-    xSemaphoreTake(s_rec_mutex, portMAX_DELAY);
-    if (strcmp(cmd, "start_rec") == 0 && !s_recording) {
-        s_rec_request_start = true;
-    } else if (strcmp(cmd, "stop_rec") == 0 && s_recording) {
-        s_rec_request_stop = true;
+    status_snapshot_t snap = {
+        .recording = s_recording,
+        .rec_source = (uint8_t)s_rec_source,
+        .rms = s_current_rms,
+        .zcr = s_current_zcr,
+        .vad_voice = s_vad_voice,
+        .vad_us = s_vad_us,
+        .vad_us_max = s_vad_us_max,
+        .adc_overflows = audio_get_overflow_count(),
+        .auto_mode = s_auto_mode,
+        .auto_threshold = s_auto_threshold,
+        .preroll_s = s_preroll_s,
+        .silence_s = s_silence_s,
+        .min_event_ms = s_min_event_ms,
+        .container = s_ev_container,
+        .ulaw = s_use_ulaw,
+        .vad_spectral = s_vad_mode == TRIGGER_MODE_SPECTRAL,
+        .filter_hp = audio_get_hp_freq(),
+        .filter_lp = audio_get_lp_freq(),
+    };
+    if (s_recording) {
+        writer_current_name(snap.filename, sizeof(snap.filename));
+        snprintf(snap.rec_started_at, sizeof(snap.rec_started_at), "%s", s_rec_start_time);
+    }
+    status_publish(&snap);
+}
+
+// --- WebSocket/HTTP command callback (runs in httpd task context) ---
+// Only queues the command; done(ctx, result) follows from the audio task.
+static bool on_ws_command(const char *cmd, cmd_done_fn done, void *ctx)
+{
+    cmd_t c = { .done = done, .ctx = ctx };
+    if (strcmp(cmd, "start_rec") == 0) {
+        c.type = CMD_REC_START;
+    } else if (strcmp(cmd, "stop_rec") == 0) {
+        c.type = CMD_REC_STOP;
+    } else {
+        return false;
     }
-    xSemaphoreGive(s_rec_mutex);
+    return cmdq_push(&c);
+}
+
+// Apply one queued command between frames (audio task)
+static esp_err_t apply_command(const cmd_t *c, int64_t *next_space_check)
+{
+    switch (c->type) {
+    case CMD_REC_START:
+        if (s_recording && s_rec_source == REC_SOURCE_MANUAL) return ESP_ERR_INVALID_STATE;
+        // Manual start stops any auto-recording first
+        if (s_recording) {
+            stop_recording();
+            trigger_set_idle(&s_trigger);
+        }
+        if (!start_recording(REC_SOURCE_MANUAL)) return ESP_FAIL;
+        *next_space_check = esp_timer_get_time() + SPACE_CHECK_INTERVAL_US;
+        return ESP_OK;
+    case CMD_REC_STOP:
+        if (!s_recording) return ESP_ERR_INVALID_STATE;
+        stop_recording();
+        // If was auto-recording, reset auto state
+        trigger_set_idle(&s_trigger);
+        return ESP_OK;
+    case CMD_SET_AUTO:
+        if (c->a && !s_auto_mode) {
+            // Reset adaptive state on fresh enable
+            trigger_reset(&s_trigger);
+        }
+        s_auto_mode = c->a != 0;
+        return ESP_OK;
+    case CMD_SET_THRESHOLD:
+        s_auto_threshold = (uint16_t)c->a;
+        return ESP_OK;
+    case CMD_SET_CODEC:
+        s_use_ulaw = c->a != 0;  // from the next recording on
+        return ESP_OK;
+    case CMD_SET_FILTER:
+        audio_set_filter((uint16_t)c->a, (uint16_t)c->b);
+        return ESP_OK;
+    case CMD_SET_VAD:
+        s_vad_mode = (uint8_t)c->a;
+        s_vad_us_max = 0;
+        return ESP_OK;
+    case CMD_SET_TIMING:
+        s_silence_s = (uint16_t)c->a;
+        s_min_event_ms = (uint16_t)c->b;
+        return ESP_OK;
+    case CMD_SET_PREROLL:
+        s_preroll_s = (uint8_t)c->a;  // see pre_ring_apply_size()
+        return ESP_OK;
+    case CMD_SET_CONTAINER:
+        s_ev_container = c->a != 0;   // from the next event on
+        return ESP_OK;
+    }
+    return ESP_ERR_INVALID_ARG;
 }
 
 // --- Audio pipeline task -- pinned to core 1 ---
@@ -386,24 +547,13 @@ static void audio_pipeline_task(void *arg)
         return;
     }
 
-    s_write_buf = heap_caps_malloc(WRITE_BUF_SAMPLES * sizeof(int16_t), MALLOC_CAP_SPIRAM);
-    if (!s_write_buf) {
-        ESP_LOGE(TAG, "Failed to allocate write buffer in PSRAM");
-        vTaskDelete(NULL);
-        return;
-    }
-
-    s_pre_buf = heap_caps_malloc(PRE_BUF_SAMPLES * sizeof(int16_t), MALLOC_CAP_SPIRAM);
-    if (!s_pre_buf) {
-        ESP_LOGE(TAG, "Failed to allocate pre-buffer in PSRAM");
-        vTaskDelete(NULL);
-        return;
-    }
+    pre_ring_apply_size();
 
     ESP_ERROR_CHECK(audio_start());
     ESP_LOGI(TAG, "Audio pipeline running on core %d", xPortGetCoreID());
 
-    int space_check_count = 0;
+    int64_t next_space_check = 0;
+    bool vad_active = false;
 
     while (1) {
         ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
@@ -413,150 +563,103 @@ static void audio_pipeline_task(void *arg)
             esp_err_t ret = audio_read(pcm_buf, &num_samples);
             if (ret != ESP_OK || num_samples == 0) break;
 
-            // 1. Compute RMS and ZCR (before mutex)
-            float sum_sq = 0;
-            int zc = 0;
-            for (size_t i = 0; i < num_samples; i++) {
-                float s = (float)pcm_buf[i];
-                sum_sq += s * s;
-                if (i > 0 && ((pcm_buf[i] > 0) != (pcm_buf[i-1] > 0))) zc++;
-            }
-            s_current_rms = (uint16_t)sqrtf(sum_sq / num_samples);
-            float zcr = (num_samples > 1) ? (float)zc / (num_samples - 1) : 0;
+            // 1. Compute RMS and ZCR
+            float rms, zcr;
+            uint16_t peak;
+            trigger_frame_stats(pcm_buf, num_samples, &rms, &zcr, &peak);
+            s_current_rms = (uint16_t)rms;
             s_current_zcr = zcr;
 
-            // 2. Broadcast to WebSocket (before mutex)
-            webserver_broadcast_audio(pcm_buf, num_samples);
-
-            // 3. Take mutex
-            xSemaphoreTake(s_rec_mutex, portMAX_DELAY);
-
-            // 4. Handle manual start/stop requests
-            if (s_rec_request_start) {
-                s_rec_request_start = false;
-                // Manual stop of any auto-recording first
-                if (s_recording && s_rec_source == REC_SOURCE_AUTO) {
-                    stop_recording();
-                    s_auto_state = AUTO_IDLE;
-                }
-                if (!s_recording) {
-                    start_recording(REC_SOURCE_MANUAL);
-                    space_check_count = 0;
+            // Spectral VAD (~1 FFT per chunk on this core)
+            bool voice = false;
+            if (s_auto_mode && s_vad_mode == TRIGGER_MODE_SPECTRAL) {
+                if (!vad_active) {
+                    // Fresh noise floors whenever the VAD (re)starts
+                    vad_reset(&s_vad);
+                    vad_active = true;
                 }
+                int64_t t0 = esp_timer_get_time();
+                voice = vad_process(&s_vad, pcm_buf, num_samples);
+                uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+                s_vad_us = (s_vad_us * 15 + us) / 16;
+                if (us > s_vad_us_max) s_vad_us_max = us;
+                s_vad_voice = voice;
+            } else {
+                vad_active = false;
             }
 
-            if (s_rec_request_stop && s_recording) {
-                s_rec_request_stop = false;
-                stop_recording();
-                // If was auto-recording, reset auto state
-                s_auto_state = AUTO_IDLE;
-                s_silence_chunks = 0;
+            // 2. Hand the frame to the live stream and feed the dashcam ring
+            stream_levels_t levels = {
+                .rms = (uint16_t)rms,
+                .peak = peak,
+                .zcr = (uint16_t)(zcr * 10000),
+                .flags = (voice ? STREAM_LEVEL_VOICE : 0) | (s_recording ? STREAM_LEVEL_REC : 0),
+            };
+            stream_push(pcm_buf, num_samples, &levels);
+            dashcam_feed(pcm_buf, num_samples);
+
+            // 3-4. Apply queued commands (start/stop, settings)
+            cmd_t cmd;
+            while (cmdq_pop(&cmd)) {
+                esp_err_t res = apply_command(&cmd, &next_space_check);
+                if (cmd.done) cmd.done(cmd.ctx, res);
             }
 
             // 5. Auto-record state machine (if enabled and no manual rec)
             if (s_auto_mode && s_rec_source != REC_SOURCE_MANUAL) {
-                float rms = (float)s_current_rms;
-
-                // Update smoothed RMS (fast EMA)
-                s_rms_smooth += RMS_SMOOTH_ALPHA * (rms - s_rms_smooth);
-                // Update smoothed ZCR
-                s_zcr_smooth += ZCR_SMOOTH_ALPHA * (s_current_zcr - s_zcr_smooth);
-
-                // Trigger threshold = max(user threshold, noise_floor * multiplier)
-                float trig_level = (float)s_auto_threshold;
-                float noise_trig = s_noise_floor * NOISE_MULT;
-                if (noise_trig > trig_level) trig_level = noise_trig;
-
-                // Silence threshold with hysteresis (lower than trigger)
-                float silence_level = trig_level * SILENCE_FRAC;
-
-                // Combined trigger: high energy AND low ZCR (not white noise)
-                bool loud = (s_rms_smooth >= trig_level) && (s_zcr_smooth < 0.40f);
-                bool quiet = (s_rms_smooth < silence_level);
-
-                switch (s_auto_state) {
-                case AUTO_IDLE:
-                    // Update adaptive noise floor (slow EMA, only in IDLE)
-                    s_noise_floor += NOISE_FLOOR_ALPHA * (rms - s_noise_floor);
-
-                    // Feed pre-buffer
-                    pre_buf_write(pcm_buf, num_samples);
+                if (s_trigger.state == TRIGGER_IDLE) {
+                    // Feed pre-trigger ring
+                    pre_ring_apply_size();
+                    pre_ring_feed(pcm_buf, num_samples);
+                }
 
-                    if (loud) {
-                        s_loud_streak++;
+                s_trigger.cfg.threshold = s_auto_threshold;
+                s_trigger.cfg.mode = s_vad_mode;
+                s_trigger.cfg.silence_ms = (uint32_t)s_silence_s * 1000;
+                s_trigger.cfg.min_event_ms = s_min_event_ms;
+                switch (trigger_update(&s_trigger, num_samples, rms, zcr, voice)) {
+                case TRIGGER_EV_START:
+                    ESP_LOGI(TAG, "Auto-trigger: rms=%.0f noise=%.0f trig=%.0f zcr=%.2f",
+                             s_trigger.rms_smooth, s_trigger.noise_floor,
+                             s_trigger.trig_level, s_trigger.zcr_smooth);
+                    if (start_recording(REC_SOURCE_AUTO)) {
+                        pre_ring_flush_to_wav();
+                        next_space_check = esp_timer_get_time() + SPACE_CHECK_INTERVAL_US;
                     } else {
-                        s_loud_streak = 0;
-                    }
-
-                    // Require sustained loud signal to trigger
-                    if (s_loud_streak >= TRIGGER_STREAK) {
-                        ESP_LOGI(TAG, "Auto-trigger: rms=%.0f noise=%.0f trig=%.0f zcr=%.2f",
-                                 s_rms_smooth, s_noise_floor, trig_level, s_zcr_smooth);
-                        if (start_recording(REC_SOURCE_AUTO)) {
-                            pre_buf_flush_to_wav();
-                            s_auto_state = AUTO_RECORDING;
-                            s_silence_chunks = 0;
-                            s_loud_streak = 0;
-                            space_check_count = 0;
-                        }
+                        trigger_set_idle(&s_trigger);
                     }
                     break;
-
-                case AUTO_RECORDING:
-                    if (!quiet) {
-                        s_silence_chunks = 0;
-                    } else {
-                        s_silence_chunks++;
-                    }
-                    if (s_silence_chunks >= SILENCE_TIMEOUT_CHUNKS) {
-                        ESP_LOGI(TAG, "Auto-record: 2 min silence, stopping");
-                        stop_recording();
-                        s_auto_state = AUTO_IDLE;
-                        s_silence_chunks = 0;
-                        s_loud_streak = 0;
-                    }
+                case TRIGGER_EV_STOP:
+                    ESP_LOGI(TAG, "Auto-record: %u s silence, stopping", s_silence_s);
+                    stop_recording();
+                    break;
+                default:
                     break;
                 }
             } else if (!s_auto_mode && s_rec_source == REC_SOURCE_AUTO) {
                 // Auto-mode disabled mid-recording: stop
                 ESP_LOGI(TAG, "Auto-mode disabled, stopping auto-recording");
                 stop_recording();
-                s_auto_state = AUTO_IDLE;
-                s_silence_chunks = 0;
-                s_loud_streak = 0;
-                s_noise_floor = 0;
-                s_rms_smooth = 0;
-                s_zcr_smooth = 0;
+                trigger_reset(&s_trigger);
             }
 
-            // 6. Buffer audio to SD if recording (any source)
-            if (s_recording && s_wav_file) {
-                size_t to_copy = num_samples;
-                if (s_write_buf_pos + to_copy > WRITE_BUF_SAMPLES) {
-                    to_copy = WRITE_BUF_SAMPLES - s_write_buf_pos;
-                }
-                memcpy(&s_write_buf[s_write_buf_pos], pcm_buf, to_copy * sizeof(int16_t));
-                s_write_buf_pos += to_copy;
-
-                if (s_write_buf_pos >= WRITE_BUF_SAMPLES) {
-                    flush_write_buf();
-                }
+            // 6. Hand audio to the SD writer if recording (any source)
+            if (s_recording) {
+                record_samples(pcm_buf, num_samples);
 
-                if (++space_check_count >= 250) {
-                    space_check_count = 0;
+                int64_t now = esp_timer_get_time();
+                if (now >= next_space_check) {
+                    next_space_check = now + SPACE_CHECK_INTERVAL_US;
                     if (sdcard_free_bytes() < 512 * 1024) {
                         ESP_LOGW(TAG, "SD card nearly full, stopping recording");
                         stop_recording();
-                        if (s_auto_state == AUTO_RECORDING) {
-                            s_auto_state = AUTO_IDLE;
-                            s_silence_chunks = 0;
-                        }
+                        trigger_set_idle(&s_trigger);
                     }
                 }
             }
 
-            // 7. Release mutex
-            xSemaphoreGive(s_rec_mutex);
+            // 7. Publish the live state for status readers
+            publish_status();
         }
     }
 }
@@ -571,8 +674,8 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
-    // Recording mutex
-    s_rec_mutex = xSemaphoreCreateMutex();
+    // Commands from the web server to the audio task
+    cmdq_init();
 
     // Connect WiFi (scans, tries saved creds, falls back to AP)
     ESP_LOGI(TAG, "Starting WiFi...");
@@ -590,10 +693,30 @@ void app_main(void)
     ESP_LOGI(TAG, "Mounting SD card...");
     ESP_ERROR_CHECK(sdcard_init());
 
+    // Recording catalogue, checked against the card
+    ESP_ERROR_CHECK(catalog_init());
+
+    // Finalise recordings interrupted by a power loss
+    writer_recover();
+
     // Initialize ADC
     ESP_LOGI(TAG, "Initializing audio...");
     ESP_ERROR_CHECK(audio_init());
 
+    // Background SD writer (block pool in PSRAM)
+    ESP_ERROR_CHECK(writer_init());
+
+    // Continuous-capture ring on the SD card (if enabled)
+    ESP_ERROR_CHECK(dashcam_init());
+
+    // Auto-record detector with the stock tuning
+    trigger_config_t trig_cfg;
+    trigger_default_config(&trig_cfg, AUDIO_SAMPLE_RATE);
+    trigger_init(&s_trigger, &trig_cfg);
+    vad_config_t vad_cfg;
+    vad_default_config(&vad_cfg);
+    vad_init(&s_vad, &vad_cfg, AUDIO_SAMPLE_RATE);
+
     // Load persisted settings from NVS
     load_settings_from_nvs();
 
@@ -601,7 +724,12 @@ void app_main(void)
     ESP_LOGI(TAG, "Starting web server...");
     ESP_ERROR_CHECK(webserver_start(on_ws_command));
 
-    // Generate missing waveform caches in background
+    // Live status pushed to WebSocket clients; publish the settings once
+    // so readers have a snapshot before the first audio frame
+    publish_status();
+    ESP_ERROR_CHECK(status_init());
+
+    // Waveform caches: the missing ones now, finished recordings as they come
     waveform_start_bg_task();
 
     // Launch audio pipeline on core 1
@@ -0,0 +1,75 @@
+#include "pcm_ring.h"
+
+#include <string.h>
+#include "esp_heap_caps.h"
+
+esp_err_t pcm_ring_init(pcm_ring_t *r, size_t capacity, size_t headroom)
+{
+    memset(r, 0, sizeof(*r));
+    if (capacity == 0) return ESP_OK;
+
+    size_t size = 1;
+    while (size < capacity + headroom) size <<= 1;
+
+    r->buf = heap_caps_malloc(size * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (!r->buf) return ESP_ERR_NO_MEM;
+    r->size = size;
+    r->mask = size - 1;
+    r->capacity = capacity;
+    return ESP_OK;
+}
+
+void pcm_ring_free(pcm_ring_t *r)
+{
+    heap_caps_free(r->buf);
+    memset(r, 0, sizeof(*r));
+}
+
+static void copy_in(pcm_ring_t *r, const int16_t *samples, size_t num_samples)
+{
+    size_t idx = r->head & r->mask;
+    size_t first = r->size - idx;
+    if (first > num_samples) first = num_samples;
+    memcpy(&r->buf[idx], samples, first * sizeof(int16_t));
+    memcpy(r->buf, samples + first, (num_samples - first) * sizeof(int16_t));
+    r->head += num_samples;
+}
+
+void pcm_ring_write(pcm_ring_t *r, const int16_t *samples, size_t num_samples)
+{
+    if (!r->buf || num_samples == 0) return;
+
+    // Only the newest `capacity` samples can survive
+    if (num_samples > r->capacity) {
+        r->head += num_samples - r->capacity;
+        samples += num_samples - r->capacity;
+        num_samples = r->capacity;
+    }
+
+    copy_in(r, samples, num_samples);
+    r->count += num_samples;
+    if (r->count > r->capacity) r->count = r->capacity;
+}
+
+bool pcm_ring_append(pcm_ring_t *r, const int16_t *samples, size_t num_samples, size_t held)
+{
+    if (!r->buf || held > r->size || r->count + num_samples > r->size - held) return false;
+
+    copy_in(r, samples, num_samples);
+    r->count += num_samples;
+    return true;
+}
+
+size_t pcm_ring_peek(const pcm_ring_t *r, const int16_t **a, size_t *na,
+                     const int16_t **b, size_t *nb)
+{
+    size_t start = (r->head - r->count) & r->mask;
+    size_t first = r->size - start;
+    if (first > r->count) first = r->count;
+
+    *a = r->buf ? &r->buf[start] : NULL;
+    *na = first;
+    *b = r->buf;
+    *nb = r->count - first;
+    return r->count;
+}
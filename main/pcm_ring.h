@@ -0,0 +1,40 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Ring of int16 samples holding the newest `capacity` samples. Storage is
+// rounded up to a power of two so wrap-around is a mask, and writes are at
+// most two memcpy segments.
+typedef struct {
+    int16_t *buf;
+    size_t size;        // storage in samples (power of two)
+    size_t mask;        // size - 1
+    size_t capacity;    // samples kept by pcm_ring_write (<= size)
+    size_t head;        // total samples written; index = head & mask
+    size_t count;       // valid samples (<= capacity, <= size after appends)
+} pcm_ring_t;
+
+// Allocate storage in PSRAM for `capacity` samples plus `headroom` that only
+// pcm_ring_append uses (capacity 0 = empty ring).
+esp_err_t pcm_ring_init(pcm_ring_t *r, size_t capacity, size_t headroom);
+
+void pcm_ring_free(pcm_ring_t *r);
+
+// Append samples, overwriting the oldest ones once full.
+void pcm_ring_write(pcm_ring_t *r, const int16_t *samples, size_t num_samples);
+
+// Append samples without overwriting any: the `held` samples written just
+// before the current contents (handed out by reference) are kept as well.
+// Returns false, writing nothing, if the storage cannot take them all.
+bool pcm_ring_append(pcm_ring_t *r, const int16_t *samples, size_t num_samples, size_t held);
+
+// Oldest-to-newest contents as up to two contiguous segments (b may be empty).
+// Returns the total number of samples. Memory stays valid until the next write.
+size_t pcm_ring_peek(const pcm_ring_t *r, const int16_t **a, size_t *na,
+                     const int16_t **b, size_t *nb);
+
+// Forget the contents (storage is kept).
+static inline void pcm_ring_clear(pcm_ring_t *r) { r->count = 0; }
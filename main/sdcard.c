@@ -18,7 +18,7 @@ esp_err_t sdcard_init(void)
 {
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
         .format_if_mount_failed = true,
-        .max_files = 5,
+        .max_files = 8,  // writer keeps current + pre-opened + retired parts open
         .allocation_unit_size = 16 * 1024,
     };
 
@@ -0,0 +1,175 @@
+#include "status.h"
+#include "webserver.h"
+#include "stream.h"
+#include "sdcard.h"
+#include "jsonw.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "status";
+
+// Free space is a FAT scan; refresh it far less often than the push rate
+#define SD_REFRESH_US (10 * 1000 * 1000)
+#define PUSH_BUF_SIZE 384
+
+// Seqlock: odd while a publish is in progress. The writer never waits;
+// a reader copies and retries if the sequence moved underneath it.
+static volatile uint32_t s_seq = 0;
+static status_snapshot_t s_snap;
+static volatile uint32_t s_sd_free_kb = 0;
+static volatile uint16_t s_push_ms = STATUS_PUSH_DEFAULT_MS;
+
+void status_publish(const status_snapshot_t *snap)
+{
+    uint32_t seq = s_seq;
+    __atomic_store_n(&s_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    memcpy(&s_snap, snap, sizeof(s_snap));
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&s_seq, seq + 2, __ATOMIC_RELAXED);
+}
+
+void status_read(status_snapshot_t *out)
+{
+    for (int tries = 1;; tries++) {
+        uint32_t before = __atomic_load_n(&s_seq, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!(before & 1)) {
+            memcpy(out, &s_snap, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&s_seq, __ATOMIC_RELAXED) == before) return;
+        }
+        // Only a reader that preempted the audio task mid-publish (same
+        // core, time-sliced) can keep missing; let the writer finish
+        if (tries % 64 == 0) vTaskDelay(1);
+    }
+}
+
+uint32_t status_sd_free_kb(void) { return s_sd_free_kb; }
+
+uint16_t status_push_ms(void) { return s_push_ms; }
+
+void status_set_push_ms(uint16_t ms)
+{
+    if (ms != 0 && ms < STATUS_PUSH_MIN_MS) ms = STATUS_PUSH_MIN_MS;
+    if (ms > STATUS_PUSH_MAX_MS) ms = STATUS_PUSH_MAX_MS;
+    s_push_ms = ms;
+
+    nvs_handle_t h;
+    if (nvs_open("settings", NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_u16(h, "status_ms", ms);
+        nvs_commit(h);
+        nvs_close(h);
+    }
+}
+
+const char *status_source_str(uint8_t src)
+{
+    return src == 2 ? "auto" : src == 1 ? "manual" : "none";
+}
+
+static void refresh_sd_free(void)
+{
+    s_sd_free_kb = (uint32_t)(sdcard_free_bytes() / 1024);
+}
+
+// Push task: every interval, send the fields that changed since the last
+// message as {"type":"status",...} on /ws. A newly joined client makes the
+// next message a full one. The field names match /api/status.
+static void status_task(void *arg)
+{
+    static char buf[PUSH_BUF_SIZE];
+    status_snapshot_t cur, last;
+    bool have_last = false;
+    uint32_t joins_seen = 0;
+    uint32_t lost_seen = 0;
+    int last_sd_tenths = -1;  // free space in 0.1 MB
+    int64_t next_sd = 0;
+
+    while (1) {
+        uint16_t ms = s_push_ms;
+        vTaskDelay(pdMS_TO_TICKS(ms ? ms : 1000));
+
+        int64_t now = esp_timer_get_time();
+        if (now >= next_sd) {
+            refresh_sd_free();
+            next_sd = now + SD_REFRESH_US;
+        }
+
+        if (ms == 0 || !webserver_has_clients()) {
+            have_last = false;
+            continue;
+        }
+
+        uint32_t joins = webserver_ws_joins();
+        // A newcomer, or anyone who missed a delta, needs everything again
+        uint32_t lost = stream_text_lost();
+        bool full = !have_last || joins != joins_seen || lost != lost_seen;
+        joins_seen = joins;
+        lost_seen = lost;
+
+        int sd_tenths = (int)((uint64_t)s_sd_free_kb * 10 / 1024);
+        status_read(&cur);
+
+        jsonw_t w;
+        jsonw_init(&w, buf, sizeof(buf), NULL, NULL);  // whole message in buf
+        jsonw_object_begin(&w);
+        jsonw_field_string(&w, "type", "status");
+        size_t empty = w.len;
+
+#define CHANGED(f) (full || cur.f != last.f)
+        if (CHANGED(recording)) jsonw_field_bool(&w, "recording", cur.recording);
+        if (CHANGED(rec_source)) jsonw_field_string(&w, "rec_source", status_source_str(cur.rec_source));
+        if (full || strcmp(cur.filename, last.filename) != 0)
+            jsonw_field_string(&w, "filename", cur.filename);
+        if (full || strcmp(cur.rec_started_at, last.rec_started_at) != 0)
+            jsonw_field_string(&w, "rec_started_at", cur.rec_started_at);
+        if (CHANGED(rms)) jsonw_field_int(&w, "current_rms", cur.rms);
+        if (full || (int)(cur.zcr * 100 + 0.5f) != (int)(last.zcr * 100 + 0.5f))
+            jsonw_field_fixed(&w, "current_zcr", cur.zcr, 3);
+        if (CHANGED(auto_mode)) jsonw_field_bool(&w, "auto_mode", cur.auto_mode);
+        if (CHANGED(vad_voice)) jsonw_field_bool(&w, "vad_voice", cur.vad_voice);
+        if (CHANGED(vad_us)) jsonw_field_int(&w, "vad_us", cur.vad_us);
+        if (CHANGED(vad_us_max)) jsonw_field_int(&w, "vad_us_max", cur.vad_us_max);
+        if (CHANGED(adc_overflows)) jsonw_field_int(&w, "adc_overflows", cur.adc_overflows);
+        if (full || sd_tenths != last_sd_tenths)
+            jsonw_field_fixed(&w, "sd_free_mb", sd_tenths / 10.0, 1);
+#undef CHANGED
+
+        if (w.len == empty) continue;  // nothing changed
+        jsonw_object_end(&w);
+        if (jsonw_finish(&w) != 0) {
+            ESP_LOGW(TAG, "Status message does not fit in %d bytes", PUSH_BUF_SIZE);
+            continue;
+        }
+
+        if (!webserver_broadcast_text(buf, w.len)) continue;  // lost: next one is full
+        last = cur;
+        last_sd_tenths = sd_tenths;
+        have_last = true;
+    }
+}
+
+esp_err_t status_init(void)
+{
+    refresh_sd_free();
+
+    nvs_handle_t h;
+    if (nvs_open("settings", NVS_READONLY, &h) == ESP_OK) {
+        uint16_t ms;
+        if (nvs_get_u16(h, "status_ms", &ms) == ESP_OK && ms <= STATUS_PUSH_MAX_MS) s_push_ms = ms;
+        nvs_close(h);
+    }
+
+    if (xTaskCreatePinnedToCore(status_task, "status", 3072, NULL, 2, NULL, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start status task");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Status push every %u ms", s_push_ms);
+    return ESP_OK;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STATUS_PUSH_DEFAULT_MS 500
+#define STATUS_PUSH_MIN_MS     100
+#define STATUS_PUSH_MAX_MS     10000
+
+// Recorder state as one consistent picture. The audio task fills one of
+// these at the end of every frame and publishes it through a seqlock;
+// readers on any task get a copy that never mixes two frames (or two
+// recordings) and never blocks the audio task.
+typedef struct {
+    bool     recording;
+    uint8_t  rec_source;        // 0 none, 1 manual, 2 auto
+    char     filename[48];
+    char     rec_started_at[20];
+    uint16_t rms;
+    float    zcr;
+    bool     vad_voice;
+    uint32_t vad_us;
+    uint32_t vad_us_max;
+    uint32_t adc_overflows;
+
+    // Settings as the audio task is applying them
+    bool     auto_mode;
+    uint16_t auto_threshold;
+    uint8_t  preroll_s;
+    uint16_t silence_s;
+    uint16_t min_event_ms;
+    bool     container;
+    bool     ulaw;
+    bool     vad_spectral;
+    uint16_t filter_hp;
+    uint16_t filter_lp;
+} status_snapshot_t;
+
+// Load the push interval from NVS and start the push task (core 0).
+esp_err_t status_init(void);
+
+// Audio task (the only writer): replace the published snapshot.
+void status_publish(const status_snapshot_t *snap);
+
+// Copy of the last published snapshot. Lock-free; retries if it overlaps
+// a publish.
+void status_read(status_snapshot_t *out);
+
+const char *status_source_str(uint8_t rec_source);
+
+// SD free space in KB, refreshed in the background every few seconds.
+uint32_t status_sd_free_kb(void);
+
+// Interval between WebSocket status messages (persisted); 0 turns pushing off.
+void status_set_push_ms(uint16_t ms);
+uint16_t status_push_ms(void);
@@ -0,0 +1,617 @@
+#include "stream.h"
+#include "audio.h"
+#include "codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+static const char *TAG = "stream";
+
+#define MAX_SEND_FAILS 3   // consecutive failed sends before a client is dropped
+
+// Batch sizing. A client's batch is big enough that sending takes at most
+// 1/SEND_SHARE of the audio time it carries, doubles when its socket pushes
+// back, and shrinks one frame after SHRINK_AFTER easy messages in a row.
+#define SEND_SHARE   10
+#define SHRINK_AFTER 50
+#define BATCH_BUF_SIZE (STREAM_HDR_SIZE + STREAM_MAX_BATCH * STREAM_FRAME_SAMPLES * sizeof(int16_t))
+
+typedef struct {
+    uint16_t refs;          // client queues holding this buffer (network task)
+    uint16_t len;           // payload bytes after the header
+    uint16_t samples;       // ADC samples covered, for lag accounting
+    uint16_t seq;           // ADC frame number
+    stream_levels_t levels; // ADC frames only
+    uint8_t data[STREAM_HDR_SIZE + STREAM_FRAME_SAMPLES * sizeof(int16_t)];
+} stream_buf_t;
+
+static const struct {
+    const char *codec;
+    uint16_t rate;
+    uint8_t id;
+} s_formats[STREAM_FMT_COUNT] = {
+    [STREAM_FMT_PCM16]    = { "pcm16", AUDIO_SAMPLE_RATE, STREAM_CODEC_PCM16 },
+    [STREAM_FMT_ULAW]     = { "ulaw",  AUDIO_SAMPLE_RATE, STREAM_CODEC_ULAW },
+    [STREAM_FMT_ADPCM]    = { "adpcm", AUDIO_SAMPLE_RATE, STREAM_CODEC_ADPCM },
+    [STREAM_FMT_PCM16_8K] = { "pcm16", 8000, STREAM_CODEC_PCM16 },
+    [STREAM_FMT_ULAW_8K]  = { "ulaw",  8000, STREAM_CODEC_ULAW },
+    [STREAM_FMT_ADPCM_8K] = { "adpcm", 8000, STREAM_CODEC_ADPCM },
+    [STREAM_FMT_LEVELS]   = { "levels", AUDIO_SAMPLE_RATE, STREAM_CODEC_LEVELS },
+};
+
+typedef enum {
+    SMSG_FRAME = 0,
+    SMSG_ADD,
+    SMSG_REMOVE,
+    SMSG_FORMAT,
+    SMSG_TEXT,
+} smsg_type_t;
+
+typedef struct {
+    smsg_type_t type;
+    int fd;                 // ADD/REMOVE/FORMAT/TEXT (-1: every client)
+    stream_fmt_t fmt;       // FORMAT
+    cmd_done_fn done;       // FORMAT, optional
+    void *ctx;
+    stream_buf_t *buf;      // FRAME
+    char *text;             // TEXT: heap copy, freed by the network task
+    uint16_t len;           // TEXT
+} smsg_t;
+
+typedef struct {
+    stream_client_stats_t st;
+    stream_buf_t *q[STREAM_CLIENT_QUEUE];
+    uint8_t head;
+    uint8_t count;
+    uint32_t queued_samples;
+    uint8_t fails;
+    bool blocked;           // socket was full with a batch ready
+    uint8_t easy;           // messages in a row that would fit a smaller batch
+} client_t;
+
+static httpd_handle_t s_server = NULL;
+static QueueHandle_t s_msg_queue = NULL;   // audio/httpd tasks -> network task
+static QueueHandle_t s_free_queue = NULL;  // network task -> audio task (empty buffers)
+
+// Owned by the network task; stream_stats() reads the word-sized counters
+// without a lock
+static client_t s_clients[STREAM_MAX_CLIENTS];
+static volatile int s_active = 0;
+
+static volatile uint32_t s_frames_in = 0;
+static volatile uint32_t s_dropped_in = 0;
+static volatile uint32_t s_text_lost = 0;
+static volatile uint16_t s_budget_ms = STREAM_BATCH_DEFAULT_MS;
+static uint8_t *s_batch_buf = NULL;  // network task: a message being assembled
+
+// Encoder state, network task only. ADPCM blocks carry their own start
+// state, so those never need a reset; the resampler restarts whenever the
+// first 8 kHz client arrives.
+static codec_adpcm_t s_adpcm[2];    // 20 kHz, 8 kHz
+static codec_decim_t s_decim;
+static bool s_decim_live = false;
+
+static uint32_t samples_to_ms(uint32_t samples)
+{
+    return (uint32_t)((uint64_t)samples * 1000 / AUDIO_SAMPLE_RATE);
+}
+
+static void buf_release(stream_buf_t *b)
+{
+    if (--b->refs == 0) xQueueSend(s_free_queue, &b, 0);
+}
+
+static stream_buf_t *client_pop(client_t *c)
+{
+    stream_buf_t *b = c->q[c->head];
+    c->head = (c->head + 1) % STREAM_CLIENT_QUEUE;
+    c->count--;
+    c->queued_samples -= b->samples;
+    return b;
+}
+
+static void client_update_lag(client_t *c)
+{
+    c->st.queued = c->count;
+    c->st.lag_ms = samples_to_ms(c->queued_samples);
+    if (c->st.lag_ms > c->st.max_lag_ms) c->st.max_lag_ms = c->st.lag_ms;
+}
+
+static void client_drop(client_t *c)
+{
+    while (c->count) buf_release(client_pop(c));
+    memset(c, 0, sizeof(*c));
+    c->st.fd = -1;
+    s_active--;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void write_header(stream_buf_t *b, stream_fmt_t fmt, size_t samples)
+{
+    put_u16(b->data, b->seq);
+    put_u16(b->data + 2, s_formats[fmt].rate);
+    b->data[4] = s_formats[fmt].id;
+    b->data[5] = 1;
+    put_u16(b->data + 6, (uint16_t)samples);
+}
+
+// Encode n samples for fmt into a fresh pool buffer; NULL if the pool is empty
+static stream_buf_t *encode(stream_fmt_t fmt, const stream_buf_t *src,
+                            const int16_t *pcm, size_t n)
+{
+    stream_buf_t *b;
+    if (xQueueReceive(s_free_queue, &b, 0) != pdTRUE) return NULL;
+    b->refs = 1;
+    b->samples = src->samples;
+    b->seq = src->seq;
+
+    uint8_t *out = b->data + STREAM_HDR_SIZE;
+    switch (s_formats[fmt].id) {
+    case STREAM_CODEC_ULAW:
+        codec_ulaw_encode(pcm, n, out);
+        b->len = n;
+        break;
+    case STREAM_CODEC_ADPCM:
+        n &= ~(size_t)1;  // two samples per byte
+        b->len = codec_adpcm_encode(&s_adpcm[s_formats[fmt].rate != AUDIO_SAMPLE_RATE],
+                                    pcm, n, out);
+        break;
+    case STREAM_CODEC_LEVELS:
+        put_u16(out, src->levels.rms);
+        put_u16(out + 2, src->levels.peak);
+        put_u16(out + 4, src->levels.zcr);
+        out[6] = src->levels.flags;
+        out[7] = 0;
+        b->len = 8;
+        break;
+    default:
+        memcpy(out, pcm, n * sizeof(int16_t));
+        b->len = n * sizeof(int16_t);
+        break;
+    }
+    write_header(b, fmt, n);
+    return b;
+}
+
+// Produce one buffer per format some client wants. The PCM16 buffer is the
+// input frame itself; everything else is encoded from it exactly once.
+static void encode_formats(stream_buf_t *in, const bool used[STREAM_FMT_COUNT],
+                           stream_buf_t *out[STREAM_FMT_COUNT])
+{
+    const int16_t *pcm = (const int16_t *)(in->data + STREAM_HDR_SIZE);
+    size_t n = in->len / sizeof(int16_t);
+
+    in->refs = 1;  // held while distributing
+    write_header(in, STREAM_FMT_PCM16, n);
+    out[STREAM_FMT_PCM16] = in;
+    if (used[STREAM_FMT_ULAW]) out[STREAM_FMT_ULAW] = encode(STREAM_FMT_ULAW, in, pcm, n);
+    if (used[STREAM_FMT_ADPCM]) out[STREAM_FMT_ADPCM] = encode(STREAM_FMT_ADPCM, in, pcm, n);
+    if (used[STREAM_FMT_LEVELS]) out[STREAM_FMT_LEVELS] = encode(STREAM_FMT_LEVELS, in, pcm, n);
+
+    bool want_8k = used[STREAM_FMT_PCM16_8K] || used[STREAM_FMT_ULAW_8K] || used[STREAM_FMT_ADPCM_8K];
+    if (!want_8k) {
+        s_decim_live = false;
+        return;
+    }
+    if (!s_decim_live) {
+        codec_decim_reset(&s_decim);
+        s_decim_live = true;
+    }
+    int16_t low[STREAM_FRAME_SAMPLES * 2 / 5 + 1];
+    size_t m = codec_decim_8k(&s_decim, pcm, n, low);
+    for (int f = STREAM_FMT_PCM16_8K; f <= STREAM_FMT_ADPCM_8K; f++) {
+        if (used[f]) out[f] = encode(f, in, low, m);
+    }
+}
+
+// Share each encoding of a frame between the client queues that asked for
+// it, dropping a client's oldest frame if its queue is full
+static void distribute(stream_buf_t *in)
+{
+    bool used[STREAM_FMT_COUNT] = { false };
+    stream_buf_t *out[STREAM_FMT_COUNT] = { NULL };
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (s_clients[i].st.fd >= 0) used[s_clients[i].st.format] = true;
+    }
+    encode_formats(in, used, out);
+
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        client_t *c = &s_clients[i];
+        if (c->st.fd < 0) continue;
+        stream_buf_t *b = out[c->st.format];
+        if (!b) {
+            c->st.dropped++;  // pool ran dry while encoding
+            continue;
+        }
+        if (c->count == STREAM_CLIENT_QUEUE) {
+            buf_release(client_pop(c));
+            c->st.dropped++;
+        }
+        c->q[(c->head + c->count) % STREAM_CLIENT_QUEUE] = b;
+        c->count++;
+        c->queued_samples += b->samples;
+        b->refs++;
+        client_update_lag(c);
+    }
+    for (int f = 0; f < STREAM_FMT_COUNT; f++) {
+        if (out[f]) buf_release(out[f]);
+    }
+}
+
+static int max_batch(void)
+{
+    return s_budget_ms / STREAM_FRAME_MS;
+}
+
+// A full batch is waiting (or more than the budget allows after it shrank)
+static bool batch_ready(const client_t *c)
+{
+    return c->count > 0 && c->count >= c->st.batch;
+}
+
+static void adapt_batch(client_t *c, uint32_t send_us)
+{
+    c->st.send_us = c->st.send_us ? (c->st.send_us * 7 + send_us) / 8 : send_us;
+    if (c->st.format == STREAM_FMT_LEVELS) {
+        // Meters: messages are tiny, so only their count matters
+        c->st.batch = (uint8_t)max_batch();
+        return;
+    }
+    int need = (int)((c->st.send_us * SEND_SHARE + STREAM_FRAME_MS * 1000 - 1) / (STREAM_FRAME_MS * 1000));
+    int batch = c->st.batch;
+
+    if (c->blocked) {
+        batch *= 2;
+        c->easy = 0;
+    } else if (need < batch && ++c->easy >= SHRINK_AFTER) {
+        batch--;
+        c->easy = 0;
+    }
+    c->blocked = false;
+
+    if (batch < need) batch = need;
+    if (batch > max_batch()) batch = max_batch();
+    if (batch < 1) batch = 1;
+    c->st.batch = (uint8_t)batch;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// Gather up to one batch of consecutive, equal-sized frames from the head
+// of the queue. A single frame is sent from its pool buffer as is; more are
+// copied behind one header into s_batch_buf. Returns the frame count.
+static int build_message(const client_t *c, httpd_ws_frame_t *pkt)
+{
+    const stream_buf_t *first = c->q[c->head];
+    size_t skip = c->st.framed ? 0 : STREAM_HDR_SIZE;  // legacy clients get bare PCM16
+    uint16_t samples = get_u16(first->data + 6);
+
+    int n = 1;
+    while (n < c->st.batch && n < c->count) {
+        const stream_buf_t *b = c->q[(c->head + n) % STREAM_CLIENT_QUEUE];
+        if (b->seq != (uint16_t)(first->seq + n) || get_u16(b->data + 6) != samples) break;
+        n++;
+    }
+
+    pkt->final = true;
+    pkt->fragmented = false;
+    pkt->type = HTTPD_WS_TYPE_BINARY;
+    if (n == 1) {
+        pkt->payload = (uint8_t *)first->data + skip;
+        pkt->len = STREAM_HDR_SIZE + first->len - skip;
+        return 1;
+    }
+
+    size_t len = STREAM_HDR_SIZE;
+    memcpy(s_batch_buf, first->data, STREAM_HDR_SIZE);
+    for (int i = 0; i < n; i++) {
+        const stream_buf_t *b = c->q[(c->head + i) % STREAM_CLIENT_QUEUE];
+        memcpy(s_batch_buf + len, b->data + STREAM_HDR_SIZE, b->len);
+        len += b->len;
+    }
+    s_batch_buf[5] = (uint8_t)n;
+    put_u16(s_batch_buf + 6, (uint16_t)(samples * n));
+    pkt->payload = s_batch_buf + skip;
+    pkt->len = len - skip;
+    return n;
+}
+
+static bool fd_writable(int fd)
+{
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    struct timeval tv = { 0, 0 };
+    return select(fd + 1, NULL, &wfds, NULL, &tv) > 0;
+}
+
+// Send each client's ready batches while its socket will take them without
+// blocking. A client whose send buffer is full is skipped and catches up
+// (or drops) later, with a bigger batch.
+static void send_pending(void)
+{
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        client_t *c = &s_clients[i];
+        while (c->st.fd >= 0 && batch_ready(c)) {
+            if (!fd_writable(c->st.fd)) {
+                c->blocked = true;
+                break;
+            }
+            httpd_ws_frame_t pkt = { 0 };
+            int n = build_message(c, &pkt);
+            int64_t t0 = esp_timer_get_time();
+            if (httpd_ws_send_frame_async(s_server, c->st.fd, &pkt) == ESP_OK) {
+                c->st.sent++;
+                c->st.frames_sent += n;
+                c->st.bytes += pkt.len;
+                c->fails = 0;
+                adapt_batch(c, (uint32_t)(esp_timer_get_time() - t0));
+            } else {
+                c->st.errors++;
+                if (++c->fails >= MAX_SEND_FAILS) {
+                    // Close the session too: its close callback frees the
+                    // WebSocket slot, and the fd cannot be reused before that
+                    ESP_LOGW(TAG, "fd=%d: %d sends failed, dropping client", c->st.fd, c->fails);
+                    httpd_sess_trigger_close(s_server, c->st.fd);
+                    client_drop(c);
+                    break;
+                }
+            }
+            while (n--) buf_release(client_pop(c));
+            client_update_lag(c);
+        }
+    }
+}
+
+// Text goes out between two audio messages, so never inside one; a socket
+// that would block does not get it
+static void send_text(int fd, httpd_ws_frame_t *pkt, client_t *c)
+{
+    if (fd_writable(fd) && httpd_ws_send_frame_async(s_server, fd, pkt) == ESP_OK) return;
+    s_text_lost++;
+    if (c) c->st.errors++;
+}
+
+static void handle_msg(const smsg_t *m)
+{
+    switch (m->type) {
+    case SMSG_FRAME:
+        distribute(m->buf);
+        break;
+    case SMSG_ADD:
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            if (s_clients[i].st.fd < 0) {
+                memset(&s_clients[i], 0, sizeof(client_t));
+                s_clients[i].st.fd = m->fd;
+                s_clients[i].st.batch = 1;
+                s_active++;
+                return;
+            }
+        }
+        ESP_LOGW(TAG, "fd=%d: no free stream slot", m->fd);
+        break;
+    case SMSG_REMOVE:
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            if (s_clients[i].st.fd == m->fd) client_drop(&s_clients[i]);
+        }
+        break;
+    case SMSG_FORMAT: {
+        esp_err_t err = ESP_ERR_NOT_FOUND;
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            client_t *c = &s_clients[i];
+            if (c->st.fd != m->fd) continue;
+            // Frames already queued were encoded for the old format
+            while (c->count) buf_release(client_pop(c));
+            client_update_lag(c);
+            c->st.format = m->fmt;
+            c->st.framed = true;
+            c->st.batch = m->fmt == STREAM_FMT_LEVELS ? max_batch() : 1;
+            err = ESP_OK;
+            ESP_LOGI(TAG, "fd=%d: %s at %d Hz", m->fd, s_formats[m->fmt].codec, s_formats[m->fmt].rate);
+        }
+        if (m->done) m->done(m->ctx, err);
+        break;
+    }
+    case SMSG_TEXT: {
+        httpd_ws_frame_t pkt = {
+            .final = true,
+            .type = HTTPD_WS_TYPE_TEXT,
+            .payload = (uint8_t *)m->text,
+            .len = m->len,
+        };
+        bool found = false;
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            client_t *c = &s_clients[i];
+            if (c->st.fd < 0 || (m->fd >= 0 && c->st.fd != m->fd)) continue;
+            send_text(c->st.fd, &pkt, c);
+            found = true;
+        }
+        // A connection without a stream slot still gets its acks
+        if (m->fd >= 0 && !found) send_text(m->fd, &pkt, NULL);
+        free(m->text);
+        break;
+    }
+    }
+}
+
+static bool any_pending(void)
+{
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (s_clients[i].st.fd >= 0 && batch_ready(&s_clients[i])) return true;
+    }
+    return false;
+}
+
+static void stream_task(void *arg)
+{
+    smsg_t m;
+    while (1) {
+        // Poll while a batch is ready for a socket that was not writable
+        TickType_t wait = any_pending() ? pdMS_TO_TICKS(5) : portMAX_DELAY;
+        if (xQueueReceive(s_msg_queue, &m, wait) == pdTRUE) {
+            do {
+                handle_msg(&m);
+            } while (xQueueReceive(s_msg_queue, &m, 0) == pdTRUE);
+        }
+        send_pending();
+    }
+}
+
+esp_err_t stream_init(httpd_handle_t server)
+{
+    s_server = server;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) s_clients[i].st.fd = -1;
+
+    nvs_handle_t h;
+    if (nvs_open("settings", NVS_READONLY, &h) == ESP_OK) {
+        uint16_t ms;
+        if (nvs_get_u16(h, "stream_ms", &ms) == ESP_OK &&
+            ms >= STREAM_BATCH_MIN_MS && ms <= STREAM_BATCH_MAX_MS) s_budget_ms = ms;
+        nvs_close(h);
+    }
+
+    s_msg_queue = xQueueCreate(STREAM_POOL_BUFS + 8, sizeof(smsg_t));
+    s_free_queue = xQueueCreate(STREAM_POOL_BUFS, sizeof(stream_buf_t *));
+    if (!s_msg_queue || !s_free_queue) return ESP_ERR_NO_MEM;
+
+    s_batch_buf = heap_caps_malloc(BATCH_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (!s_batch_buf) {
+        ESP_LOGE(TAG, "Failed to allocate batch buffer in PSRAM");
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < STREAM_POOL_BUFS; i++) {
+        stream_buf_t *b = heap_caps_malloc(sizeof(stream_buf_t), MALLOC_CAP_SPIRAM);
+        if (!b) {
+            ESP_LOGE(TAG, "Failed to allocate stream buffers in PSRAM");
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(s_free_queue, &b, 0);
+    }
+
+    xTaskCreatePinnedToCore(stream_task, "stream", 4096, NULL, 4, NULL, 0);
+    ESP_LOGI(TAG, "Latency budget %u ms", s_budget_ms);
+    return ESP_OK;
+}
+
+void stream_push(const int16_t *samples, size_t num_samples, const stream_levels_t *levels)
+{
+    if (!s_msg_queue || s_active == 0 || num_samples == 0) return;
+    if (num_samples > STREAM_FRAME_SAMPLES) num_samples = STREAM_FRAME_SAMPLES;
+
+    uint32_t seq = s_frames_in++;
+    stream_buf_t *b;
+    if (xQueueReceive(s_free_queue, &b, 0) != pdTRUE) {
+        s_dropped_in++;
+        return;
+    }
+    memcpy(b->data + STREAM_HDR_SIZE, samples, num_samples * sizeof(int16_t));
+    b->len = num_samples * sizeof(int16_t);
+    b->samples = num_samples;
+    b->seq = (uint16_t)seq;
+    b->levels = *levels;
+
+    smsg_t m = { .type = SMSG_FRAME, .buf = b };
+    if (xQueueSend(s_msg_queue, &m, 0) != pdTRUE) {
+        xQueueSend(s_free_queue, &b, 0);
+        s_dropped_in++;
+    }
+}
+
+void stream_client_add(int fd)
+{
+    if (!s_msg_queue) return;
+    smsg_t m = { .type = SMSG_ADD, .fd = fd };
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+}
+
+void stream_client_remove(int fd)
+{
+    if (!s_msg_queue) return;
+    smsg_t m = { .type = SMSG_REMOVE, .fd = fd };
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+}
+
+bool stream_send_text(int fd, const char *text, size_t len)
+{
+    if (!s_msg_queue || len == 0 || len > UINT16_MAX) return false;
+    smsg_t m = { .type = SMSG_TEXT, .fd = fd, .text = malloc(len), .len = (uint16_t)len };
+    if (m.text) {
+        memcpy(m.text, text, len);
+        if (xQueueSend(s_msg_queue, &m, 0) == pdTRUE) return true;
+        free(m.text);
+    }
+    s_text_lost++;
+    return false;
+}
+
+uint32_t stream_text_lost(void)
+{
+    return s_text_lost;
+}
+
+int stream_format_find(const char *codec, int rate)
+{
+    for (int f = 0; f < STREAM_FMT_COUNT; f++) {
+        if (strcmp(s_formats[f].codec, codec) != 0) continue;
+        if (f == STREAM_FMT_LEVELS || s_formats[f].rate == rate) return f;
+    }
+    return -1;
+}
+
+const char *stream_format_codec(stream_fmt_t fmt) { return s_formats[fmt].codec; }
+
+int stream_format_rate(stream_fmt_t fmt) { return s_formats[fmt].rate; }
+
+void stream_client_set_format(int fd, stream_fmt_t fmt, cmd_done_fn done, void *ctx)
+{
+    if (!s_msg_queue || fmt >= STREAM_FMT_COUNT) {
+        if (done) done(ctx, ESP_ERR_INVALID_STATE);
+        return;
+    }
+    smsg_t m = { .type = SMSG_FORMAT, .fd = fd, .fmt = fmt, .done = done, .ctx = ctx };
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+}
+
+uint16_t stream_budget_ms(void) { return s_budget_ms; }
+
+void stream_set_budget_ms(uint16_t ms)
+{
+    if (ms < STREAM_BATCH_MIN_MS) ms = STREAM_BATCH_MIN_MS;
+    if (ms > STREAM_BATCH_MAX_MS) ms = STREAM_BATCH_MAX_MS;
+    s_budget_ms = ms;  // batches above it shrink on their next send
+
+    nvs_handle_t h;
+    if (nvs_open("settings", NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_u16(h, "stream_ms", ms);
+        nvs_commit(h);
+        nvs_close(h);
+    }
+}
+
+int stream_stats(stream_client_stats_t out[STREAM_MAX_CLIENTS],
+                 uint32_t *frames_in, uint32_t *dropped_in)
+{
+    int n = 0;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (s_clients[i].st.fd >= 0) out[n++] = s_clients[i].st;
+    }
+    *frames_in = s_frames_in;
+    *dropped_in = s_dropped_in;
+    return n;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "cmdq.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Live audio fan-out to WebSocket clients. The audio task hands each frame
+// to stream_push(), which only copies it into a pooled buffer and queues
+// it. A network task on core 0 shares that buffer (refcounted) between
+// per-client queues and sends from them. A slow client only loses its own
+// oldest frames; the capture loop never touches a socket.
+//
+// A client that sends {"cmd":"stream",...} gets framed messages in the
+// format it picked instead of raw PCM: full-rate audio, an 8 kHz preview,
+// or levels only (a few bytes per frame, for meters). Each frame is encoded
+// once per format in use, however many clients share it.
+//
+// Frames for a client are coalesced into one message of up to the latency
+// budget. The batch grows when sends to that client get slow or its socket
+// pushes back, and shrinks again once it keeps up.
+
+#define STREAM_MAX_CLIENTS   4
+#define STREAM_FRAME_SAMPLES 400   // one ADC read
+#define STREAM_FRAME_MS      20    // ... at 20 kHz
+#define STREAM_POOL_BUFS     96    // ADC frames plus one encoding per format in use
+#define STREAM_CLIENT_QUEUE  16    // frames per client (~320 ms at 20 ms/frame)
+
+// Latency budget: the most audio one message may hold (persisted)
+#define STREAM_BATCH_DEFAULT_MS 100
+#define STREAM_BATCH_MIN_MS     STREAM_FRAME_MS
+#define STREAM_BATCH_MAX_MS     200
+#define STREAM_MAX_BATCH        (STREAM_BATCH_MAX_MS / STREAM_FRAME_MS)
+
+// Header in front of every framed message (little-endian):
+//   u16 seq      number of the first ADC frame (wraps; a gap means loss)
+//   u16 rate     sample rate in Hz
+//   u8  codec    STREAM_CODEC_*
+//   u8  frames   ADC frames in the message
+//   u16 samples  samples in the message
+// IMA ADPCM payloads hold one block (see codec.h) per ADC frame. Levels
+// payloads hold one stream_levels_t per frame: rms, peak, zcr (u16 each),
+// flags, 0.
+#define STREAM_HDR_SIZE 8
+
+#define STREAM_CODEC_PCM16 0
+#define STREAM_CODEC_ULAW  1
+#define STREAM_CODEC_ADPCM 2
+#define STREAM_CODEC_LEVELS 3
+
+typedef enum {
+    STREAM_FMT_PCM16 = 0,
+    STREAM_FMT_ULAW,
+    STREAM_FMT_ADPCM,
+    STREAM_FMT_PCM16_8K,
+    STREAM_FMT_ULAW_8K,
+    STREAM_FMT_ADPCM_8K,
+    STREAM_FMT_LEVELS,
+    STREAM_FMT_COUNT
+} stream_fmt_t;
+
+#define STREAM_LEVEL_VOICE 0x01  // VAD says voice
+#define STREAM_LEVEL_REC   0x02  // recording
+
+// Per-frame meter values the audio task has already computed
+typedef struct {
+    uint16_t rms;
+    uint16_t peak;
+    uint16_t zcr;           // crossings per 10000 sample pairs
+    uint8_t flags;          // STREAM_LEVEL_*
+} stream_levels_t;
+
+typedef struct {
+    int fd;                 // -1: slot unused
+    uint32_t queued;        // frames waiting now
+    uint32_t lag_ms;        // audio time waiting now
+    uint32_t max_lag_ms;
+    uint32_t sent;          // messages
+    uint32_t frames_sent;
+    uint32_t dropped;       // oldest frames discarded because the queue was full
+    uint32_t errors;        // failed sends
+    uint32_t bytes;         // payload bytes sent
+    uint8_t batch;          // frames per message now
+    uint32_t send_us;       // average time in one send
+    uint8_t format;         // stream_fmt_t
+    bool framed;            // false: legacy raw PCM16 without a header
+} stream_client_stats_t;
+
+// Allocate the buffer pool, load the latency budget and start the network
+// task. server is used for the sends.
+esp_err_t stream_init(httpd_handle_t server);
+
+// Audio task. Never blocks; if the network task is behind, the frame is
+// dropped and counted.
+void stream_push(const int16_t *samples, size_t num_samples, const stream_levels_t *levels);
+
+// WebSocket clients joining/leaving (httpd task). A client whose sends keep
+// failing is dropped here and its session closed, so the server's close
+// callback removes it everywhere else.
+void stream_client_add(int fd);
+void stream_client_remove(int fd);
+
+// Send a text message (status push, command ack) to client fd, or to every
+// client with fd -1. It goes out from the network task, the only task that
+// writes to WebSocket sockets, so it can never land inside another frame.
+// Copies text and never blocks; false if it could not be queued.
+bool stream_send_text(int fd, const char *text, size_t len);
+
+// Text messages not delivered so far (queue or socket full, send failed)
+uint32_t stream_text_lost(void);
+
+// Format for codec "pcm16", "ulaw" or "adpcm" at 20000 or 8000 Hz, or
+// "levels"; -1 if there is none.
+int stream_format_find(const char *codec, int rate);
+const char *stream_format_codec(stream_fmt_t fmt);
+int stream_format_rate(stream_fmt_t fmt);
+
+// Switch a client to framed messages in fmt (httpd task). done runs on the
+// network task once the switch is made, so anything sent after it (an ack,
+// say) reaches the client behind the last raw frame.
+void stream_client_set_format(int fd, stream_fmt_t fmt, cmd_done_fn done, void *ctx);
+
+// Latency budget in ms, clamped to STREAM_BATCH_MIN_MS..STREAM_BATCH_MAX_MS.
+void stream_set_budget_ms(uint16_t ms);
+uint16_t stream_budget_ms(void);
+
+// Counters for /api/stream. Returns the number of client slots filled.
+int stream_stats(stream_client_stats_t out[STREAM_MAX_CLIENTS],
+                 uint32_t *frames_in, uint32_t *dropped_in);
@@ -0,0 +1,140 @@
+#include "trigger.h"
+
+#include <math.h>
+#include <string.h>
+
+void trigger_default_config(trigger_config_t *cfg, uint32_t sample_rate)
+{
+    cfg->mode = TRIGGER_MODE_RMS;
+    cfg->sample_rate = sample_rate;
+    cfg->threshold = 2000;
+    cfg->rms_tau_s = 0.056f;      // alpha 0.3 per 20 ms chunk
+    cfg->noise_tau_s = 4.0f;      // alpha 0.005 per 20 ms chunk
+    cfg->noise_mult = 3.0f;
+    cfg->zcr_max = 0.40f;
+    cfg->voice_on = 0.5f;
+    cfg->voice_off = 0.2f;
+    cfg->silence_frac = 0.7f;
+    cfg->min_event_ms = 100;
+    cfg->silence_ms = 120000;
+}
+
+void trigger_init(trigger_t *t, const trigger_config_t *cfg)
+{
+    memset(t, 0, sizeof(*t));
+    t->cfg = *cfg;
+}
+
+void trigger_reset(trigger_t *t)
+{
+    t->state = TRIGGER_IDLE;
+    t->rms_smooth = 0;
+    t->noise_floor = 0;
+    t->zcr_smooth = 0;
+    t->voice_smooth = 0;
+    t->loud_samples = 0;
+    t->silence_samples = 0;
+}
+
+void trigger_set_idle(trigger_t *t)
+{
+    t->state = TRIGGER_IDLE;
+    t->loud_samples = 0;
+    t->silence_samples = 0;
+}
+
+// EMA coefficient for a chunk of n samples with time constant tau
+static float chunk_alpha(size_t n, float tau_s, uint32_t rate)
+{
+    if (tau_s <= 0) return 1.0f;
+    return 1.0f - expf(-(float)n / (tau_s * (float)rate));
+}
+
+static uint32_t ms_to_samples(uint32_t ms, uint32_t rate)
+{
+    return (uint32_t)((uint64_t)ms * rate / 1000);
+}
+
+void trigger_frame_stats(const int16_t *pcm, size_t n, float *rms, float *zcr, uint16_t *peak)
+{
+    float sum_sq = 0;
+    int zc = 0;
+    int max = 0;
+    for (size_t i = 0; i < n; i++) {
+        float s = (float)pcm[i];
+        sum_sq += s * s;
+        if (i > 0 && ((pcm[i] > 0) != (pcm[i-1] > 0))) zc++;
+        int mag = pcm[i] < 0 ? -pcm[i] : pcm[i];
+        if (mag > max) max = mag;
+    }
+    *rms = (n > 0) ? sqrtf(sum_sq / n) : 0;
+    *zcr = (n > 1) ? (float)zc / (n - 1) : 0;
+    if (peak) *peak = (uint16_t)max;
+}
+
+trigger_event_t trigger_update(trigger_t *t, size_t n, float rms, float zcr, bool voice)
+{
+    const trigger_config_t *c = &t->cfg;
+
+    // Chunk sizes rarely change, so only recompute the alphas when they do
+    if (n != t->alpha_n) {
+        t->alpha_n = n;
+        t->rms_alpha = chunk_alpha(n, c->rms_tau_s, c->sample_rate);
+        t->noise_alpha = chunk_alpha(n, c->noise_tau_s, c->sample_rate);
+    }
+
+    t->rms_smooth += t->rms_alpha * (rms - t->rms_smooth);
+    t->zcr_smooth += t->rms_alpha * (zcr - t->zcr_smooth);
+    t->voice_smooth += t->rms_alpha * ((voice ? 1.0f : 0.0f) - t->voice_smooth);
+
+    bool loud, quiet;
+    if (c->mode == TRIGGER_MODE_SPECTRAL) {
+        // The VAD already tracks a noise floor per band, so only the user's
+        // absolute minimum applies to the level
+        float trig_level = (float)c->threshold;
+        t->trig_level = trig_level;
+        loud = (t->rms_smooth >= trig_level) && (t->voice_smooth >= c->voice_on);
+        quiet = (t->voice_smooth < c->voice_off) ||
+                (t->rms_smooth < trig_level * c->silence_frac);
+    } else {
+        // Trigger threshold = max(user threshold, noise_floor * multiplier)
+        float trig_level = (float)c->threshold;
+        float noise_trig = t->noise_floor * c->noise_mult;
+        if (noise_trig > trig_level) trig_level = noise_trig;
+        t->trig_level = trig_level;
+
+        // Silence threshold with hysteresis (lower than trigger)
+        float silence_level = trig_level * c->silence_frac;
+
+        // Combined trigger: high energy AND low ZCR (not white noise)
+        loud = (t->rms_smooth >= trig_level) && (t->zcr_smooth < c->zcr_max);
+        quiet = (t->rms_smooth < silence_level);
+    }
+
+    switch (t->state) {
+    case TRIGGER_IDLE:
+        // Adaptive noise floor only follows the ambient level while idle
+        t->noise_floor += t->noise_alpha * (rms - t->noise_floor);
+
+        // Require a sustained loud signal (at least one chunk)
+        t->loud_samples = loud ? t->loud_samples + n : 0;
+        if (loud && t->loud_samples >= ms_to_samples(c->min_event_ms, c->sample_rate)) {
+            t->state = TRIGGER_RECORDING;
+            t->loud_samples = 0;
+            t->silence_samples = 0;
+            return TRIGGER_EV_START;
+        }
+        break;
+
+    case TRIGGER_RECORDING:
+        t->silence_samples = quiet ? t->silence_samples + n : 0;
+        if (quiet && t->silence_samples >= ms_to_samples(c->silence_ms, c->sample_rate)) {
+            t->state = TRIGGER_IDLE;
+            t->loud_samples = 0;
+            t->silence_samples = 0;
+            return TRIGGER_EV_STOP;
+        }
+        break;
+    }
+    return TRIGGER_EV_NONE;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Auto-record trigger state machine. Pure and reentrant: all state lives in
+// trigger_t and there are no IDF/FreeRTOS dependencies, so the same code runs
+// on the device and in the host replay tool (tools/trigger_replay).
+//
+// All timing is in samples: smoothing uses time constants and the start and
+// stop conditions count audio duration, so chunks of any size (audio_read
+// returns whatever the ADC produced) give the same behaviour.
+
+typedef enum {
+    TRIGGER_IDLE = 0,
+    TRIGGER_RECORDING,
+} trigger_state_t;
+
+typedef enum {
+    TRIGGER_MODE_RMS = 0,   // smoothed RMS over an adaptive floor, ZCR veto
+    TRIGGER_MODE_SPECTRAL,  // per-frame voice decision from vad.c
+} trigger_mode_t;
+
+typedef enum {
+    TRIGGER_EV_NONE = 0,
+    TRIGGER_EV_START,   // sustained loud signal: start recording
+    TRIGGER_EV_STOP,    // silence timeout: stop recording
+} trigger_event_t;
+
+typedef struct {
+    trigger_mode_t mode;
+    uint32_t sample_rate;
+    uint16_t threshold;       // absolute minimum smoothed RMS to trigger
+    float    rms_tau_s;       // fast EMA of per-chunk RMS (also ZCR, voice)
+    float    noise_tau_s;     // slow EMA tracking ambient level (idle only)
+    float    noise_mult;      // trigger also needs rms > noise_floor * mult
+    float    zcr_max;         // rms mode: reject white-noise-like signals above this ZCR
+    float    voice_on;        // spectral mode: smoothed voice ratio needed to start
+    float    voice_off;       // spectral mode: below this the chunk counts as silence
+    float    silence_frac;    // silence level = trigger level * frac (hysteresis)
+    uint32_t min_event_ms;    // loud signal must last this long to start
+    uint32_t silence_ms;      // quiet this long stops the recording
+} trigger_config_t;
+
+typedef struct {
+    trigger_config_t cfg;
+    trigger_state_t state;
+    float rms_smooth;
+    float noise_floor;
+    float zcr_smooth;
+    float voice_smooth;       // EMA of the VAD decision (spectral mode)
+    float trig_level;         // trigger level used by the last update
+    uint32_t loud_samples;    // consecutive loud audio
+    uint32_t silence_samples; // consecutive quiet audio
+    size_t alpha_n;           // chunk size the cached alphas are for
+    float rms_alpha, noise_alpha;
+} trigger_t;
+
+// Defaults matching the original tuning, which assumed 20 ms chunks.
+void trigger_default_config(trigger_config_t *cfg, uint32_t sample_rate);
+
+void trigger_init(trigger_t *t, const trigger_config_t *cfg);
+
+// Back to idle and forget the adaptive noise floor and smoothing.
+void trigger_reset(trigger_t *t);
+
+// Back to idle, keeping the adaptive state (e.g. after a manual stop or a
+// start that failed).
+void trigger_set_idle(trigger_t *t);
+
+// RMS, zero-crossing rate (crossings per sample pair) and, if peak is not
+// NULL, the largest magnitude of one chunk.
+void trigger_frame_stats(const int16_t *pcm, size_t n, float *rms, float *zcr, uint16_t *peak);
+
+// Feed one chunk of n samples: its RMS, ZCR and VAD decision (only used in
+// spectral mode). Returns an event when the state changes.
+trigger_event_t trigger_update(trigger_t *t, size_t n, float rms, float zcr, bool voice);
@@ -0,0 +1,235 @@
+#include "vad.h"
+
+#include <math.h>
+#include <string.h>
+
+#define FFT_HALF   (VAD_FFT_SIZE / 2)   // complex FFT length
+
+// Band edges in Hz; bands 1..3 cover the speech range
+static const uint16_t s_band_edges[VAD_NUM_BANDS + 1] = {
+    80, 300, 1000, 2000, 4000, 7000, 10000,
+};
+#define SPEECH_BAND_FIRST 1
+#define SPEECH_BAND_LAST  3
+
+// log2 approximation (~0.005 error), plenty for dB and flatness
+static inline float fast_log2(float x)
+{
+    union { float f; uint32_t i; } u = { x };
+    float e = (float)((int)((u.i >> 23) & 0xff) - 127);
+    u.i = (u.i & 0x007fffff) | 0x3f800000;
+    float m = u.f;
+    return e + (-0.34484843f * m + 2.02466578f) * m - 0.67487759f;
+}
+
+#define LOG2_TO_DB 3.0103f
+
+void vad_default_config(vad_config_t *cfg)
+{
+    cfg->snr_on_db = 6.0f;
+    cfg->flatness_max = 0.40f;
+    cfg->floor_up_s = 2.0f;
+    cfg->floor_down_s = 0.2f;    // quiet moments pull the floor down quickly
+    cfg->floor_creep_s = 40.0f;  // learns a steady hum even if it looks tonal
+}
+
+static float frame_alpha(size_t n, float tau_s, int sample_rate)
+{
+    if (tau_s <= 0) return 1.0f;
+    return 1.0f - expf(-(float)n / (tau_s * (float)sample_rate));
+}
+
+static uint16_t hz_to_bin(int hz, int sample_rate)
+{
+    int bin = (int)((int64_t)hz * VAD_FFT_SIZE / sample_rate);
+    if (bin > FFT_HALF) bin = FFT_HALF;
+    return (uint16_t)bin;
+}
+
+void vad_init(vad_t *v, const vad_config_t *cfg, int sample_rate)
+{
+    memset(v, 0, sizeof(*v));
+    v->cfg = *cfg;
+    v->sample_rate = sample_rate;
+
+    for (int b = 0; b < VAD_NUM_BANDS; b++) {
+        v->band_lo[b] = hz_to_bin(s_band_edges[b], sample_rate);
+        v->band_hi[b] = hz_to_bin(s_band_edges[b + 1], sample_rate);
+    }
+    v->flat_lo = v->band_lo[SPEECH_BAND_FIRST];
+    v->flat_hi = v->band_hi[SPEECH_BAND_LAST];
+
+    // Tables are built once, in float
+    for (int i = 0; i < VAD_FFT_SIZE; i++) {
+        float w = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / VAD_FFT_SIZE);
+        v->window[i] = (int16_t)(w * 32767.0f + 0.5f);
+    }
+    for (int k = 0; k < FFT_HALF; k++) {
+        float a = 2.0f * (float)M_PI * k / VAD_FFT_SIZE;
+        v->twiddle[k][0] = (int16_t)lrintf(cosf(a) * 32767.0f);
+        v->twiddle[k][1] = (int16_t)lrintf(-sinf(a) * 32767.0f);
+    }
+}
+
+void vad_reset(vad_t *v)
+{
+    memset(v->history, 0, sizeof(v->history));
+    v->primed = false;
+    v->voice = false;
+}
+
+// In-place radix-2 complex FFT of FFT_HALF points, halving every stage so
+// magnitudes never grow (output = DFT / FFT_HALF). Inputs must have
+// |z| <= 2^15 so each Q15 product fits in 32 bits.
+static void fft_complex_q15(int32_t *z, const int16_t (*tw)[2])
+{
+    // Bit-reversal permutation
+    for (int i = 1, j = 0; i < FFT_HALF; i++) {
+        int bit = FFT_HALF >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j |= bit;
+        if (i < j) {
+            int32_t tr = z[2 * i], ti = z[2 * i + 1];
+            z[2 * i] = z[2 * j];
+            z[2 * i + 1] = z[2 * j + 1];
+            z[2 * j] = tr;
+            z[2 * j + 1] = ti;
+        }
+    }
+
+    for (int len = 2; len <= FFT_HALF; len <<= 1) {
+        int half = len >> 1;
+        int step = VAD_FFT_SIZE / len;   // stride into the 512-point table
+        for (int i = 0; i < FFT_HALF; i += len) {
+            for (int k = 0; k < half; k++) {
+                int32_t wr = tw[k * step][0], wi = tw[k * step][1];
+                int32_t *a = &z[2 * (i + k)];
+                int32_t *b = &z[2 * (i + k + half)];
+                int32_t tr = (b[0] * wr - b[1] * wi) >> 15;
+                int32_t ti = (b[0] * wi + b[1] * wr) >> 15;
+                b[0] = (a[0] - tr) >> 1;
+                b[1] = (a[1] - ti) >> 1;
+                a[0] = (a[0] + tr) >> 1;
+                a[1] = (a[1] + ti) >> 1;
+            }
+        }
+    }
+}
+
+// Power of bin k (0..FFT_HALF) of the 512-point real FFT, recovered from
+// the packed 256-point complex FFT of even/odd samples
+static inline float real_bin_power(const int32_t *z, const int16_t (*tw)[2], int k)
+{
+    if (k == 0 || k == FFT_HALF) {
+        float x = (float)(k == 0 ? z[0] + z[1] : z[0] - z[1]);
+        return x * x;
+    }
+    int32_t a = z[2 * k], b = z[2 * k + 1];
+    int32_t c = z[2 * (FFT_HALF - k)], d = z[2 * (FFT_HALF - k) + 1];
+
+    // even = (Z[k] + conj(Z[N-k])) / 2, odd = (Z[k] - conj(Z[N-k])) / 2j
+    int32_t er = (a + c) >> 1, ei = (b - d) >> 1;
+    int32_t or_ = (b + d) >> 1, oi = (c - a) >> 1;
+    int32_t wr = tw[k][0], wi = tw[k][1];
+    float re = (float)er + (float)((or_ * wr - oi * wi) >> 15);
+    float im = (float)ei + (float)((or_ * wi + oi * wr) >> 15);
+    return re * re + im * im;
+}
+
+bool vad_process(vad_t *v, const int16_t *pcm, size_t n)
+{
+    const vad_config_t *c = &v->cfg;
+
+    // Slide the newest samples into the analysis window
+    if (n >= VAD_FFT_SIZE) {
+        memcpy(v->history, pcm + n - VAD_FFT_SIZE, sizeof(v->history));
+    } else {
+        memmove(v->history, v->history + n, (VAD_FFT_SIZE - n) * sizeof(int16_t));
+        memcpy(v->history + VAD_FFT_SIZE - n, pcm, n * sizeof(int16_t));
+    }
+
+    // Window, then normalise the block so the peak sits at 2^14 (block
+    // floating point keeps quiet rooms above the FFT's rounding noise)
+    int32_t peak = 0;
+    for (int i = 0; i < VAD_FFT_SIZE; i++) {
+        int32_t x = ((int32_t)v->history[i] * v->window[i]) >> 15;
+        v->work[i] = x;
+        if (x < 0) x = -x;
+        if (x > peak) peak = x;
+    }
+    if (peak == 0) {
+        v->voice = false;
+        return false;
+    }
+    int shift = 0;
+    while ((peak << (shift + 1)) <= 16384) shift++;
+    if (peak > 16384) shift = -1;
+    for (int i = 0; i < VAD_FFT_SIZE; i++) {
+        v->work[i] = shift >= 0 ? v->work[i] << shift : v->work[i] >> 1;
+    }
+
+    // Even samples are the real parts, odd samples the imaginary parts
+    fft_complex_q15(v->work, v->twiddle);
+
+    // Undo the normalisation in the log domain
+    float offset_log2 = -2.0f * shift;
+
+    float log_sum = 0, lin_sum = 0;
+    int flat_bins = 0;
+    for (int b = 0; b < VAD_NUM_BANDS; b++) {
+        int lo = v->band_lo[b], hi = v->band_hi[b];
+        if (lo >= hi) {
+            v->band_db[b] = -120.0f;
+            continue;
+        }
+        float e = 0;
+        for (int k = lo; k < hi; k++) {
+            float p = real_bin_power(v->work, v->twiddle, k) + 1.0f;
+            e += p;
+            if (k >= v->flat_lo && k < v->flat_hi) {
+                log_sum += fast_log2(p);
+                lin_sum += p;
+                flat_bins++;
+            }
+        }
+        v->band_db[b] = LOG2_TO_DB * (fast_log2(e / (hi - lo)) + offset_log2);
+    }
+
+    // Spectral flatness: geometric / arithmetic mean of the bin powers
+    v->flatness = flat_bins ? exp2f(log_sum / flat_bins - fast_log2(lin_sum / flat_bins)) : 1.0f;
+
+    if (!v->primed) {
+        memcpy(v->floor_db, v->band_db, sizeof(v->floor_db));
+        v->primed = true;
+    }
+
+    // Voice: speech bands stand out from their floors and the spectrum is
+    // structured rather than noise-like
+    int active = 0;
+    bool strong = false;
+    for (int b = SPEECH_BAND_FIRST; b <= SPEECH_BAND_LAST; b++) {
+        float snr = v->band_db[b] - v->floor_db[b];
+        if (snr >= c->snr_on_db) active++;
+        if (snr >= 2.0f * c->snr_on_db) strong = true;
+    }
+    v->voice = (active >= 2 || strong) && v->flatness < c->flatness_max;
+
+    // Per-band adaptive noise floor, rates scaled to the audio just shifted in
+    if (n != v->alpha_n) {
+        v->alpha_n = n;
+        v->up_alpha = frame_alpha(n, c->floor_up_s, v->sample_rate);
+        v->down_alpha = frame_alpha(n, c->floor_down_s, v->sample_rate);
+        v->creep_alpha = frame_alpha(n, c->floor_creep_s, v->sample_rate);
+    }
+    for (int b = 0; b < VAD_NUM_BANDS; b++) {
+        float d = v->band_db[b] - v->floor_db[b];
+        float rate;
+        if (d < 0)
+            rate = v->down_alpha;
+        else
+            rate = v->voice ? v->creep_alpha : v->up_alpha;
+        v->floor_db[b] += rate * d;
+    }
+
+    return v->voice;
+}
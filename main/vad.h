@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Spectral voice activity detector for auto-record. A 512-point fixed-point
+// real FFT runs over a sliding window of the newest samples (each call
+// shifts in whatever audio_read produced, so successive 400-sample frames
+// overlap by 112). Per-band energies are compared against a per-band
+// adaptive noise floor, and spectral flatness over the speech range rejects
+// broadband noise (fans, rain) that the RMS trigger cannot tell from voice.
+// Pure C like trigger.c, so tools/trigger_replay can run it on the host.
+
+#define VAD_FFT_SIZE   512
+#define VAD_NUM_BANDS  6
+
+typedef struct {
+    float snr_on_db;        // band counts as active this far above its floor
+    float flatness_max;     // voice needs flatness (0 = tonal, ~0.56 = white) below this
+    float floor_up_s;       // floor time constant when energy rises (non-voice frames)
+    float floor_down_s;     // floor time constant when energy falls
+    float floor_creep_s;    // floor time constant during voice, so steady tones are learned
+} vad_config_t;
+
+typedef struct {
+    vad_config_t cfg;
+    int sample_rate;
+    uint16_t band_lo[VAD_NUM_BANDS];     // first FFT bin of each band
+    uint16_t band_hi[VAD_NUM_BANDS];     // one past the last bin
+    uint16_t flat_lo, flat_hi;           // bins used for flatness (speech range)
+    int16_t window[VAD_FFT_SIZE];        // Hann, Q15
+    int16_t twiddle[VAD_FFT_SIZE / 2][2];// cos/-sin(2*pi*k/512), Q15
+    int16_t history[VAD_FFT_SIZE];       // newest VAD_FFT_SIZE samples
+    int32_t work[VAD_FFT_SIZE];          // 256 complex values, interleaved
+    bool primed;                         // floors initialised from a first frame
+    size_t alpha_n;                      // frame size the cached floor rates are for
+    float up_alpha, down_alpha, creep_alpha;
+
+    // Features of the last frame
+    float band_db[VAD_NUM_BANDS];
+    float floor_db[VAD_NUM_BANDS];
+    float flatness;
+    bool voice;
+} vad_t;
+
+void vad_default_config(vad_config_t *cfg);
+
+void vad_init(vad_t *v, const vad_config_t *cfg, int sample_rate);
+
+// Forget the noise floors and the sample history.
+void vad_reset(vad_t *v);
+
+// Shift in one frame of audio and classify the newest window.
+// Returns true if it looks like voice.
+bool vad_process(vad_t *v, const int16_t *pcm, size_t n);
@@ -1,7 +1,9 @@
 #include "wav.h"
+#include "codec.h"
 
 #include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
 #include "esp_log.h"
 
 static const char *TAG = "wav";
@@ -51,30 +53,23 @@ FILE *wav_open(const char *path, int sample_rate, int bits_per_sample, int chann
     return f;
 }
 
-// ITU-T G.711 µ-law encoding: 16-bit linear PCM → 8-bit µ-law
-static uint8_t linear_to_ulaw(int16_t sample)
+void wav_build_header(uint8_t out[WAV_HEADER_SIZE], int sample_rate, bool ulaw, uint32_t data_size)
 {
-    const int16_t BIAS = 0x84;   // 132
-    const int16_t CLIP = 32635;
-    uint8_t sign = 0;
-    if (sample < 0) {
-        sign = 0x80;
-        sample = -sample;
-    }
-    if (sample > CLIP) sample = CLIP;
-    sample += BIAS;
-
-    // Find segment (exponent)
-    int seg = 0;
-    int shifted = sample >> 7;
-    while (shifted > 0) {
-        seg++;
-        shifted >>= 1;
-    }
-    // Build µ-law byte: sign(1) | exponent(3) | mantissa(4)
-    uint8_t uval = (uint8_t)(sign | ((uint8_t)seg << 4) |
-                              ((sample >> (seg + 3)) & 0x0F));
-    return ~uval;  // complement per standard
+    wav_header_t hdr;
+    memcpy(hdr.riff_tag, "RIFF", 4);
+    hdr.riff_size = data_size + sizeof(hdr) - 8;
+    memcpy(hdr.wave_tag, "WAVE", 4);
+    memcpy(hdr.fmt_tag, "fmt ", 4);
+    hdr.fmt_size = 16;
+    hdr.audio_format = ulaw ? 7 : 1;
+    hdr.num_channels = 1;
+    hdr.sample_rate = sample_rate;
+    hdr.bits_per_sample = ulaw ? 8 : 16;
+    hdr.block_align = hdr.bits_per_sample / 8;
+    hdr.byte_rate = sample_rate * hdr.block_align;
+    memcpy(hdr.data_tag, "data", 4);
+    hdr.data_size = data_size;
+    memcpy(out, &hdr, sizeof(hdr));
 }
 
 FILE *wav_open_ulaw(const char *path, int sample_rate, int channels)
@@ -115,7 +110,7 @@ size_t wav_write_ulaw(FILE *f, const int16_t *samples, size_t num_samples)
         size_t chunk = num_samples - total;
         if (chunk > sizeof(ubuf)) chunk = sizeof(ubuf);
         for (size_t i = 0; i < chunk; i++) {
-            ubuf[i] = linear_to_ulaw(samples[total + i]);
+            ubuf[i] = codec_ulaw(samples[total + i]);
         }
         total += fwrite(ubuf, 1, chunk, f);
     }
@@ -128,22 +123,111 @@ size_t wav_write(FILE *f, const int16_t *samples, size_t num_samples)
     return fwrite(samples, sizeof(int16_t), num_samples, f);
 }
 
-void wav_close(FILE *f)
+// Write RIFF size (offset 4) and data size (offset 40) for a file of file_size bytes
+static void wav_patch_sizes(FILE *f, long file_size)
 {
-    if (!f) return;
-
-    long file_size = ftell(f);
     uint32_t data_size = file_size - sizeof(wav_header_t);
     uint32_t riff_size = file_size - 8;
 
-    // Fix RIFF size at offset 4
     fseek(f, 4, SEEK_SET);
     fwrite(&riff_size, 4, 1, f);
 
-    // Fix data size at offset 40
     fseek(f, 40, SEEK_SET);
     fwrite(&data_size, 4, 1, f);
+}
+
+void wav_close(FILE *f)
+{
+    if (!f) return;
+
+    long file_size = ftell(f);
+    wav_patch_sizes(f, file_size);
+
+    fclose(f);
+    ESP_LOGI(TAG, "WAV closed: %ld bytes total, %"PRIu32" bytes PCM data",
+             file_size, (uint32_t)(file_size - sizeof(wav_header_t)));
+}
+
+void wav_commit(FILE *f)
+{
+    if (!f) return;
+
+    long file_size = ftell(f);
+    if (file_size < (long)sizeof(wav_header_t)) return;
+
+    wav_patch_sizes(f, file_size);
+    fseek(f, file_size, SEEK_SET);
+    fflush(f);
+    fsync(fileno(f));
+}
+
+FILE *wav_open_append(const char *path, int sample_rate, bool ulaw, uint32_t *data_size)
+{
+    FILE *f = fopen(path, "r+b");
+    if (!f) {
+        *data_size = 0;
+        return ulaw ? wav_open_ulaw(path, sample_rate, 1)
+                    : wav_open(path, sample_rate, 16, 1);
+    }
+
+    wav_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.riff_tag, "RIFF", 4) != 0 || memcmp(hdr.data_tag, "data", 4) != 0 ||
+        hdr.audio_format != (ulaw ? 7 : 1) || (int)hdr.sample_rate != sample_rate ||
+        hdr.num_channels != 1) {
+        ESP_LOGE(TAG, "Cannot append to %s: not a matching WAV", path);
+        fclose(f);
+        return NULL;
+    }
+
+    // Trust the header (the recovery journal keeps it in step with the
+    // data) and drop anything after it, e.g. a partial block
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    uint32_t size = hdr.data_size;
+    if ((long)(sizeof(hdr) + size) > file_size) size = file_size - sizeof(hdr);
+    size -= size % hdr.block_align;
+    if ((long)(sizeof(hdr) + size) < file_size) {
+        fflush(f);
+        ftruncate(fileno(f), sizeof(hdr) + size);
+    }
+    fseek(f, sizeof(hdr) + size, SEEK_SET);
 
+    *data_size = size;
+    ESP_LOGI(TAG, "Appending to WAV: %s (%"PRIu32" bytes PCM data)", path, size);
+    return f;
+}
+
+esp_err_t wav_repair(const char *path, uint32_t *data_size)
+{
+    FILE *f = fopen(path, "r+b");
+    if (!f) return ESP_ERR_NOT_FOUND;
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+
+    wav_header_t hdr;
+    fseek(f, 0, SEEK_SET);
+    if (file_size < (long)sizeof(hdr) || fread(&hdr, sizeof(hdr), 1, f) != 1) {
+        fclose(f);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (memcmp(hdr.riff_tag, "RIFF", 4) != 0 || memcmp(hdr.data_tag, "data", 4) != 0) {
+        fclose(f);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Drop a trailing partial sample frame
+    uint32_t actual = file_size - sizeof(hdr);
+    if (hdr.block_align > 1) actual -= actual % hdr.block_align;
+
+    if (hdr.data_size != actual || hdr.riff_size != actual + sizeof(hdr) - 8) {
+        wav_patch_sizes(f, actual + sizeof(hdr));
+        ESP_LOGI(TAG, "WAV repaired: %s (%"PRIu32" -> %"PRIu32" bytes PCM data)",
+                 path, hdr.data_size, actual);
+    }
     fclose(f);
-    ESP_LOGI(TAG, "WAV closed: %ld bytes total, %"PRIu32" bytes PCM data", file_size, data_size);
+
+    if (data_size) *data_size = actual;
+    return ESP_OK;
 }
@@ -2,6 +2,8 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
 
 // Open a new WAV file and write the header (placeholder sizes).
 // Returns file handle or NULL on error.
@@ -13,8 +15,27 @@ size_t wav_write(FILE *f, const int16_t *samples, size_t num_samples);
 // Open a new WAV file with µ-law encoding (audio_format=7, 8-bit).
 FILE *wav_open_ulaw(const char *path, int sample_rate, int channels);
 
+// Open an existing WAV for appending (positioned at the end of its data
+// chunk), or create it if missing. Fails if the file's format does not
+// match. data_size receives the PCM bytes already present.
+FILE *wav_open_append(const char *path, int sample_rate, bool ulaw, uint32_t *data_size);
+
 // Append µ-law encoded data: converts int16 PCM to 8-bit µ-law and writes.
 size_t wav_write_ulaw(FILE *f, const int16_t *samples, size_t num_samples);
 
+#define WAV_HEADER_SIZE 44
+
+// Fill a 44-byte mono header (PCM16 or µ-law) for data_size bytes of audio,
+// for responses that serve part of a file as a WAV of its own.
+void wav_build_header(uint8_t out[WAV_HEADER_SIZE], int sample_rate, bool ulaw, uint32_t data_size);
+
 // Finalize the WAV file: seek back and fix RIFF/data sizes, then close.
 void wav_close(FILE *f);
+
+// Patch RIFF/data sizes for what has been written so far and fsync,
+// leaving the file positioned at the end for further writes.
+void wav_commit(FILE *f);
+
+// Fix the header sizes of a WAV file left unfinalised (e.g. by power loss).
+// data_size (optional) receives the PCM data length now in the header.
+esp_err_t wav_repair(const char *path, uint32_t *data_size);
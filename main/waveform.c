@@ -1,17 +1,23 @@
 #include "waveform.h"
 #include "sdcard.h"
+#include "catalog.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
-#include <dirent.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 
 static const char *TAG = "waveform";
 
+#define WAVEFORM_QUEUE_LEN 8
+
+static QueueHandle_t s_requests = NULL;   // names, char[CATALOG_NAME_LEN]
+static volatile bool s_resweep = false;   // a request did not fit the queue
+
 static int16_t ulaw_decode(uint8_t u)
 {
     u = ~u;
@@ -54,6 +60,26 @@ void waveform_delete_cache(const char *wav_filename)
     char path[280];
     cache_path_for(wav_filename, path, sizeof(path));
     unlink(path);
+    catalog_set_waveform(wav_filename, false);
+}
+
+static esp_err_t write_cache(const char *wav_filename, const uint16_t peaks[WAVEFORM_BINS])
+{
+    // Ensure cache directory exists
+    mkdir(WAVEFORM_CACHE_DIR, 0755);
+
+    char cache_path[280];
+    cache_path_for(wav_filename, cache_path, sizeof(cache_path));
+
+    FILE *cf = fopen(cache_path, "wb");
+    if (!cf) {
+        ESP_LOGW(TAG, "cannot write cache %s", cache_path);
+        return ESP_FAIL;
+    }
+    fwrite(peaks, sizeof(uint16_t), WAVEFORM_BINS, cf);
+    fclose(cf);
+    catalog_set_waveform(wav_filename, true);
+    return ESP_OK;
 }
 
 esp_err_t waveform_generate(const char *wav_filename)
@@ -138,23 +164,95 @@ esp_err_t waveform_generate(const char *wav_filename)
     }
     fclose(f);
 
-    // Ensure cache directory exists
-    mkdir(WAVEFORM_CACHE_DIR, 0755);
+    esp_err_t err = write_cache(wav_filename, peaks);
+    if (err == ESP_OK) ESP_LOGI(TAG, "generated cache for %s", wav_filename);
+    return err;
+}
 
-    // Write cache file
-    char cache_path[280];
-    cache_path_for(wav_filename, cache_path, sizeof(cache_path));
+esp_err_t waveform_append(const char *wav_filename, uint32_t before, uint32_t after, uint16_t peak)
+{
+    uint16_t old[WAVEFORM_BINS];
+    // Short files have fewer than 64 bins in their cache; a rescan is cheap
+    if (before < WAVEFORM_BINS || after <= before || waveform_read_cache(wav_filename, old) != ESP_OK) {
+        waveform_delete_cache(wav_filename);
+        waveform_request(wav_filename);
+        return ESP_ERR_NOT_FOUND;
+    }
 
-    FILE *cf = fopen(cache_path, "wb");
-    if (!cf) {
-        ESP_LOGW(TAG, "cannot write cache %s", cache_path);
-        return ESP_FAIL;
+    // Old bin b covered [b, b + 1) * before / 64; each lands in the new bins
+    // it overlaps, and the appended samples fill the rest
+    uint16_t peaks[WAVEFORM_BINS];
+    memset(peaks, 0, sizeof(peaks));
+    for (int b = 0; b < WAVEFORM_BINS; b++) {
+        uint64_t a = (uint64_t)b * before / WAVEFORM_BINS;
+        uint64_t z = (uint64_t)(b + 1) * before / WAVEFORM_BINS;
+        int first = (int)(a * WAVEFORM_BINS / after);
+        int last = (int)((z - 1) * WAVEFORM_BINS / after);
+        for (int j = first; j <= last; j++) {
+            if (old[b] > peaks[j]) peaks[j] = old[b];
+        }
     }
-    fwrite(peaks, sizeof(uint16_t), WAVEFORM_BINS, cf);
-    fclose(cf);
+    for (int j = (int)((uint64_t)before * WAVEFORM_BINS / after); j < WAVEFORM_BINS; j++) {
+        if (peak > peaks[j]) peaks[j] = peak;
+    }
+    return write_cache(wav_filename, peaks);
+}
 
-    ESP_LOGI(TAG, "generated cache for %s", wav_filename);
-    return ESP_OK;
+esp_err_t waveform_read_group(const group_t *g, uint16_t peaks[WAVEFORM_BINS])
+{
+    memset(peaks, 0, WAVEFORM_BINS * sizeof(uint16_t));
+    if (g->total == 0) return ESP_OK;
+
+    // Request every missing part at once, so one retry can find them all
+    bool missing = false;
+    uint64_t part_start = 0;
+    for (int i = 0; i < g->parts; i++) {
+        char name[CATALOG_NAME_LEN];
+        uint16_t part_peaks[WAVEFORM_BINS];
+        group_part_name(g, i + 1, name, sizeof(name));
+        if (waveform_read_cache(name, part_peaks) != ESP_OK) {
+            waveform_request(name);
+            missing = true;
+        }
+        if (missing) continue;
+
+        // Same binning as waveform_generate: up to 64 bins of samples/bins each
+        uint32_t n = g->samples[i];
+        int bins = n < WAVEFORM_BINS ? (int)n : WAVEFORM_BINS;
+        uint32_t per_bin = bins ? n / bins : 0;
+        for (int b = 0; b < bins; b++) {
+            uint64_t a = part_start + (uint64_t)b * per_bin;
+            uint64_t z = a + per_bin;
+            int first = (int)(a * WAVEFORM_BINS / g->total);
+            int last = (int)((z - 1) * WAVEFORM_BINS / g->total);
+            if (last >= WAVEFORM_BINS) last = WAVEFORM_BINS - 1;
+            for (int j = first; j <= last; j++) {
+                if (part_peaks[b] > peaks[j]) peaks[j] = part_peaks[b];
+            }
+        }
+        part_start += n;
+    }
+    return missing ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+// Generate every cache the catalogue reports missing
+static int sweep_missing(void)
+{
+    // Take a few names at a time so the catalogue lock is never held
+    // across SD work
+    char names[8][CATALOG_NAME_LEN];
+    catalog_cursor_t cursor = { 0 };
+    int generated = 0;
+    int n;
+    while ((n = catalog_missing_waveforms(&cursor, names, 8)) > 0) {
+        for (int i = 0; i < n; i++) {
+            ESP_LOGI(TAG, "generating cache for %s", names[i]);
+            waveform_generate(names[i]);
+            generated++;
+            vTaskDelay(pdMS_TO_TICKS(50));
+        }
+    }
+    return generated;
 }
 
 static void waveform_bg_task(void *arg)
@@ -164,33 +262,41 @@ static void waveform_bg_task(void *arg)
     // Ensure cache directory exists
     mkdir(WAVEFORM_CACHE_DIR, 0755);
 
-    DIR *dir = opendir(SD_MOUNT_POINT);
-    if (!dir) {
-        ESP_LOGW(TAG, "cannot open SD for scan");
-        vTaskDelete(NULL);
-        return;
-    }
-
-    int generated = 0;
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-        char *ext = strrchr(ent->d_name, '.');
-        if (!ext || strcasecmp(ext, ".wav") != 0) continue;
-
-        if (!waveform_has_cache(ent->d_name)) {
-            ESP_LOGI(TAG, "generating cache for %s", ent->d_name);
-            waveform_generate(ent->d_name);
-            generated++;
-            vTaskDelay(pdMS_TO_TICKS(50));
+    int generated = sweep_missing();
+    ESP_LOGI(TAG, "cache backlog done, generated %d", generated);
+
+    char name[CATALOG_NAME_LEN];
+    while (1) {
+        xQueueReceive(s_requests, name, portMAX_DELAY);
+        // Several requests for one file end up here as one scan. A part still
+        // being recorded is requested again once it is finalised.
+        catalog_entry_t e;
+        bool active = catalog_get(name, &e) && (e.flags & CATALOG_F_ACTIVE);
+        if (!active && !waveform_has_cache(name)) waveform_generate(name);
+
+        if (s_resweep && uxQueueMessagesWaiting(s_requests) == 0) {
+            s_resweep = false;
+            sweep_missing();
         }
     }
-    closedir(dir);
-
-    ESP_LOGI(TAG, "background cache task done, generated %d", generated);
-    vTaskDelete(NULL);
 }
 
 void waveform_start_bg_task(void)
 {
+    s_requests = xQueueCreate(WAVEFORM_QUEUE_LEN, CATALOG_NAME_LEN);
+    if (!s_requests) {
+        ESP_LOGE(TAG, "no memory for the cache request queue");
+        return;
+    }
     xTaskCreatePinnedToCore(waveform_bg_task, "wf_cache", 4096, NULL, 2, NULL, 0);
 }
+
+void waveform_request(const char *wav_filename)
+{
+    // Before the task starts, its first sweep finds the file anyway
+    if (!s_requests) return;
+
+    char name[CATALOG_NAME_LEN];
+    snprintf(name, sizeof(name), "%s", wav_filename);
+    if (xQueueSend(s_requests, name, 0) != pdTRUE) s_resweep = true;
+}
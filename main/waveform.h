@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include "group.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -13,11 +14,29 @@ esp_err_t waveform_generate(const char *wav_filename);
 // Read cached peaks. Returns ESP_OK if cache exists, fills peaks[64].
 esp_err_t waveform_read_cache(const char *wav_filename, uint16_t peaks[WAVEFORM_BINS]);
 
+// Peaks for a split recording as a whole, folded from the parts' caches.
+// A part covers its share of the bins by duration; a bin spanning a part
+// boundary takes the larger peak. ESP_ERR_INVALID_STATE: some part has no
+// cache yet; it is requested from the background task.
+esp_err_t waveform_read_group(const group_t *g, uint16_t peaks[WAVEFORM_BINS]);
+
+// Fold audio appended to a file into its cache without reading the file:
+// the cache covers the first `before` samples, the file now has `after`,
+// and the new ones peak at `peak`. Without a usable cache one is requested
+// from the background task instead.
+esp_err_t waveform_append(const char *wav_filename, uint32_t before, uint32_t after, uint16_t peak);
+
 // Delete cache file for a WAV file.
 void waveform_delete_cache(const char *wav_filename);
 
 // Check if cache exists for a WAV file.
 bool waveform_has_cache(const char *wav_filename);
 
-// Background task: scans all WAV files, generates missing caches.
+// Background task: generates the caches the catalogue reports missing, then
+// stays up for waveform_request().
 void waveform_start_bg_task(void);
+
+// Generate the cache of a finished file on the background task, so the
+// caller never scans it. Never blocks: if the queue is full the name waits
+// for the next sweep of the catalogue's missing caches.
+void waveform_request(const char *wav_filename);
@@ -3,24 +3,37 @@
 #include "sdcard.h"
 #include "audio.h"
 #include "wifi.h"
+#include "dashcam.h"
+#include "events.h"
+#include "wav.h"
+#include "catalog.h"
+#include "jsonw.h"
+#include "jsonr.h"
+#include "status.h"
+#include "stream.h"
+#include "follow.h"
+#include "dl.h"
+#include "workers.h"
+#include "export.h"
+#include "group.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <dirent.h>
 #include <sys/stat.h>
 #include <time.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "nvs.h"
 #include "esp_http_server.h"
-#include "cJSON.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "esp_wifi.h"
 
 static const char *TAG = "webserver";
 
-#define MAX_WS_CLIENTS 4
+#define MAX_WS_CLIENTS STREAM_MAX_CLIENTS
+#define WS_CMD_MAX     128   // largest text command taken on the stack
 
 // Embedded HTML
 extern const char index_html_start[] asm("_binary_index_html_start");
@@ -30,6 +43,7 @@ static httpd_handle_t s_server = NULL;
 static int s_ws_fds[MAX_WS_CLIENTS];
 static SemaphoreHandle_t s_ws_mutex = NULL;
 static webserver_cmd_cb_t s_cmd_cb = NULL;
+static volatile uint32_t s_ws_joins = 0;
 
 // --- WebSocket client tracking ---
 
@@ -47,6 +61,8 @@ static void ws_client_add(int fd)
     for (int i = 0; i < MAX_WS_CLIENTS; i++) {
         if (s_ws_fds[i] == -1) {
             s_ws_fds[i] = fd;
+            s_ws_joins++;
+            stream_client_add(fd);
             ESP_LOGI(TAG, "WS client added: fd=%d slot=%d", fd, i);
             break;
         }
@@ -60,6 +76,7 @@ static void ws_client_remove(int fd)
     for (int i = 0; i < MAX_WS_CLIENTS; i++) {
         if (s_ws_fds[i] == fd) {
             s_ws_fds[i] = -1;
+            stream_client_remove(fd);
             ESP_LOGI(TAG, "WS client removed: fd=%d slot=%d", fd, i);
             break;
         }
@@ -73,15 +90,111 @@ static void ws_close_callback(httpd_handle_t hd, int fd)
     close(fd);
 }
 
+// --- WebSocket command acks ---
+// {"cmd":"start_rec","id":7} is answered with {"type":"ack","id":7,...} once
+// the audio task has applied it. The completion runs on the audio task, so
+// it only hands the slot to the httpd task with httpd_queue_work; the ack
+// is sent by the stream task like every other WebSocket frame.
+
+#define WS_ACK_SLOTS 8
+
+typedef struct {
+    uint8_t used;           // claimed by ws_handler, released after sending
+    int fd;
+    int32_t id;
+    char cmd[16];
+    esp_err_t result;
+} ws_ack_t;
+
+static ws_ack_t s_acks[WS_ACK_SLOTS];
+
+static ws_ack_t *ws_ack_claim(void)
+{
+    for (int i = 0; i < WS_ACK_SLOTS; i++) {
+        uint8_t expected = 0;
+        if (__atomic_compare_exchange_n(&s_acks[i].used, &expected, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return &s_acks[i];
+        }
+    }
+    return NULL;
+}
+
+static void ws_ack_release(ws_ack_t *a)
+{
+    __atomic_store_n(&a->used, 0, __ATOMIC_RELEASE);
+}
+
+// httpd task
+static void ws_ack_send(void *arg)
+{
+    ws_ack_t *a = arg;
+    char buf[128];
+    jsonw_t w;
+    jsonw_init(&w, buf, sizeof(buf), NULL, NULL);
+    jsonw_object_begin(&w);
+    jsonw_field_string(&w, "type", "ack");
+    jsonw_field_int(&w, "id", a->id);
+    jsonw_field_string(&w, "cmd", a->cmd);
+    jsonw_field_bool(&w, "ok", a->result == ESP_OK);
+    if (a->result != ESP_OK) jsonw_field_string(&w, "error", esp_err_to_name(a->result));
+    jsonw_object_end(&w);
+
+    if (jsonw_finish(&w) == 0) stream_send_text(a->fd, buf, w.len);
+    ws_ack_release(a);
+}
+
+// Audio or stream task: must not block
+static void ws_cmd_done(void *ctx, esp_err_t result)
+{
+    ws_ack_t *a = ctx;
+    a->result = result;
+    if (httpd_queue_work(s_server, ws_ack_send, a) != ESP_OK) ws_ack_release(a);
+}
+
 // --- HTTP Handlers ---
 
 static esp_err_t index_handler(httpd_req_t *req)
 {
     size_t len = index_html_end - index_html_start;
     httpd_resp_set_type(req, "text/html");
+    // Cross-origin isolation lets the player share its ring with the
+    // audio thread (SharedArrayBuffer) where the browser allows it
+    httpd_resp_set_hdr(req, "Cross-Origin-Opener-Policy", "same-origin");
+    httpd_resp_set_hdr(req, "Cross-Origin-Embedder-Policy", "require-corp");
     return httpd_resp_send(req, index_html_start, len);
 }
 
+// {"cmd":"stream","type":"full"|"preview"|"levels","codec":"adpcm"}: switch
+// this connection from raw PCM to framed messages. "full" is audio at the
+// capture rate (or "rate"), PCM16 unless "codec" says otherwise; "preview"
+// is 8 kHz audio, ADPCM by default; "levels" is meter values only. The ack
+// comes from the network task once it has switched, so the client can treat
+// every binary message after it as framed.
+static bool ws_stream_format(int fd, const jsonr_t *json, ws_ack_t *ack)
+{
+    const char *type = "full";
+    const char *codec = NULL;
+    int rate = AUDIO_SAMPLE_RATE;
+    jsonr_get_string(json, "type", &type);
+    jsonr_get_string(json, "codec", &codec);
+    jsonr_get_int(json, "rate", &rate);
+    if (strcmp(type, "levels") == 0) {
+        codec = "levels";
+    } else if (strcmp(type, "preview") == 0) {
+        if (!codec) codec = "adpcm";
+        rate = 8000;
+    } else if (strcmp(type, "full") == 0) {
+        if (!codec) codec = "pcm16";
+    } else {
+        return false;
+    }
+    int fmt = stream_format_find(codec, rate);
+    if (fmt < 0) return false;
+    stream_client_set_format(fd, fmt, ack ? ws_cmd_done : NULL, ack);
+    return true;
+}
+
 static esp_err_t ws_handler(httpd_req_t *req)
 {
     if (req->method == HTTP_GET) {
@@ -100,333 +213,702 @@ static esp_err_t ws_handler(httpd_req_t *req)
 
     if (ws_pkt.len == 0) return ESP_OK;
 
-    uint8_t *buf = malloc(ws_pkt.len + 1);
-    if (!buf) return ESP_ERR_NO_MEM;
-
-    ws_pkt.payload = buf;
-    ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
-    if (ret != ESP_OK) {
-        free(buf);
-        return ret;
+    // Commands are tiny; only an unexpectedly large frame goes to the heap
+    char small[WS_CMD_MAX];
+    char *buf = small;
+    if (ws_pkt.len >= sizeof(small)) {
+        buf = malloc(ws_pkt.len + 1);
+        if (!buf) return ESP_ERR_NO_MEM;
     }
-    buf[ws_pkt.len] = 0;
 
-    if (ws_pkt.type == HTTPD_WS_TYPE_TEXT && s_cmd_cb) {
-        // Parse JSON command
-        cJSON *json = cJSON_Parse((char *)buf);
-        if (json) {
-            cJSON *cmd = cJSON_GetObjectItem(json, "cmd");
-            if (cmd && cJSON_IsString(cmd)) {
-                s_cmd_cb(cmd->valuestring);
+    ws_pkt.payload = (uint8_t *)buf;
+    ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+    if (ret == ESP_OK && ws_pkt.type == HTTPD_WS_TYPE_TEXT && s_cmd_cb) {
+        buf[ws_pkt.len] = 0;
+
+        // Parse JSON command; an "id" asks for an ack
+        jsonr_t json;
+        const char *cmd;
+        int id;
+        if (jsonr_parse(&json, buf) == 0 && jsonr_get_string(&json, "cmd", &cmd)) {
+            ws_ack_t *ack = jsonr_get_int(&json, "id", &id) ? ws_ack_claim() : NULL;
+            if (ack) {
+                ack->fd = httpd_req_to_sockfd(req);
+                ack->id = id;
+                snprintf(ack->cmd, sizeof(ack->cmd), "%s", cmd);
+            }
+            bool queued = strcmp(cmd, "stream") == 0
+                ? ws_stream_format(httpd_req_to_sockfd(req), &json, ack)
+                : s_cmd_cb(cmd, ack ? ws_cmd_done : NULL, ack);
+            if (!queued && ack) {
+                // Unknown command or queue full: answer right away
+                ack->result = ESP_ERR_NOT_SUPPORTED;
+                ws_ack_send(ack);
             }
-            cJSON_Delete(json);
         }
     }
 
-    free(buf);
-    return ESP_OK;
+    if (buf != small) free(buf);
+    return ret;
 }
 
-static esp_err_t api_files_handler(httpd_req_t *req)
+// --- JSON responses ---
+// Replies are written with jsonw into a stack buffer. One that fits is sent
+// in a single piece with a Content-Length; a longer one streams out as HTTP
+// chunks whenever the buffer fills. Request bodies are parsed in place with
+// jsonr. Neither touches the heap.
+
+#define JSON_BUF_SIZE 1024
+
+static int json_send_chunk(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len) == ESP_OK ? 0 : -1;
+}
+
+static void json_begin(jsonw_t *w, char *buf, size_t size, httpd_req_t *req)
 {
-    DIR *dir = opendir(SD_MOUNT_POINT);
-    if (!dir) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot open SD card");
+    httpd_resp_set_type(req, "application/json");
+    jsonw_init(w, buf, size, json_send_chunk, req);
+}
+
+static esp_err_t json_end(jsonw_t *w, httpd_req_t *req)
+{
+    if (jsonw_finish(w) != 0) return ESP_FAIL;
+    if (w->flushed == 0) return httpd_resp_send(req, w->buf, w->len);
+    if (jsonw_flush(w) != 0) return ESP_FAIL;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Read a small JSON body into buf and parse it. Sends the 400 itself.
+static esp_err_t json_recv(httpd_req_t *req, char *buf, size_t size, jsonr_t *json)
+{
+    int len = httpd_req_recv(req, buf, size - 1);
+    if (len <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No body");
         return ESP_FAIL;
     }
+    buf[len] = '\0';
+    if (jsonr_parse(json, buf) != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
 
-    cJSON *arr = cJSON_CreateArray();
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-        // Only list .wav files
-        char *ext = strrchr(ent->d_name, '.');
-        if (!ext || strcasecmp(ext, ".wav") != 0) continue;
+// A queue is full or the answer is still being prepared
+static esp_err_t send_busy(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    httpd_resp_sendstr(req, "Busy, try again");
+    return ESP_OK;
+}
 
-        char path[280];
-        snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, ent->d_name);
-        struct stat st;
-        if (stat(path, &st) != 0) continue;
+// --- File downloads ---
+// esp_http_server only knows chunked bodies, so downloads write the status
+// line and headers themselves and follow them with exactly Content-Length
+// bytes from the download engine. The body goes out on a worker (workers.h).
 
-        cJSON *obj = cJSON_CreateObject();
-        cJSON_AddStringToObject(obj, "name", ent->d_name);
-        cJSON_AddNumberToObject(obj, "size", st.st_size);
+// Byte range [*start, *end) requested of a total-byte body by the Range
+// header: "bytes=A-B", "bytes=A-" or the last N with "bytes=-N". Returns 1
+// if set, -1 if it cannot be satisfied (416) and 0 if there is none to
+// honour (missing, malformed or several ranges), so the whole body is sent.
+static int parse_range(httpd_req_t *req, uint64_t total, uint64_t *start, uint64_t *end)
+{
+    char hdr[64];
+    if (httpd_req_get_hdr_value_str(req, "Range", hdr, sizeof(hdr)) != ESP_OK ||
+        strncmp(hdr, "bytes=", 6) != 0) return 0;
+
+    const char *p = hdr + 6;
+    char *e;
+    if (*p == '-') {
+        unsigned long long n = strtoull(p + 1, &e, 10);
+        if (e == p + 1 || *e != '\0') return 0;
+        if (n == 0 || total == 0) return -1;
+        *start = n < total ? total - n : 0;
+        *end = total;
+        return 1;
+    }
+    unsigned long long a = strtoull(p, &e, 10);
+    if (e == p || *e != '-') return 0;
+    unsigned long long b = total ? total - 1 : 0;
+    const char *q = e + 1;
+    if (*q != '\0') {
+        b = strtoull(q, &e, 10);
+        if (e == q || *e != '\0' || b < a) return 0;
+    }
+    if (a >= total) return -1;
+    if (b >= total) b = total - 1;
+    *start = a;
+    *end = b + 1;
+    return 1;
+}
 
-        // Format modification time
-        struct tm ti;
-        localtime_r(&st.st_mtime, &ti);
-        char timebuf[80];
-        snprintf(timebuf, sizeof(timebuf), "%04d-%02d-%02d %02d:%02d:%02d",
-                 ti.tm_year + 1900, ti.tm_mon + 1, ti.tm_mday,
-                 ti.tm_hour, ti.tm_min, ti.tm_sec);
-        cJSON_AddStringToObject(obj, "modified", timebuf);
-        cJSON_AddBoolToObject(obj, "has_waveform", waveform_has_cache(ent->d_name));
+static esp_err_t send_416(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "416 Range Not Satisfiable");
+    httpd_resp_send(req, NULL, 0);
+    return ESP_FAIL;
+}
 
-        cJSON_AddItemToArray(arr, obj);
+typedef struct {
+    char path[128];
+    long file_off;
+    long file_len;
+    uint8_t prefix[WAV_HEADER_SIZE];   // synthesized header bytes, sent first
+    uint8_t prefix_len;
+    bool ranged;
+    char content_range[48];
+} download_t;
+
+static int dl_send_sock(void *ctx, const uint8_t *data, size_t len)
+{
+    httpd_req_t *req = ctx;
+    while (len > 0) {
+        int n = httpd_send(req, (const char *)data, len);
+        if (n <= 0) return -1;  // HTTPD_SOCK_ERR_*
+        data += n;
+        len -= n;
     }
-    closedir(dir);
-
-    char *json_str = cJSON_PrintUnformatted(arr);
-    cJSON_Delete(arr);
+    return 0;
+}
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
-    return ESP_OK;
+static esp_err_t download_job(httpd_req_t *req, void *arg)
+{
+    const download_t *d = arg;
+    char head[320 + WAV_HEADER_SIZE];
+    int n = snprintf(head, sizeof(head) - WAV_HEADER_SIZE,
+                     "HTTP/1.1 %s\r\n"
+                     "Content-Type: audio/wav\r\n"
+                     "Content-Length: %ld\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "%s%s%s"
+                     "\r\n",
+                     d->ranged ? "206 Partial Content" : "200 OK",
+                     (long)d->prefix_len + d->file_len,
+                     d->ranged ? "Content-Range: " : "",
+                     d->ranged ? d->content_range : "",
+                     d->ranged ? "\r\n" : "");
+    memcpy(head + n, d->prefix, d->prefix_len);
+
+    esp_err_t err = dl_stream(d->path, d->file_off, d->file_len, head, n + d->prefix_len,
+                              dl_send_sock, req);
+    if (err == ESP_ERR_TIMEOUT) return send_busy(req);
+    if (err == ESP_ERR_NOT_FOUND) return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+    if (err != ESP_OK) {
+        // Short of Content-Length: the client can only tell if the connection ends
+        httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+    }
+    return err;
 }
 
-static esp_err_t api_file_download_handler(httpd_req_t *req)
+// Answer with prefix (may be empty) followed by file_len bytes of path from
+// file_off. content_range is NULL for a whole-file 200.
+static esp_err_t send_file_body(httpd_req_t *req, const char *path, long file_off, long file_len,
+                                const uint8_t *prefix, size_t prefix_len, const char *content_range)
 {
-    // URI: /api/files/<filename>
-    const char *filename = req->uri + strlen("/api/files/");
-    if (!filename || strlen(filename) == 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No filename");
+    download_t d = { .file_off = file_off, .file_len = file_len };
+    if (snprintf(d.path, sizeof(d.path), "%s", path) >= (int)sizeof(d.path)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
         return ESP_FAIL;
     }
+    if (prefix_len > WAV_HEADER_SIZE) prefix_len = WAV_HEADER_SIZE;
+    if (prefix_len) memcpy(d.prefix, prefix, prefix_len);
+    d.prefix_len = prefix_len;
+    if (content_range) {
+        d.ranged = true;
+        snprintf(d.content_range, sizeof(d.content_range), "%s", content_range);
+    }
 
-    char path[280];
-    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, filename);
-
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+    esp_err_t err = workers_submit(req, download_job, &d, sizeof(d));
+    if (err == ESP_ERR_NO_MEM) return send_busy(req);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start download");
         return ESP_FAIL;
     }
+    return ESP_OK;
+}
 
-    fseek(f, 0, SEEK_END);
-    long total_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+// --- Recordings list ---
 
-    httpd_resp_set_type(req, "audio/wav");
-    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+#define FILES_PAGE_DEFAULT 50
+#define FILES_PAGE_MAX     200
+#define FILES_BATCH        32   // entries per catalogue query for unpaged lists
 
-    // Check for Range header
-    char range_hdr[64] = "";
-    if (httpd_req_get_hdr_value_str(req, "Range", range_hdr, sizeof(range_hdr)) == ESP_OK) {
-        long range_start = 0, range_end = total_size - 1;
+static void format_time(int64_t t, char *out, size_t out_size)
+{
+    time_t tt = (time_t)t;
+    struct tm ti;
+    localtime_r(&tt, &ti);
+    snprintf(out, out_size, "%04d-%02d-%02d %02d:%02d:%02d",
+             ti.tm_year + 1900, ti.tm_mon + 1, ti.tm_mday,
+             ti.tm_hour, ti.tm_min, ti.tm_sec);
+}
 
-        // Parse "bytes=START-END" or "bytes=START-"
-        if (strncmp(range_hdr, "bytes=", 6) == 0) {
-            char *dash = strchr(range_hdr + 6, '-');
-            if (dash) {
-                range_start = strtol(range_hdr + 6, NULL, 10);
-                if (dash[1] != '\0') {
-                    range_end = strtol(dash + 1, NULL, 10);
-                }
-            }
-        }
+// g: the split recording e starts, or NULL to describe e on its own
+static void write_file_json(jsonw_t *w, const catalog_entry_t *e, const group_t *g)
+{
+    char timebuf[32];
+    jsonw_object_begin(w);
+    jsonw_field_string(w, "name", e->name);
+    jsonw_field_int(w, "size", g ? g->size : e->size);
+    format_time(e->mtime, timebuf, sizeof(timebuf));
+    jsonw_field_string(w, "modified", timebuf);
+    format_time(e->start_time, timebuf, sizeof(timebuf));
+    jsonw_field_string(w, "start", timebuf);
+    jsonw_field_fixed(w, "duration", (double)(g ? g->total : e->samples) / AUDIO_SAMPLE_RATE, 2);
+    jsonw_field_string(w, "codec", e->codec == CATALOG_CODEC_ULAW ? "ulaw" : "pcm16");
+    jsonw_field_int(w, "peak", g ? g->peak : e->peak);
+    jsonw_field_int(w, "rms", g ? g->rms : e->rms);
+    jsonw_field_bool(w, "has_waveform", (e->flags & CATALOG_F_WAVEFORM) != 0);
+    if (e->flags & CATALOG_F_ACTIVE) jsonw_field_bool(w, "active", true);
+    if (g) jsonw_field_int(w, "parts", g->parts);
+    jsonw_object_end(w);
+}
 
-        // Clamp
-        if (range_start < 0) range_start = 0;
-        if (range_end >= total_size) range_end = total_size - 1;
-        if (range_start > range_end) {
-            fclose(f);
-            httpd_resp_set_status(req, "416 Range Not Satisfiable");
-            httpd_resp_send(req, NULL, 0);
-            return ESP_FAIL;
-        }
+// Entry as listed: with groups, a recording split into parts is described
+// as a whole under the name of its first part
+static void write_listed_json(jsonw_t *w, const catalog_entry_t *e, group_t *g)
+{
+    if (g && group_resolve(e->name, g) == ESP_OK && g->parts > 1)
+        write_file_json(w, e, g);
+    else
+        write_file_json(w, e, NULL);
+}
 
-        long content_length = range_end - range_start + 1;
-
-        static char cr_buf[80];
-        snprintf(cr_buf, sizeof(cr_buf), "bytes %ld-%ld/%ld", range_start, range_end, total_size);
-        httpd_resp_set_hdr(req, "Content-Range", cr_buf);
-
-        static char cl_buf[24];
-        snprintf(cl_buf, sizeof(cl_buf), "%ld", content_length);
-        httpd_resp_set_hdr(req, "Content-Length", cl_buf);
-
-        httpd_resp_set_status(req, "206 Partial Content");
-
-        fseek(f, range_start, SEEK_SET);
-        char buf[1024];
-        long remaining = content_length;
-        while (remaining > 0) {
-            size_t to_read = (remaining < (long)sizeof(buf)) ? (size_t)remaining : sizeof(buf);
-            size_t n = fread(buf, 1, to_read, f);
-            if (n == 0) break;
-            if (httpd_resp_send_chunk(req, buf, n) != ESP_OK) {
-                fclose(f);
-                httpd_resp_send_chunk(req, NULL, 0);
-                return ESP_FAIL;
-            }
-            remaining -= n;
+static catalog_sort_t parse_sort(const char *s)
+{
+    if (strcmp(s, "size") == 0)     return CATALOG_SORT_SIZE;
+    if (strcmp(s, "duration") == 0) return CATALOG_SORT_DURATION;
+    if (strcmp(s, "loudness") == 0 || strcmp(s, "rms") == 0) return CATALOG_SORT_RMS;
+    if (strcmp(s, "peak") == 0)     return CATALOG_SORT_PEAK;
+    if (strcmp(s, "name") == 0)     return CATALOG_SORT_NAME;
+    return CATALOG_SORT_TIME;
+}
+
+// GET /api/files                 -> [ {...}, ... ] in catalogue order
+// GET /api/files?offset=&limit=&sort=time|size|duration|loudness|peak|name
+//                &order=asc|desc&from=&to=&groups=1
+//                                -> {"total":N,"offset":O,"limit":L,"files":[...]}
+// from/to are unix times bounding the recording start. With groups=1 a
+// recording split into parts is one entry (its first part's name, sizes
+// and duration of all parts, "parts": N); sorting uses the first part. Served from the
+// catalogue and streamed; memory use does not depend on how many recordings
+// there are.
+static esp_err_t api_files_handler(httpd_req_t *req)
+{
+    catalog_query_t q = { .sort = CATALOG_SORT_TIME, .descending = true };
+    int offset = 0, limit = FILES_PAGE_DEFAULT;
+    bool paged = false;
+
+    char qbuf[160];
+    if (httpd_req_get_url_query_str(req, qbuf, sizeof(qbuf)) == ESP_OK) {
+        char param[24];
+        if (httpd_query_key_value(qbuf, "offset", param, sizeof(param)) == ESP_OK) {
+            offset = atoi(param);
+            paged = true;
         }
-        fclose(f);
-        httpd_resp_send_chunk(req, NULL, 0);
-        return ESP_OK;
+        if (httpd_query_key_value(qbuf, "limit", param, sizeof(param)) == ESP_OK) {
+            limit = atoi(param);
+            paged = true;
+        }
+        if (httpd_query_key_value(qbuf, "sort", param, sizeof(param)) == ESP_OK) {
+            q.sort = parse_sort(param);
+            paged = true;
+        }
+        if (httpd_query_key_value(qbuf, "order", param, sizeof(param)) == ESP_OK) {
+            q.descending = strcmp(param, "asc") != 0;
+            paged = true;
+        }
+        if (httpd_query_key_value(qbuf, "from", param, sizeof(param)) == ESP_OK) {
+            q.from = atoll(param);
+            paged = true;
+        }
+        if (httpd_query_key_value(qbuf, "to", param, sizeof(param)) == ESP_OK) {
+            q.to = atoll(param);
+            paged = true;
+        }
+        if (httpd_query_key_value(qbuf, "groups", param, sizeof(param)) == ESP_OK) {
+            q.groups = strcmp(param, "0") != 0;
+        }
+    }
+    if (offset < 0) offset = 0;
+    if (limit < 1 || limit > FILES_PAGE_MAX) limit = FILES_PAGE_MAX;
+
+    size_t batch_cap = paged ? (size_t)limit : FILES_BATCH;
+    catalog_entry_t *batch = heap_caps_malloc(batch_cap * sizeof(catalog_entry_t), MALLOC_CAP_SPIRAM);
+    group_t *g = q.groups ? heap_caps_malloc(sizeof(group_t), MALLOC_CAP_SPIRAM) : NULL;
+    if (!batch || (q.groups && !g)) {
+        heap_caps_free(batch);
+        heap_caps_free(g);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
     }
 
-    // No Range header — stream entire file
-    char buf[1024];
-    size_t n;
-    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
-        if (httpd_resp_send_chunk(req, buf, n) != ESP_OK) {
-            fclose(f);
-            httpd_resp_send_chunk(req, NULL, 0);
-            return ESP_FAIL;
+    char jbuf[JSON_BUF_SIZE];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+
+    if (paged) {
+        size_t total = 0;
+        size_t n = catalog_query(&q, offset, batch, limit, &total);
+        jsonw_object_begin(&w);
+        jsonw_field_int(&w, "total", total);
+        jsonw_field_int(&w, "offset", offset);
+        jsonw_field_int(&w, "limit", limit);
+        jsonw_key(&w, "files");
+        jsonw_array_begin(&w);
+        for (size_t i = 0; i < n; i++) write_listed_json(&w, &batch[i], g);
+        jsonw_array_end(&w);
+        jsonw_object_end(&w);
+    } else {
+        // Everything, a batch at a time in catalogue order
+        catalog_query_t all = { .sort = CATALOG_SORT_NONE, .groups = q.groups };
+        size_t pos = 0, n;
+        jsonw_array_begin(&w);
+        while (!w.err && (n = catalog_query(&all, pos, batch, FILES_BATCH, NULL)) > 0) {
+            for (size_t i = 0; i < n; i++) write_listed_json(&w, &batch[i], g);
+            pos += n;
         }
+        jsonw_array_end(&w);
     }
-    fclose(f);
-    httpd_resp_send_chunk(req, NULL, 0);
-    return ESP_OK;
+
+    heap_caps_free(batch);
+    heap_caps_free(g);
+    return json_end(&w, req);
 }
 
-static esp_err_t api_file_delete_handler(httpd_req_t *req)
+static esp_err_t api_file_download_handler(httpd_req_t *req)
 {
+    // URI: /api/files/<filename>
     const char *filename = req->uri + strlen("/api/files/");
     if (!filename || strlen(filename) == 0) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No filename");
         return ESP_FAIL;
     }
 
-    char path[128];
+    char path[280];
     snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, filename);
 
-    if (unlink(path) != 0) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
         return ESP_FAIL;
     }
+    long total_size = st.st_size;
+
+    uint64_t range_start, range_end;
+    int ranged = parse_range(req, total_size, &range_start, &range_end);
+    if (ranged < 0) return send_416(req);
+    if (ranged) {
+        char cr_buf[80];
+        snprintf(cr_buf, sizeof(cr_buf), "bytes %ld-%ld/%ld",
+                 (long)range_start, (long)range_end - 1, total_size);
+        return send_file_body(req, path, range_start, range_end - range_start, NULL, 0, cr_buf);
+    }
+
+    return send_file_body(req, path, 0, total_size, NULL, 0, NULL);
+}
+
+static bool is_active(const char *filename)
+{
+    catalog_entry_t e;
+    return catalog_get(filename, &e) && (e.flags & CATALOG_F_ACTIVE);
+}
+
+static esp_err_t delete_recording(const char *filename)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, filename);
+    if (unlink(path) != 0) return ESP_ERR_NOT_FOUND;
 
     waveform_delete_cache(filename);
-    httpd_resp_sendstr(req, "OK");
+    if (events_is_container(filename)) events_delete_index(filename);
+    catalog_remove(filename);
     return ESP_OK;
 }
 
-static esp_err_t api_auto_handler(httpd_req_t *req)
+// DELETE /api/files/<name>[?group=1] -- with group=1, every part of the
+// split recording name belongs to
+static esp_err_t api_file_delete_handler(httpd_req_t *req)
 {
-    extern void main_set_auto_mode(bool enabled);
-    extern void main_set_auto_threshold(uint16_t thr);
-    extern bool main_auto_mode(void);
-    extern uint16_t main_auto_threshold(void);
-
-    char buf[128];
-    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (len <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No body");
+    char filename[CATALOG_NAME_LEN * 3];
+    snprintf(filename, sizeof(filename), "%s", req->uri + strlen("/api/files/"));
+    char *q = strchr(filename, '?');
+    if (q) *q = '\0';
+    if (filename[0] == '\0') {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No filename");
         return ESP_FAIL;
     }
-    buf[len] = '\0';
 
-    cJSON *json = cJSON_Parse(buf);
-    if (!json) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-        return ESP_FAIL;
+    char qbuf[32], param[8];
+    group_t *g = NULL;
+    if (httpd_req_get_url_query_str(req, qbuf, sizeof(qbuf)) == ESP_OK &&
+        httpd_query_key_value(qbuf, "group", param, sizeof(param)) == ESP_OK &&
+        strcmp(param, "0") != 0) {
+        g = heap_caps_malloc(sizeof(group_t), MALLOC_CAP_SPIRAM);
+        if (g && group_resolve(filename, g) != ESP_OK) {
+            heap_caps_free(g);
+            g = NULL;
+        }
     }
 
-    cJSON *enabled = cJSON_GetObjectItem(json, "enabled");
-    if (enabled && cJSON_IsBool(enabled)) {
-        main_set_auto_mode(cJSON_IsTrue(enabled));
+    // Parts still open for writing stay until the recording stops
+    bool active = !g && is_active(filename);
+    for (int i = g ? g->parts : 0; i >= 1 && !active; i--) {
+        char name[CATALOG_NAME_LEN];
+        group_part_name(g, i, name, sizeof(name));
+        active = is_active(name);
+    }
+    if (active) {
+        heap_caps_free(g);
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "Recording in progress");
+        return ESP_OK;
     }
 
-    cJSON *threshold = cJSON_GetObjectItem(json, "threshold");
-    if (threshold && cJSON_IsNumber(threshold)) {
-        main_set_auto_threshold((uint16_t)threshold->valueint);
+    esp_err_t err;
+    if (g) {
+        // Last part first, so an interrupted delete leaves a shorter group
+        err = ESP_OK;
+        for (int i = g->parts; i >= 1; i--) {
+            char name[CATALOG_NAME_LEN];
+            group_part_name(g, i, name, sizeof(name));
+            if (delete_recording(name) != ESP_OK) err = ESP_ERR_NOT_FOUND;
+        }
+        heap_caps_free(g);
+    } else {
+        err = delete_recording(filename);
     }
 
-    cJSON_Delete(json);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_FAIL;
+    }
+    httpd_resp_sendstr(req, "OK");
+    return ESP_OK;
+}
 
-    // Return current state
-    cJSON *resp = cJSON_CreateObject();
-    cJSON_AddBoolToObject(resp, "auto_mode", main_auto_mode());
-    cJSON_AddNumberToObject(resp, "auto_threshold", main_auto_threshold());
-    char *json_str = cJSON_PrintUnformatted(resp);
-    cJSON_Delete(resp);
+static esp_err_t api_auto_handler(httpd_req_t *req)
+{
+    extern bool main_set_auto_mode(bool enabled);
+    extern bool main_set_auto_threshold(uint16_t thr);
+    extern bool main_auto_mode(void);
+    extern uint16_t main_auto_threshold(void);
+    extern bool main_set_preroll_seconds(uint8_t sec);
+    extern uint8_t main_preroll_seconds(void);
+    extern bool main_set_vad_mode(const char *mode);
+    extern const char *main_vad_mode_str(void);
+    extern bool main_set_silence_seconds(uint16_t sec);
+    extern uint16_t main_silence_seconds(void);
+    extern bool main_set_min_event_ms(uint16_t ms);
+    extern uint16_t main_min_event_ms(void);
+    extern bool main_set_event_container(bool v);
+    extern bool main_event_container(void);
+
+    char buf[192];
+    jsonr_t json;
+    if (json_recv(req, buf, sizeof(buf), &json) != ESP_OK) return ESP_FAIL;
+
+    // Check every value before applying any, so a rejected request
+    // changes nothing
+    static const char *const counts[] = { "threshold", "preroll", "silence_s", "min_event_ms" };
+    int v;
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        if (jsonr_get_int(&json, counts[i], &v) && v < 0) {
+            char msg[48];
+            snprintf(msg, sizeof(msg), "%s must not be negative", counts[i]);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, msg);
+            return ESP_FAIL;
+        }
+    }
+    const char *vad = NULL;
+    if (jsonr_get_string(&json, "vad", &vad) &&
+        strcmp(vad, "rms") != 0 && strcmp(vad, "spectral") != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "vad must be rms or spectral");
+        return ESP_FAIL;
+    }
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
-    return ESP_OK;
+    bool b;
+    bool queued = true;
+    if (jsonr_get_bool(&json, "enabled", &b)) {
+        queued &= main_set_auto_mode(b);
+    }
+    if (jsonr_get_int(&json, "threshold", &v)) {
+        queued &= main_set_auto_threshold((uint16_t)(v > 65535 ? 65535 : v));
+    }
+    if (jsonr_get_int(&json, "preroll", &v)) {
+        queued &= main_set_preroll_seconds((uint8_t)(v > 255 ? 255 : v));
+    }
+    if (jsonr_get_int(&json, "silence_s", &v)) {
+        queued &= main_set_silence_seconds((uint16_t)(v > 65535 ? 65535 : v));
+    }
+    if (jsonr_get_int(&json, "min_event_ms", &v)) {
+        queued &= main_set_min_event_ms((uint16_t)(v > 65535 ? 65535 : v));
+    }
+    if (jsonr_get_bool(&json, "container", &b)) {
+        queued &= main_set_event_container(b);
+    }
+    if (vad) {
+        queued &= main_set_vad_mode(vad);  // checked above
+    }
+    if (!queued) return send_busy(req);
+
+    // Return the settings as requested; the audio task applies them at
+    // its next frame
+    char jbuf[256];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_bool(&w, "auto_mode", main_auto_mode());
+    jsonw_field_int(&w, "auto_threshold", main_auto_threshold());
+    jsonw_field_int(&w, "preroll", main_preroll_seconds());
+    jsonw_field_string(&w, "vad", main_vad_mode_str());
+    jsonw_field_int(&w, "silence_s", main_silence_seconds());
+    jsonw_field_int(&w, "min_event_ms", main_min_event_ms());
+    jsonw_field_bool(&w, "container", main_event_container());
+    jsonw_object_end(&w);
+    return json_end(&w, req);
 }
 
 static esp_err_t api_codec_handler(httpd_req_t *req)
 {
     extern bool main_use_ulaw(void);
-    extern void main_set_use_ulaw(bool v);
+    extern bool main_set_use_ulaw(bool v);
 
     char buf[64];
-    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (len <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No body");
-        return ESP_FAIL;
-    }
-    buf[len] = '\0';
+    jsonr_t json;
+    if (json_recv(req, buf, sizeof(buf), &json) != ESP_OK) return ESP_FAIL;
 
-    cJSON *json = cJSON_Parse(buf);
-    if (!json) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-        return ESP_FAIL;
+    bool ulaw;
+    if (jsonr_get_bool(&json, "ulaw", &ulaw) && !main_set_use_ulaw(ulaw)) {
+        return send_busy(req);
     }
 
-    cJSON *ulaw = cJSON_GetObjectItem(json, "ulaw");
-    if (ulaw && cJSON_IsBool(ulaw)) {
-        main_set_use_ulaw(cJSON_IsTrue(ulaw));
-    }
-    cJSON_Delete(json);
-
-    cJSON *resp = cJSON_CreateObject();
-    cJSON_AddBoolToObject(resp, "ulaw", main_use_ulaw());
-    char *json_str = cJSON_PrintUnformatted(resp);
-    cJSON_Delete(resp);
-
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
-    return ESP_OK;
+    char jbuf[64];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_bool(&w, "ulaw", main_use_ulaw());
+    jsonw_object_end(&w);
+    return json_end(&w, req);
 }
 
 static esp_err_t api_filter_handler(httpd_req_t *req)
 {
-    char buf[64];
-    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (len <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No body");
-        return ESP_FAIL;
-    }
-    buf[len] = '\0';
+    extern bool main_set_filter(uint16_t hp, uint16_t lp);
 
-    cJSON *json = cJSON_Parse(buf);
-    if (!json) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-        return ESP_FAIL;
-    }
+    char buf[64];
+    jsonr_t json;
+    if (json_recv(req, buf, sizeof(buf), &json) != ESP_OK) return ESP_FAIL;
 
     uint16_t hp = audio_get_hp_freq();
     uint16_t lp = audio_get_lp_freq();
 
-    cJSON *jhp = cJSON_GetObjectItem(json, "hp");
-    if (jhp && cJSON_IsNumber(jhp)) {
-        int v = jhp->valueint;
+    int v;
+    if (jsonr_get_int(&json, "hp", &v)) {
         if (v == 0 || (v >= 50 && v <= 2000)) hp = (uint16_t)v;
     }
-    cJSON *jlp = cJSON_GetObjectItem(json, "lp");
-    if (jlp && cJSON_IsNumber(jlp)) {
-        int v = jlp->valueint;
+    if (jsonr_get_int(&json, "lp", &v)) {
         if (v == 0 || (v >= 2000 && v <= 9500)) lp = (uint16_t)v;
     }
-    cJSON_Delete(json);
 
-    audio_set_filter(hp, lp);
+    // Persisted here, applied to the filters by the audio task
+    if (!main_set_filter(hp, lp)) return send_busy(req);
+
+    char jbuf[64];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_int(&w, "filter_hp", hp);
+    jsonw_field_int(&w, "filter_lp", lp);
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
 
-    // Persist filter settings to NVS
-    {
-        nvs_handle_t nvs_h;
-        if (nvs_open("settings", NVS_READWRITE, &nvs_h) == ESP_OK) {
-            nvs_set_u16(nvs_h, "filter_hp", hp);
-            nvs_set_u16(nvs_h, "filter_lp", lp);
-            nvs_commit(nvs_h);
-            nvs_close(nvs_h);
-        }
+// --- Dashcam ring ---
+
+static esp_err_t send_dashcam_state(httpd_req_t *req)
+{
+    char jbuf[128];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_bool(&w, "enabled", dashcam_enabled());
+    jsonw_field_int(&w, "minutes", dashcam_minutes());
+    jsonw_field_int(&w, "segment_s", DASHCAM_SEG_SECONDS);
+    jsonw_field_int(&w, "available_s", dashcam_available_seconds());
+    jsonw_field_int(&w, "dropped", dashcam_dropped_samples());
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
+
+static esp_err_t api_dashcam_get_handler(httpd_req_t *req)
+{
+    return send_dashcam_state(req);
+}
+
+static esp_err_t api_dashcam_post_handler(httpd_req_t *req)
+{
+    char buf[64];
+    jsonr_t json;
+    if (json_recv(req, buf, sizeof(buf), &json) != ESP_OK) return ESP_FAIL;
+
+    bool enabled = dashcam_enabled();
+    int minutes = dashcam_minutes();
+    jsonr_get_bool(&json, "enabled", &enabled);
+    jsonr_get_int(&json, "minutes", &minutes);
+
+    dashcam_configure(enabled, minutes);
+    return send_dashcam_state(req);
+}
+
+// Worker: the ring task may take a while to get to the save and rename
+// every segment, so the server does not wait for it
+static esp_err_t dashcam_save_job(httpd_req_t *req, void *arg)
+{
+    uint32_t seconds = *(uint32_t *)arg;
+    char name[64] = "";
+    int parts = 0;
+    esp_err_t ret = dashcam_save(seconds, name, sizeof(name), &parts);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Ring is empty");
+        return ESP_FAIL;
+    } else if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Save failed");
+        return ESP_FAIL;
     }
 
-    cJSON *resp = cJSON_CreateObject();
-    cJSON_AddNumberToObject(resp, "filter_hp", audio_get_hp_freq());
-    cJSON_AddNumberToObject(resp, "filter_lp", audio_get_lp_freq());
-    char *json_str = cJSON_PrintUnformatted(resp);
-    cJSON_Delete(resp);
+    char jbuf[128];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_string(&w, "file", name);
+    jsonw_field_int(&w, "parts", parts);
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
+static esp_err_t api_dashcam_save_handler(httpd_req_t *req)
+{
+    // Optional body {"seconds": N}; default and upper bound is the whole ring
+    uint32_t seconds = dashcam_minutes() * 60;
+    char buf[64];
+    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (len > 0) {
+        buf[len] = '\0';
+        jsonr_t json;
+        int v;
+        if (jsonr_parse(&json, buf) == 0 && jsonr_get_int(&json, "seconds", &v) && v > 0 &&
+            (uint32_t)v < seconds) seconds = v;
+    }
+
+    esp_err_t err = workers_submit(req, dashcam_save_job, &seconds, sizeof(seconds));
+    if (err == ESP_ERR_NO_MEM) return send_busy(req);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start save");
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
@@ -473,45 +955,468 @@ static esp_err_t api_waveform_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    // Try reading from cache first
     uint16_t peaks[WAVEFORM_BINS];
-    if (waveform_read_cache(filename, peaks) != ESP_OK) {
-        // Cache miss — generate now (fallback)
-        if (waveform_generate(filename) != ESP_OK) {
-            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Cannot process file");
+    char param[8];
+    if (httpd_query_key_value(qbuf, "group", param, sizeof(param)) == ESP_OK && strcmp(param, "0") != 0) {
+        // The whole split recording, from the parts' caches
+        group_t *g = heap_caps_malloc(sizeof(group_t), MALLOC_CAP_SPIRAM);
+        esp_err_t err = g ? group_resolve(filename, g) : ESP_ERR_NO_MEM;
+        if (err == ESP_OK) err = waveform_read_group(g, peaks);
+        heap_caps_free(g);
+        if (err == ESP_ERR_INVALID_STATE) return send_busy(req);
+        if (err != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Cannot process recording");
             return ESP_FAIL;
         }
-        if (waveform_read_cache(filename, peaks) != ESP_OK) {
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cache read failed");
+    } else if (waveform_read_cache(filename, peaks) != ESP_OK) {
+        // Cache miss: a scan can take seconds (minutes for a day's
+        // container), so it runs on the background task and the client retries
+        catalog_entry_t e;
+        if (!catalog_get(filename, &e)) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
             return ESP_FAIL;
         }
+        waveform_request(filename);
+        return send_busy(req);
     }
 
-    // Build JSON array
-    cJSON *arr = cJSON_CreateArray();
+    char jbuf[WAVEFORM_BINS * 6 + 4];  // up to 5 digits and a comma per bin
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_array_begin(&w);
     for (int i = 0; i < WAVEFORM_BINS; i++) {
-        cJSON_AddItemToArray(arr, cJSON_CreateNumber(peaks[i]));
+        jsonw_int(&w, peaks[i]);
     }
+    jsonw_array_end(&w);
+    return json_end(&w, req);
+}
 
-    char *json_str = cJSON_PrintUnformatted(arr);
-    cJSON_Delete(arr);
+// --- Event containers ---
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
+#define EVENTS_PAGE_MAX 200
+
+// Sample format of a container, from its header
+static esp_err_t container_format(const char *name, bool *ulaw, uint32_t *data_size)
+{
+    char path[280];
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) return ESP_ERR_NOT_FOUND;
+    uint8_t hdr[WAV_HEADER_SIZE];
+    size_t got = fread(hdr, 1, sizeof(hdr), f);
+    fclose(f);
+    if (got != sizeof(hdr) || memcmp(hdr, "RIFF", 4) != 0) return ESP_ERR_INVALID_SIZE;
+    *ulaw = (hdr[20] == 7);
+    *data_size = hdr[40] | (hdr[41] << 8) | (hdr[42] << 16) | ((uint32_t)hdr[43] << 24);
+    return ESP_OK;
+}
+
+static void write_event_json(jsonw_t *w, int index, const event_rec_t *ev, int bps)
+{
+    jsonw_object_begin(w);
+    jsonw_field_int(w, "i", index);
+    jsonw_field_int(w, "start", ev->start_sample);
+    jsonw_field_int(w, "samples", ev->num_samples);
+    jsonw_field_double(w, "duration", (double)ev->num_samples / AUDIO_SAMPLE_RATE);
+    jsonw_field_int(w, "peak", ev->peak);
+    // Byte range inside the container, for Range requests on /api/files
+    jsonw_field_int(w, "offset", WAV_HEADER_SIZE + (int64_t)ev->start_sample * bps);
+    jsonw_field_int(w, "length", (int64_t)ev->num_samples * bps);
+
+    char timebuf[32];
+    format_time(ev->wall_time, timebuf, sizeof(timebuf));
+    jsonw_field_string(w, "time", timebuf);
+    jsonw_object_end(w);
+}
+
+// GET /api/events                      -> containers with event counts
+// GET /api/events?file=X[&offset=&limit=] -> events of one container
+static esp_err_t api_events_list_handler(httpd_req_t *req)
+{
+    char qbuf[256];
+    char filename[128] = "";
+    int offset = 0, limit = EVENTS_PAGE_MAX;
+
+    if (httpd_req_get_url_query_str(req, qbuf, sizeof(qbuf)) == ESP_OK) {
+        char param[128];
+        if (httpd_query_key_value(qbuf, "file", param, sizeof(param)) == ESP_OK) {
+            url_decode(param);
+            strncpy(filename, param, sizeof(filename) - 1);
+        }
+        if (httpd_query_key_value(qbuf, "offset", param, sizeof(param)) == ESP_OK) {
+            offset = atoi(param);
+        }
+        if (httpd_query_key_value(qbuf, "limit", param, sizeof(param)) == ESP_OK) {
+            limit = atoi(param);
+        }
+    }
+    if (offset < 0) offset = 0;
+    if (limit < 1 || limit > EVENTS_PAGE_MAX) limit = EVENTS_PAGE_MAX;
+
+    char jbuf[JSON_BUF_SIZE];
+    jsonw_t w;
+
+    if (filename[0] == '\0') {
+        catalog_query_t all = { .sort = CATALOG_SORT_NONE };
+        catalog_entry_t batch[8];
+        size_t pos = 0, n;
+        json_begin(&w, jbuf, sizeof(jbuf), req);
+        jsonw_array_begin(&w);
+        while (!w.err && (n = catalog_query(&all, pos, batch, 8, NULL)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                if (!(batch[i].flags & CATALOG_F_CONTAINER)) continue;
+                jsonw_object_begin(&w);
+                jsonw_field_string(&w, "name", batch[i].name);
+                jsonw_field_int(&w, "events", events_count(batch[i].name));
+                jsonw_object_end(&w);
+            }
+            pos += n;
+        }
+        jsonw_array_end(&w);
+        return json_end(&w, req);
+    }
+
+    bool ulaw;
+    uint32_t data_size;
+    if (!events_is_container(filename) || container_format(filename, &ulaw, &data_size) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such container");
+        return ESP_FAIL;
+    }
+
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_string(&w, "file", filename);
+    jsonw_field_int(&w, "total", events_count(filename));
+    jsonw_field_int(&w, "offset", offset);
+    jsonw_key(&w, "events");
+    jsonw_array_begin(&w);
+
+    // Index records a few at a time, straight into the response
+    event_rec_t recs[16];
+    int done = 0;
+    while (done < limit && !w.err) {
+        int want = limit - done;
+        if (want > 16) want = 16;
+        int n = events_read(filename, offset + done, recs, want);
+        for (int i = 0; i < n; i++) {
+            write_event_json(&w, offset + done + i, &recs[i], ulaw ? 1 : 2);
+        }
+        done += n;
+        if (n < want) break;
+    }
+
+    jsonw_array_end(&w);
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
+
+// GET /api/export?from=&to= or ?files=a.wav,b.wav -> the recordings as one
+// tar (see export.h). With neither, the whole card. Content-Length is known
+// up front; Range with If-Range (the ETag) resumes an interrupted export.
+typedef struct {
+    catalog_entry_t *files;
+    size_t n;
+    uint64_t start, end;
+    int head_len;
+    char head[384];
+} export_job_t;
+
+static esp_err_t export_job(httpd_req_t *req, void *arg)
+{
+    export_job_t *job = *(export_job_t **)arg;
+    esp_err_t err = ESP_FAIL;
+    if (dl_send_sock(req, (const uint8_t *)job->head, job->head_len) == 0)
+        err = export_send(job->files, job->n, job->start, job->end, dl_send_sock, req);
+    if (err != ESP_OK) httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+    ESP_LOGI(TAG, "Export of %u files, bytes %llu-%llu: %s", (unsigned)job->n,
+             (unsigned long long)job->start, (unsigned long long)job->end, esp_err_to_name(err));
+    heap_caps_free(job->files);
+    free(job);
+    return err;
+}
+
+static esp_err_t api_export_handler(httpd_req_t *req)
+{
+    int64_t from = 0, to = 0;
+    char *names = NULL;
+
+    size_t qlen = httpd_req_get_url_query_len(req);
+    char *qbuf = qlen ? malloc(qlen + 1) : NULL;
+    if (qbuf && httpd_req_get_url_query_str(req, qbuf, qlen + 1) == ESP_OK) {
+        char param[24];
+        if (httpd_query_key_value(qbuf, "from", param, sizeof(param)) == ESP_OK) from = atoll(param);
+        if (httpd_query_key_value(qbuf, "to", param, sizeof(param)) == ESP_OK) to = atoll(param);
+        names = malloc(qlen + 1);
+        if (names && httpd_query_key_value(qbuf, "files", names, qlen + 1) == ESP_OK) {
+            url_decode(names);
+        } else {
+            free(names);
+            names = NULL;
+        }
+    }
+    free(qbuf);
+
+    export_job_t *job = calloc(1, sizeof(export_job_t));
+    esp_err_t err = job ? export_manifest(names, from, to, &job->files, &job->n) : ESP_ERR_NO_MEM;
+    free(names);
+    if (err != ESP_OK || job->n == 0) {
+        if (job) heap_caps_free(job->files);
+        free(job);
+        if (err == ESP_ERR_NOT_FOUND || err == ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, err == ESP_OK ? "Nothing to export" : "No such file");
+        } else if (err == ESP_ERR_INVALID_SIZE) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Too many files, narrow the selection");
+        } else {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        }
+        return ESP_FAIL;
+    }
+
+    uint64_t total = export_size(job->files, job->n);
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%08lx-%llx\"", (unsigned long)export_tag(job->files, job->n),
+             (unsigned long long)total);
+    job->start = 0;
+    job->end = total;
+
+    // A Range only applies to the archive the client started on
+    char if_range[40];
+    int ranged = 0;
+    if (httpd_req_get_hdr_value_str(req, "If-Range", if_range, sizeof(if_range)) != ESP_OK ||
+        strcmp(if_range, etag) == 0) {
+        ranged = parse_range(req, total, &job->start, &job->end);
+    }
+    if (ranged < 0) {
+        heap_caps_free(job->files);
+        free(job);
+        return send_416(req);
+    }
+
+    char range_line[80] = "";
+    if (ranged) {
+        snprintf(range_line, sizeof(range_line), "Content-Range: bytes %llu-%llu/%llu\r\n",
+                 (unsigned long long)job->start, (unsigned long long)job->end - 1,
+                 (unsigned long long)total);
+    }
+    char from_tag[24] = "";  // recordings.tar, or recordings-<from>.tar for a day
+    if (from) snprintf(from_tag, sizeof(from_tag), "-%lld", (long long)from);
+    job->head_len = snprintf(job->head, sizeof(job->head),
+                             "HTTP/1.1 %s\r\n"
+                             "Content-Type: application/x-tar\r\n"
+                             "Content-Length: %llu\r\n"
+                             "Content-Disposition: attachment; filename=\"recordings%s.tar\"\r\n"
+                             "Accept-Ranges: bytes\r\n"
+                             "ETag: %s\r\n"
+                             "%s"
+                             "\r\n",
+                             ranged ? "206 Partial Content" : "200 OK",
+                             (unsigned long long)(job->end - job->start),
+                             from_tag, etag, range_line);
+
+    err = workers_submit(req, export_job, &job, sizeof(job));
+    if (err != ESP_OK) {
+        heap_caps_free(job->files);
+        free(job);
+        if (err == ESP_ERR_NO_MEM) return send_busy(req);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start export");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// GET /api/clip?file=&start=&end= -> seconds [start, end) of a recording as
+// a WAV of its own: a synthesized header, then exactly those samples. A
+// recording split into parts (name_p2.wav, ...) is read as one, so a clip
+// may cross part boundaries; file may name any part. start defaults to 0,
+// end to the end of the recording. Supports Range so players can seek.
+typedef struct {
+    group_t g;
+    uint64_t first, count;      // samples
+    uint64_t start, end;        // bytes of the clip's WAV
+    int head_len;
+    char head[320];
+} clip_job_t;
+
+static esp_err_t clip_job(httpd_req_t *req, void *arg)
+{
+    clip_job_t *job = *(clip_job_t **)arg;
+    esp_err_t err = group_send_wav(&job->g, job->first, job->count, job->start, job->end,
+                                   job->head, job->head_len, dl_send_sock, req);
+    if (err == ESP_ERR_TIMEOUT) {
+        send_busy(req);
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Part missing");
+    } else if (err != ESP_OK) {
+        httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+    }
+    free(job);
+    return err;
+}
+
+static esp_err_t api_clip_handler(httpd_req_t *req)
+{
+    char qbuf[160];
+    char name[CATALOG_NAME_LEN * 3] = "";
+    double start_s = 0, end_s = -1;
+    if (httpd_req_get_url_query_str(req, qbuf, sizeof(qbuf)) == ESP_OK) {
+        char param[24];
+        if (httpd_query_key_value(qbuf, "file", name, sizeof(name)) == ESP_OK) url_decode(name);
+        if (httpd_query_key_value(qbuf, "start", param, sizeof(param)) == ESP_OK) start_s = strtod(param, NULL);
+        if (httpd_query_key_value(qbuf, "end", param, sizeof(param)) == ESP_OK) end_s = strtod(param, NULL);
+    }
+
+    clip_job_t *job = malloc(sizeof(clip_job_t));
+    if (!job) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    if (!name[0] || group_resolve(name, &job->g) != ESP_OK) {
+        free(job);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such recording");
+        return ESP_FAIL;
+    }
+
+    // Whole samples; a clip past the end is cut to what was recorded
+    uint64_t total = job->g.total;
+    uint64_t first = start_s > 0 ? (uint64_t)(start_s * AUDIO_SAMPLE_RATE + 0.5) : 0;
+    uint64_t last = end_s >= 0 ? (uint64_t)(end_s * AUDIO_SAMPLE_RATE + 0.5) : total;
+    if (last > total) last = total;
+    if (first >= last) {
+        free(job);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty clip");
+        return ESP_FAIL;
+    }
+    job->first = first;
+    job->count = last - first;
+
+    uint64_t size = group_wav_size(&job->g, job->count);
+    job->start = 0;
+    job->end = size;
+    int ranged = parse_range(req, size, &job->start, &job->end);
+    if (ranged < 0) {
+        free(job);
+        return send_416(req);
+    }
+
+    char range_line[80] = "";
+    if (ranged) {
+        snprintf(range_line, sizeof(range_line), "Content-Range: bytes %llu-%llu/%llu\r\n",
+                 (unsigned long long)job->start, (unsigned long long)job->end - 1,
+                 (unsigned long long)size);
+    }
+    job->head_len = snprintf(job->head, sizeof(job->head),
+                             "HTTP/1.1 %s\r\n"
+                             "Content-Type: audio/wav\r\n"
+                             "Content-Length: %llu\r\n"
+                             "Accept-Ranges: bytes\r\n"
+                             "X-Clip-Samples: %llu-%llu\r\n"
+                             "%s"
+                             "\r\n",
+                             ranged ? "206 Partial Content" : "200 OK",
+                             (unsigned long long)(job->end - job->start),
+                             (unsigned long long)first, (unsigned long long)last,
+                             range_line);
+
+    esp_err_t err = workers_submit(req, clip_job, &job, sizeof(job));
+    if (err != ESP_OK) {
+        free(job);
+        if (err == ESP_ERR_NO_MEM) return send_busy(req);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start clip");
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
+// GET /api/follow -> the recording in progress, streamed as it is written
+// (see follow.h). The transfer continues on a worker.
+static esp_err_t api_follow_handler(httpd_req_t *req)
+{
+    esp_err_t err = follow_begin(req);
+    if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not recording");
+        return ESP_FAIL;
+    }
+    if (err == ESP_ERR_NO_MEM) return send_busy(req);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot follow");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// GET /api/events/<container>/<index> -> the event as a standalone WAV:
+// a synthesized header followed by its byte range of the container.
+// Supports Range so players can seek.
+static esp_err_t api_event_get_handler(httpd_req_t *req)
+{
+    char name[128];
+    strncpy(name, req->uri + strlen("/api/events/"), sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    char *q = strchr(name, '?');
+    if (q) *q = '\0';
+    char *slash = strrchr(name, '/');
+    if (!slash) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Use /api/events/<file>/<index>");
+        return ESP_FAIL;
+    }
+    *slash = '\0';
+    int index = atoi(slash + 1);
+    url_decode(name);
+
+    bool ulaw;
+    uint32_t data_size;
+    event_rec_t ev;
+    if (!events_is_container(name) || container_format(name, &ulaw, &data_size) != ESP_OK ||
+        index < 0 || events_read(name, index, &ev, 1) != 1) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such event");
+        return ESP_FAIL;
+    }
+
+    int bps = ulaw ? 1 : 2;
+    uint32_t data_off = WAV_HEADER_SIZE + ev.start_sample * bps;
+    uint32_t data_len = ev.num_samples * bps;
+    if (data_off - WAV_HEADER_SIZE + data_len > data_size) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Event beyond end of container");
+        return ESP_FAIL;
+    }
+
+    uint8_t hdr[WAV_HEADER_SIZE];
+    wav_build_header(hdr, AUDIO_SAMPLE_RATE, ulaw, data_len);
+    long total = WAV_HEADER_SIZE + (long)data_len;
+    uint64_t r_start = 0, r_end = total;
+    int ranged = parse_range(req, total, &r_start, &r_end);
+    if (ranged < 0) return send_416(req);
+    long range_start = r_start, range_end = r_end - 1;
+    char cr_buf[80];
+    if (ranged) snprintf(cr_buf, sizeof(cr_buf), "bytes %ld-%ld/%ld", range_start, range_end, total);
+
+    // Header bytes first, then the slice of the container
+    long pos = range_start;
+    const uint8_t *prefix = NULL;
+    size_t prefix_len = 0;
+    if (pos < WAV_HEADER_SIZE) {
+        long n = WAV_HEADER_SIZE - pos;
+        if (n > range_end - pos + 1) n = range_end - pos + 1;
+        prefix = hdr + pos;
+        prefix_len = n;
+        pos += n;
+    }
+
+    char path[280];
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, name);
+    return send_file_body(req, path, data_off + (pos - WAV_HEADER_SIZE), range_end - pos + 1,
+                          prefix, prefix_len, ranged ? cr_buf : NULL);
+}
+
+// POST /api/rec/start or /api/rec/stop. Queued for the audio task and
+// answered at once; the outcome shows up in the status.
 static esp_err_t api_rec_handler(httpd_req_t *req)
 {
     if (s_cmd_cb) {
-        // POST /api/rec/start or /api/rec/stop
         const char *action = req->uri + strlen("/api/rec/");
-        if (strcmp(action, "start") == 0) {
-            s_cmd_cb("start_rec");
-        } else if (strcmp(action, "stop") == 0) {
-            s_cmd_cb("stop_rec");
-        }
+        const char *cmd = strcmp(action, "start") == 0 ? "start_rec" :
+                          strcmp(action, "stop") == 0  ? "stop_rec"  : NULL;
+        if (cmd && !s_cmd_cb(cmd, NULL, NULL)) return send_busy(req);
     }
     httpd_resp_sendstr(req, "OK");
     return ESP_OK;
@@ -519,133 +1424,224 @@ static esp_err_t api_rec_handler(httpd_req_t *req)
 
 static esp_err_t api_status_handler(httpd_req_t *req)
 {
-    cJSON *obj = cJSON_CreateObject();
+    char jbuf[JSON_BUF_SIZE];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+
+    // Recorder state: one consistent snapshot published by the audio task
+    status_snapshot_t st;
+    status_read(&st);
 
-    // SD free space
-    uint64_t free_bytes = sdcard_free_bytes();
-    cJSON_AddNumberToObject(obj, "sd_free_mb", (double)free_bytes / (1024 * 1024));
+    // SD free space (refreshed in the background)
+    jsonw_field_fixed(&w, "sd_free_mb", status_sd_free_kb() / 1024.0, 1);
 
     // WiFi mode and IP
     wifi_app_mode_t wmode = wifi_get_mode();
-    cJSON_AddStringToObject(obj, "wifi_mode",
+    jsonw_field_string(&w, "wifi_mode",
         wmode == WIFI_APP_MODE_STA ? "STA" :
         wmode == WIFI_APP_MODE_AP  ? "AP"  : "OFFLINE");
-    cJSON_AddStringToObject(obj, "wifi_ssid", wifi_get_ssid());
-    cJSON_AddStringToObject(obj, "wifi_ip", wifi_get_ip());
+    jsonw_field_string(&w, "wifi_ssid", wifi_get_ssid());
+    jsonw_field_string(&w, "wifi_ip", wifi_get_ip());
 
     // WiFi RSSI (only in STA mode)
     if (wmode == WIFI_APP_MODE_STA) {
         wifi_ap_record_t ap_info;
         if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
-            cJSON_AddNumberToObject(obj, "rssi", ap_info.rssi);
+            jsonw_field_int(&w, "rssi", ap_info.rssi);
         }
     }
 
-    // Recording state -- provided by main.c via getters
-    extern bool main_is_recording(void);
-    extern const char *main_rec_filename(void);
-    extern const char *main_rec_start_time(void);
-    extern const char *main_rec_source_str(void);
-    extern uint16_t main_current_rms(void);
-    extern bool main_auto_mode(void);
-    extern uint16_t main_auto_threshold(void);
-    extern bool main_use_ulaw(void);
-    extern float main_current_zcr(void);
-
-    bool rec = main_is_recording();
-    cJSON_AddBoolToObject(obj, "recording", rec);
-    if (rec) {
-        cJSON_AddStringToObject(obj, "filename", main_rec_filename());
-        const char *start_time = main_rec_start_time();
-        if (start_time[0]) {
-            cJSON_AddStringToObject(obj, "rec_started_at", start_time);
+    jsonw_field_bool(&w, "recording", st.recording);
+    if (st.recording) {
+        jsonw_field_string(&w, "filename", st.filename);
+        if (st.rec_started_at[0]) {
+            jsonw_field_string(&w, "rec_started_at", st.rec_started_at);
         }
-        cJSON_AddStringToObject(obj, "rec_source", main_rec_source_str());
+        jsonw_field_string(&w, "rec_source", status_source_str(st.rec_source));
     }
 
     // ADC overflow count
-    extern uint32_t audio_get_overflow_count(void);
-    cJSON_AddNumberToObject(obj, "adc_overflows", audio_get_overflow_count());
+    jsonw_field_int(&w, "adc_overflows", st.adc_overflows);
 
     // Auto-record state
-    cJSON_AddBoolToObject(obj, "auto_mode", main_auto_mode());
-    cJSON_AddNumberToObject(obj, "auto_threshold", main_auto_threshold());
-    cJSON_AddNumberToObject(obj, "current_rms", main_current_rms());
-    cJSON_AddBoolToObject(obj, "ulaw", main_use_ulaw());
-    cJSON_AddNumberToObject(obj, "current_zcr", (double)main_current_zcr());
+    jsonw_field_bool(&w, "auto_mode", st.auto_mode);
+    jsonw_field_int(&w, "auto_threshold", st.auto_threshold);
+    jsonw_field_int(&w, "preroll", st.preroll_s);
+    jsonw_field_int(&w, "silence_s", st.silence_s);
+    jsonw_field_int(&w, "min_event_ms", st.min_event_ms);
+    jsonw_field_bool(&w, "container", st.container);
+    jsonw_field_int(&w, "current_rms", st.rms);
+    jsonw_field_bool(&w, "ulaw", st.ulaw);
+    jsonw_field_fixed(&w, "current_zcr", st.zcr, 3);
+    jsonw_field_string(&w, "vad", st.vad_spectral ? "spectral" : "rms");
+    jsonw_field_bool(&w, "vad_voice", st.vad_voice);
+    jsonw_field_int(&w, "vad_us", st.vad_us);
+    jsonw_field_int(&w, "vad_us_max", st.vad_us_max);
 
     // Filter state
-    cJSON_AddNumberToObject(obj, "filter_hp", audio_get_hp_freq());
-    cJSON_AddNumberToObject(obj, "filter_lp", audio_get_lp_freq());
+    jsonw_field_int(&w, "filter_hp", st.filter_hp);
+    jsonw_field_int(&w, "filter_lp", st.filter_lp);
 
-    char *json_str = cJSON_PrintUnformatted(obj);
-    cJSON_Delete(obj);
+    // WebSocket status push interval (0 = off)
+    jsonw_field_int(&w, "push_ms", status_push_ms());
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
-    return ESP_OK;
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
+
+// POST /api/status {"push_ms": 500} -- interval of status messages on /ws
+static esp_err_t api_status_post_handler(httpd_req_t *req)
+{
+    char buf[64];
+    jsonr_t json;
+    if (json_recv(req, buf, sizeof(buf), &json) != ESP_OK) return ESP_FAIL;
+
+    int ms;
+    if (jsonr_get_int(&json, "push_ms", &ms)) {
+        if (ms < 0) ms = 0;
+        status_set_push_ms((uint16_t)(ms > STATUS_PUSH_MAX_MS ? STATUS_PUSH_MAX_MS : ms));
+    }
+
+    char jbuf[64];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_int(&w, "push_ms", status_push_ms());
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
+
+// GET /api/stream -- live audio fan-out counters
+static esp_err_t api_stream_handler(httpd_req_t *req)
+{
+    stream_client_stats_t st[STREAM_MAX_CLIENTS];
+    uint32_t frames_in, dropped_in;
+    int n = stream_stats(st, &frames_in, &dropped_in);
+
+    char jbuf[JSON_BUF_SIZE];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_int(&w, "budget_ms", stream_budget_ms());
+    jsonw_field_int(&w, "frames_in", frames_in);
+    jsonw_field_int(&w, "dropped_in", dropped_in);
+    jsonw_key(&w, "clients");
+    jsonw_array_begin(&w);
+    for (int i = 0; i < n; i++) {
+        jsonw_object_begin(&w);
+        jsonw_field_int(&w, "fd", st[i].fd);
+        jsonw_field_int(&w, "queued", st[i].queued);
+        jsonw_field_int(&w, "lag_ms", st[i].lag_ms);
+        jsonw_field_int(&w, "max_lag_ms", st[i].max_lag_ms);
+        jsonw_field_int(&w, "sent", st[i].sent);
+        jsonw_field_int(&w, "frames_sent", st[i].frames_sent);
+        jsonw_field_int(&w, "batch", st[i].batch);
+        jsonw_field_int(&w, "send_us", st[i].send_us);
+        jsonw_field_int(&w, "dropped", st[i].dropped);
+        jsonw_field_int(&w, "errors", st[i].errors);
+        jsonw_field_int(&w, "bytes", st[i].bytes);
+        jsonw_field_string(&w, "codec", st[i].framed ? stream_format_codec(st[i].format) : "raw");
+        jsonw_field_int(&w, "rate", stream_format_rate(st[i].format));
+        jsonw_object_end(&w);
+    }
+    jsonw_array_end(&w);
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
+
+// GET /api/workers -- pool that sends downloads and follow streams
+static esp_err_t api_workers_handler(httpd_req_t *req)
+{
+    workers_stats_t st;
+    workers_stats(&st);
+
+    char jbuf[JSON_BUF_SIZE];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_int(&w, "workers", WORKERS_COUNT);
+    jsonw_field_int(&w, "busy", st.busy);
+    jsonw_field_int(&w, "queue_size", WORKERS_QUEUE);
+    jsonw_field_int(&w, "queued", st.queued);
+    jsonw_field_int(&w, "peak_queued", st.peak_queued);
+    jsonw_field_int(&w, "submitted", st.submitted);
+    jsonw_field_int(&w, "rejected", st.rejected);
+    jsonw_field_int(&w, "completed", st.completed);
+    jsonw_field_int(&w, "failed", st.failed);
+    jsonw_field_int(&w, "wait_ms_avg", st.wait_ms_avg);
+    jsonw_field_int(&w, "wait_ms_max", st.wait_ms_max);
+    jsonw_field_int(&w, "run_ms_max", st.run_ms_max);
+    jsonw_object_end(&w);
+    return json_end(&w, req);
+}
+
+// POST /api/stream {"budget_ms": 100} -- most audio one live message may hold
+static esp_err_t api_stream_post_handler(httpd_req_t *req)
+{
+    char buf[64];
+    jsonr_t json;
+    if (json_recv(req, buf, sizeof(buf), &json) != ESP_OK) return ESP_FAIL;
+
+    int ms;
+    if (jsonr_get_int(&json, "budget_ms", &ms)) {
+        if (ms < STREAM_BATCH_MIN_MS) ms = STREAM_BATCH_MIN_MS;
+        stream_set_budget_ms((uint16_t)(ms > STREAM_BATCH_MAX_MS ? STREAM_BATCH_MAX_MS : ms));
+    }
+
+    char jbuf[64];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
+    jsonw_field_int(&w, "budget_ms", stream_budget_ms());
+    jsonw_object_end(&w);
+    return json_end(&w, req);
 }
 
 // --- WiFi API handlers ---
 
 static esp_err_t api_wifi_get_handler(httpd_req_t *req)
 {
-    cJSON *obj = cJSON_CreateObject();
+    char jbuf[512];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_object_begin(&w);
     wifi_app_mode_t m = wifi_get_mode();
-    cJSON_AddStringToObject(obj, "mode",
+    jsonw_field_string(&w, "mode",
         m == WIFI_APP_MODE_STA ? "STA" :
         m == WIFI_APP_MODE_AP  ? "AP"  : "OFFLINE");
-    cJSON_AddStringToObject(obj, "ssid", wifi_get_ssid());
-    cJSON_AddStringToObject(obj, "ip", wifi_get_ip());
+    jsonw_field_string(&w, "ssid", wifi_get_ssid());
+    jsonw_field_string(&w, "ip", wifi_get_ip());
 
     // Saved networks
     char ssids[5][33];
     int cnt = wifi_get_saved_ssids(ssids, 5);
-    cJSON *saved = cJSON_CreateArray();
+    jsonw_key(&w, "saved");
+    jsonw_array_begin(&w);
     for (int i = 0; i < cnt; i++) {
-        cJSON_AddItemToArray(saved, cJSON_CreateString(ssids[i]));
+        jsonw_string(&w, ssids[i]);
     }
-    cJSON_AddItemToObject(obj, "saved", saved);
+    jsonw_array_end(&w);
 
-    char *json_str = cJSON_PrintUnformatted(obj);
-    cJSON_Delete(obj);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
-    return ESP_OK;
+    jsonw_object_end(&w);
+    return json_end(&w, req);
 }
 
 static esp_err_t api_wifi_post_handler(httpd_req_t *req)
 {
     char buf[256];
-    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (len <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No body");
-        return ESP_FAIL;
-    }
-    buf[len] = '\0';
+    jsonr_t json;
+    if (json_recv(req, buf, sizeof(buf), &json) != ESP_OK) return ESP_FAIL;
 
-    cJSON *json = cJSON_Parse(buf);
-    if (!json) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-        return ESP_FAIL;
-    }
-
-    cJSON *jssid = cJSON_GetObjectItem(json, "ssid");
-    cJSON *jpass = cJSON_GetObjectItem(json, "pass");
-    if (!jssid || !cJSON_IsString(jssid) || strlen(jssid->valuestring) == 0) {
-        cJSON_Delete(json);
+    const char *ssid, *pass;
+    if (!jsonr_get_string(&json, "ssid", &ssid) || strlen(ssid) == 0) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing ssid");
         return ESP_FAIL;
     }
-
-    const char *ssid = jssid->valuestring;
-    const char *pass = (jpass && cJSON_IsString(jpass)) ? jpass->valuestring : "";
+    if (!jsonr_get_string(&json, "pass", &pass)) pass = "";
 
     // Send response before rebooting
     httpd_resp_sendstr(req, "OK, rebooting...");
-    cJSON_Delete(json);
 
     // Save and reboot (does not return)
     wifi_save_and_connect(ssid, pass);
@@ -662,22 +1658,20 @@ static esp_err_t api_wifi_scan_handler(httpd_req_t *req)
 
     uint16_t count = wifi_scan(results, 20);
 
-    cJSON *arr = cJSON_CreateArray();
+    char jbuf[JSON_BUF_SIZE];
+    jsonw_t w;
+    json_begin(&w, jbuf, sizeof(jbuf), req);
+    jsonw_array_begin(&w);
     for (int i = 0; i < count; i++) {
-        cJSON *ap = cJSON_CreateObject();
-        cJSON_AddStringToObject(ap, "ssid", (const char *)results[i].ssid);
-        cJSON_AddNumberToObject(ap, "rssi", results[i].rssi);
-        cJSON_AddNumberToObject(ap, "auth", results[i].authmode);
-        cJSON_AddItemToArray(arr, ap);
+        jsonw_object_begin(&w);
+        jsonw_field_string(&w, "ssid", (const char *)results[i].ssid);
+        jsonw_field_int(&w, "rssi", results[i].rssi);
+        jsonw_field_int(&w, "auth", results[i].authmode);
+        jsonw_object_end(&w);
     }
+    jsonw_array_end(&w);
     free(results);
-
-    char *json_str = cJSON_PrintUnformatted(arr);
-    cJSON_Delete(arr);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json_str, strlen(json_str));
-    free(json_str);
-    return ESP_OK;
+    return json_end(&w, req);
 }
 
 // --- Public API ---
@@ -691,7 +1685,9 @@ esp_err_t webserver_start(webserver_cmd_cb_t cmd_cb)
     config.stack_size = 8192;
     config.uri_match_fn = httpd_uri_match_wildcard;
     config.close_fn = ws_close_callback;
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = 32;
+    // Live streams and workers hold sockets for long stretches
+    config.max_open_sockets = 12;
 
     esp_err_t ret = httpd_start(&s_server, &config);
     if (ret != ESP_OK) {
@@ -699,6 +1695,22 @@ esp_err_t webserver_start(webserver_cmd_cb_t cmd_cb)
         return ret;
     }
 
+    // Downloads and other long responses, off the server task
+    ret = dl_init();
+    if (ret == ESP_OK) ret = workers_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start download workers: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // Live audio fan-out (network task)
+
+    ret = stream_init(s_server);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start audio streaming: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
     // Register handlers (order matters for wildcard matching)
     httpd_uri_t uri_ws = {
         .uri = "/ws",
@@ -729,6 +1741,27 @@ esp_err_t webserver_start(webserver_cmd_cb_t cmd_cb)
     };
     httpd_register_uri_handler(s_server, &uri_filter);
 
+    httpd_uri_t uri_dashcam_get = {
+        .uri = "/api/dashcam",
+        .method = HTTP_GET,
+        .handler = api_dashcam_get_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_dashcam_get);
+
+    httpd_uri_t uri_dashcam_post = {
+        .uri = "/api/dashcam",
+        .method = HTTP_POST,
+        .handler = api_dashcam_post_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_dashcam_post);
+
+    httpd_uri_t uri_dashcam_save = {
+        .uri = "/api/dashcam/save",
+        .method = HTTP_POST,
+        .handler = api_dashcam_save_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_dashcam_save);
+
     httpd_uri_t uri_rec = {
         .uri = "/api/rec/*",
         .method = HTTP_POST,
@@ -743,6 +1776,55 @@ esp_err_t webserver_start(webserver_cmd_cb_t cmd_cb)
     };
     httpd_register_uri_handler(s_server, &uri_status);
 
+    httpd_uri_t uri_status_post = {
+        .uri = "/api/status",
+        .method = HTTP_POST,
+        .handler = api_status_post_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_status_post);
+
+    httpd_uri_t uri_stream = {
+        .uri = "/api/stream",
+        .method = HTTP_GET,
+        .handler = api_stream_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_stream);
+
+    httpd_uri_t uri_stream_post = {
+        .uri = "/api/stream",
+        .method = HTTP_POST,
+        .handler = api_stream_post_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_stream_post);
+
+    httpd_uri_t uri_workers = {
+        .uri = "/api/workers",
+        .method = HTTP_GET,
+        .handler = api_workers_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_workers);
+
+    httpd_uri_t uri_export = {
+        .uri = "/api/export",
+        .method = HTTP_GET,
+        .handler = api_export_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_export);
+
+    httpd_uri_t uri_clip = {
+        .uri = "/api/clip",
+        .method = HTTP_GET,
+        .handler = api_clip_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_clip);
+
+    httpd_uri_t uri_follow = {
+        .uri = "/api/follow",
+        .method = HTTP_GET,
+        .handler = api_follow_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_follow);
+
     httpd_uri_t uri_files = {
         .uri = "/api/files",
         .method = HTTP_GET,
@@ -771,6 +1853,20 @@ esp_err_t webserver_start(webserver_cmd_cb_t cmd_cb)
     };
     httpd_register_uri_handler(s_server, &uri_waveform);
 
+    httpd_uri_t uri_events_list = {
+        .uri = "/api/events",
+        .method = HTTP_GET,
+        .handler = api_events_list_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_events_list);
+
+    httpd_uri_t uri_event_get = {
+        .uri = "/api/events/*",
+        .method = HTTP_GET,
+        .handler = api_event_get_handler,
+    };
+    httpd_register_uri_handler(s_server, &uri_event_get);
+
     httpd_uri_t uri_wifi_get = {
         .uri = "/api/wifi",
         .method = HTTP_GET,
@@ -803,29 +1899,12 @@ esp_err_t webserver_start(webserver_cmd_cb_t cmd_cb)
     return ESP_OK;
 }
 
-void webserver_broadcast_audio(const int16_t *samples, size_t num_samples)
+// The stream task's clients are the WebSocket clients: it sends to them,
+// and a failed send never removes one here (see ws_client_remove)
+bool webserver_broadcast_text(const char *text, size_t len)
 {
-    if (!s_server || num_samples == 0) return;
-
-    httpd_ws_frame_t ws_pkt = {
-        .final = true,
-        .fragmented = false,
-        .type = HTTPD_WS_TYPE_BINARY,
-        .payload = (uint8_t *)samples,
-        .len = num_samples * sizeof(int16_t),
-    };
-
-    xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
-        if (s_ws_fds[i] != -1) {
-            esp_err_t ret = httpd_ws_send_frame_async(s_server, s_ws_fds[i], &ws_pkt);
-            if (ret != ESP_OK) {
-                ESP_LOGW(TAG, "Failed to send to fd=%d, removing", s_ws_fds[i]);
-                s_ws_fds[i] = -1;
-            }
-        }
-    }
-    xSemaphoreGive(s_ws_mutex);
+    if (!s_server) return false;
+    return stream_send_text(-1, text, len);
 }
 
 bool webserver_has_clients(void)
@@ -841,3 +1920,8 @@ bool webserver_has_clients(void)
     xSemaphoreGive(s_ws_mutex);
     return has;
 }
+
+uint32_t webserver_ws_joins(void)
+{
+    return s_ws_joins;
+}
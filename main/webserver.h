@@ -1,18 +1,27 @@
 #pragma once
 
 #include "esp_err.h"
+#include "cmdq.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
-// Callback type for recording commands from WebSocket clients
-typedef void (*webserver_cmd_cb_t)(const char *cmd);
+// Callback for recording commands ("start_rec", "stop_rec") from WebSocket
+// clients and /api/rec. It queues the command and returns false if it is
+// unknown or cannot be queued; done(ctx, result) is called later from the
+// audio task once it has been applied (done may be NULL).
+typedef bool (*webserver_cmd_cb_t)(const char *cmd, cmd_done_fn done, void *ctx);
 
 // Start the HTTP server with WebSocket support.
 // cmd_cb is called when a WebSocket text command is received.
 esp_err_t webserver_start(webserver_cmd_cb_t cmd_cb);
 
-// Broadcast binary audio data (16-bit PCM) to all connected WebSocket clients.
-void webserver_broadcast_audio(const int16_t *samples, size_t num_samples);
+// Send a text frame (e.g. a JSON status message) to all WebSocket clients,
+// through the stream task. Never blocks; false if it could not be queued.
+bool webserver_broadcast_text(const char *text, size_t len);
 
 // Get whether any WebSocket clients are connected.
 bool webserver_has_clients(void);
+
+// Number of WebSocket connections accepted so far; changes when a client joins.
+uint32_t webserver_ws_joins(void);
@@ -0,0 +1,112 @@
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+static const char *TAG = "workers";
+
+typedef struct {
+    httpd_req_t *req;       // async copy, owned by the job
+    workers_fn_t fn;
+    int64_t queued_us;
+    uint8_t arg[WORKERS_ARG_MAX];
+} job_t;
+
+static QueueHandle_t s_jobs = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static workers_stats_t s_stats;
+static uint64_t s_wait_ms_sum = 0;
+static uint32_t s_started = 0;
+
+static void worker_task(void *arg)
+{
+    job_t job;
+    while (1) {
+        xQueueReceive(s_jobs, &job, portMAX_DELAY);
+
+        int64_t start = esp_timer_get_time();
+        uint32_t wait_ms = (uint32_t)((start - job.queued_us) / 1000);
+        portENTER_CRITICAL(&s_lock);
+        s_stats.queued--;
+        s_stats.busy++;
+        s_started++;
+        s_wait_ms_sum += wait_ms;
+        if (wait_ms > s_stats.wait_ms_max) s_stats.wait_ms_max = wait_ms;
+        portEXIT_CRITICAL(&s_lock);
+
+        esp_err_t err = job.fn(job.req, job.arg);
+        httpd_req_async_handler_complete(job.req);
+
+        uint32_t run_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+        portENTER_CRITICAL(&s_lock);
+        s_stats.busy--;
+        s_stats.completed++;
+        if (err != ESP_OK) s_stats.failed++;
+        if (run_ms > s_stats.run_ms_max) s_stats.run_ms_max = run_ms;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+esp_err_t workers_init(void)
+{
+    s_jobs = xQueueCreate(WORKERS_QUEUE, sizeof(job_t));
+    if (!s_jobs) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < WORKERS_COUNT; i++) {
+        char name[12];
+        snprintf(name, sizeof(name), "worker%d", i);
+        // Below the web server, so control requests cut in between sends
+        if (xTaskCreatePinnedToCore(worker_task, name, 4096, NULL, 3, NULL, 0) != pdPASS)
+            return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%d workers, %d queued jobs", WORKERS_COUNT, WORKERS_QUEUE);
+    return ESP_OK;
+}
+
+esp_err_t workers_submit(httpd_req_t *req, workers_fn_t fn, const void *arg, size_t arg_len)
+{
+    if (arg_len > WORKERS_ARG_MAX) return ESP_ERR_INVALID_SIZE;
+
+    // Reserve the queue slot first: once the request is taken over it
+    // cannot be given back to the server
+    bool room;
+    portENTER_CRITICAL(&s_lock);
+    room = s_stats.queued < WORKERS_QUEUE;
+    if (room) {
+        s_stats.queued++;
+        if (s_stats.queued > s_stats.peak_queued) s_stats.peak_queued = s_stats.queued;
+    } else {
+        s_stats.rejected++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (!room) return ESP_ERR_NO_MEM;
+
+    job_t job = { .fn = fn, .queued_us = esp_timer_get_time() };
+    if (arg_len) memcpy(job.arg, arg, arg_len);
+    if (httpd_req_async_handler_begin(req, &job.req) != ESP_OK) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.queued--;
+        portEXIT_CRITICAL(&s_lock);
+        return ESP_FAIL;
+    }
+
+    xQueueSend(s_jobs, &job, portMAX_DELAY);  // slot reserved above
+    portENTER_CRITICAL(&s_lock);
+    s_stats.submitted++;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+void workers_stats(workers_stats_t *out)
+{
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    out->wait_ms_avg = s_started ? (uint32_t)(s_wait_ms_sum / s_started) : 0;
+    portEXIT_CRITICAL(&s_lock);
+}
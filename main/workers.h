@@ -0,0 +1,47 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Long responses off the web server task. The server runs every handler on
+// one task, so a download streaming for a minute would hold up status polls,
+// waveform requests and WebSocket commands all that time. Handlers for
+// downloads, exports, follow streams and dashcam saves check their request,
+// then pass it here: a fixed set of worker tasks sends the body while the
+// server goes back to its other sockets. A full queue is answered with 503,
+// not queued without bound.
+//
+// Jobs that last as long as a recording (follow) have their own limit below
+// WORKERS_COUNT, so at least one worker is always left for downloads.
+
+#define WORKERS_COUNT   3
+#define WORKERS_QUEUE   4     // jobs waiting for a worker
+#define WORKERS_ARG_MAX 256   // per-job arguments, copied in
+
+// Runs on a worker with the request taken over from the server; answer it
+// as a handler would. The return value is only counted.
+typedef esp_err_t (*workers_fn_t)(httpd_req_t *req, void *arg);
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t rejected;      // queue full, answered 503
+    uint32_t completed;
+    uint32_t failed;        // fn returned an error
+    uint8_t busy;           // workers running a job now
+    uint8_t queued;         // jobs waiting now
+    uint8_t peak_queued;
+    uint32_t wait_ms_max;   // longest a job waited for a worker
+    uint32_t wait_ms_avg;
+    uint32_t run_ms_max;
+} workers_stats_t;
+
+esp_err_t workers_init(void);
+
+// Hand req to the pool with a copy of arg_len bytes of arg. ESP_ERR_NO_MEM:
+// the queue is full; ESP_FAIL: the request could not be taken over. On error
+// req is untouched and the caller still has to answer it.
+esp_err_t workers_submit(httpd_req_t *req, workers_fn_t fn, const void *arg, size_t arg_len);
+
+void workers_stats(workers_stats_t *out);
@@ -0,0 +1,593 @@
+#include "writer.h"
+#include "wav.h"
+#include "sdcard.h"
+#include "waveform.h"
+#include "events.h"
+#include "catalog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "writer";
+
+// Names of every part currently open for writing, one per line. Present on
+// the card only while a recording is in progress. An event container line
+// also carries the event's start sample, wall time and bytes per sample so
+// an interrupted event can still be indexed.
+#define JOURNAL_PATH SD_MOUNT_POINT "/.rec_journal"
+
+typedef enum {
+    WMSG_START = 0,
+    WMSG_DATA,
+    WMSG_REF,
+    WMSG_STOP,
+} wmsg_type_t;
+
+typedef struct {
+    wmsg_type_t type;
+    int16_t *block;         // DATA: pool block, recycled after write
+                            // REF: caller-owned samples, not recycled
+    size_t count;           // DATA/REF: samples in block
+    FILE *file;             // START: first part, already opened by caller
+    bool ulaw;              // START
+    bool event;             // START: append to a container (basename is its file name)
+    char basename[48];      // START
+    uint8_t session;        // START: see s_shown_part
+} wmsg_t;
+
+static QueueHandle_t s_msg_queue = NULL;   // audio task -> writer task
+static QueueHandle_t s_free_queue = NULL;  // writer task -> audio task (empty blocks)
+
+// Producer side -- only touched by the recording (audio) task
+static int16_t *s_fill = NULL;
+static size_t s_fill_pos = 0;
+static volatile uint32_t s_refs_queued = 0;  // REF messages sent
+static volatile uint32_t s_refs_done = 0;    // REF messages written (writer task)
+static char s_start_name[48];                // basename, or container file name
+static bool s_start_event = false;
+static uint8_t s_session = 0;                // bumped by every start
+
+// Part being written, published by the writer task as (session << 16) | part
+// in one word, so the producer side can name it without sharing a string.
+// A split still pending for an earlier recording carries an old session.
+static volatile uint32_t s_shown_part = 0;
+static uint8_t s_cur_session = 0;  // writer task
+
+// Writer task state
+static FILE *s_cur = NULL;        // part being written
+static FILE *s_next = NULL;       // pre-opened next part (header only)
+static FILE *s_retired = NULL;    // finished part waiting to be finalised
+static bool s_ulaw = false;
+static int s_part = 1;
+static uint32_t s_part_samples = 0;
+static uint32_t s_commit_samples = 0;  // s_part_samples at last header commit
+static char s_basename[48];
+static char s_cur_name[64];       // part being written (writer task only)
+static char s_next_name[64];
+static char s_retired_name[64];
+static bool s_event = false;      // writing an event into a container
+static event_rec_t s_event_rec;   // index record of that event
+
+// Level statistics of the part being written and of the retired one, for
+// the catalogue
+typedef struct {
+    uint16_t peak;
+    uint64_t sum_sq;
+    int64_t start_time;
+} part_stats_t;
+static part_stats_t s_part_stats;
+static part_stats_t s_retired_stats;
+static uint32_t s_retired_samples = 0;
+
+// Progress for followers. The writer task updates it under the mutex;
+// s_follow_base is where the current part's audio starts (non-zero only
+// for an event appended to a container).
+static SemaphoreHandle_t s_follow_mutex = NULL;
+static writer_follow_t s_follow;
+static volatile int s_followers = 0;
+static uint32_t s_follow_base = 0;
+
+void writer_part_name(const char *basename, int part, char *out, size_t out_size)
+{
+    if (part <= 1)
+        snprintf(out, out_size, "%s.wav", basename);
+    else
+        snprintf(out, out_size, "%s_p%d.wav", basename, part);
+}
+
+static void part_filename(int part, char *out, size_t out_size)
+{
+    writer_part_name(s_basename, part, out, out_size);
+}
+
+static uint32_t part_data_bytes(void)
+{
+    return s_follow_base + s_part_samples * (s_ulaw ? 1 : 2);
+}
+
+static void follow_lock(void)   { xSemaphoreTake(s_follow_mutex, portMAX_DELAY); }
+static void follow_unlock(void) { xSemaphoreGive(s_follow_mutex); }
+
+// Everything written to the current part so far is on the card
+static void follow_synced(void)
+{
+    follow_lock();
+    s_follow.synced = part_data_bytes();
+    follow_unlock();
+}
+
+// Rewrite the journal with the parts that are open right now, or remove it
+// when nothing is open.
+static void journal_update(void)
+{
+    if (!s_cur && !s_next && !s_retired) {
+        unlink(JOURNAL_PATH);
+        return;
+    }
+
+    FILE *j = fopen(JOURNAL_PATH, "w");
+    if (!j) {
+        ESP_LOGW(TAG, "cannot write journal");
+        return;
+    }
+    if (s_retired) fprintf(j, "%s\n", s_retired_name);
+    if (s_cur && s_event)
+        fprintf(j, "%s %lu %lld %d\n", s_cur_name, (unsigned long)s_event_rec.start_sample,
+                (long long)s_event_rec.wall_time, s_ulaw ? 1 : 2);
+    else if (s_cur)
+        fprintf(j, "%s\n", s_cur_name);
+    if (s_next)    fprintf(j, "%s\n", s_next_name);
+    fflush(j);
+    fsync(fileno(j));
+    fclose(j);
+}
+
+static void preopen_next(void)
+{
+    if (s_next) return;
+
+    char path[128];
+    part_filename(s_part + 1, s_next_name, sizeof(s_next_name));
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, s_next_name);
+    s_next = s_ulaw ? wav_open_ulaw(path, AUDIO_SAMPLE_RATE, 1)
+                    : wav_open(path, AUDIO_SAMPLE_RATE, 16, 1);
+    if (!s_next) {
+        ESP_LOGW(TAG, "pre-open of %s failed", s_next_name);
+        return;
+    }
+    journal_update();
+}
+
+static void catalog_part(const char *name, const part_stats_t *st, uint32_t samples)
+{
+    uint64_t mean_sq = samples ? st->sum_sq / samples : 0;
+    catalog_add_file(name, st->peak, (uint16_t)sqrt((double)mean_sq), st->start_time);
+}
+
+// List the part being written while it grows; containers are already listed
+static void catalog_current(void)
+{
+    if (s_cur && !s_event)
+        catalog_set_active(s_cur_name, s_part_samples, s_ulaw, s_part_stats.peak,
+                           s_part_stats.start_time);
+}
+
+static void finalise_retired(void)
+{
+    if (!s_retired) return;
+    wav_close(s_retired);
+    s_retired = NULL;
+    journal_update();
+    catalog_part(s_retired_name, &s_retired_stats, s_retired_samples);
+    waveform_request(s_retired_name);
+}
+
+// Swap to the pre-opened part. The old file is only retired here and
+// closed once the queue has drained.
+static void rollover(void)
+{
+    if (!s_next) preopen_next();  // fallback: open synchronously
+
+    if (s_retired) finalise_retired();
+    s_retired = s_cur;
+    strcpy(s_retired_name, s_cur_name);
+    s_retired_stats = s_part_stats;
+    s_retired_samples = s_part_samples;
+
+    follow_lock();
+    s_follow.part_bytes[s_part % WRITER_FOLLOW_PARTS] = part_data_bytes();
+    s_follow.part = s_part + 1;
+    s_follow.synced = 0;
+    follow_unlock();
+    s_follow_base = 0;
+
+    memset(&s_part_stats, 0, sizeof(s_part_stats));
+    s_part_stats.start_time = time(NULL);
+    s_cur = s_next;
+    s_next = NULL;
+    s_part++;
+    s_part_samples = 0;
+    s_commit_samples = 0;
+    strcpy(s_cur_name, s_next_name);
+    s_shown_part = ((uint32_t)s_cur_session << 16) | (uint32_t)s_part;
+    journal_update();
+    catalog_current();
+    ESP_LOGI(TAG, "File split: now recording %s", s_cur_name);
+}
+
+static void write_samples(const wmsg_t *m)
+{
+    if (s_cur) {
+        if (s_ulaw)
+            wav_write_ulaw(s_cur, m->block, m->count);
+        else
+            wav_write(s_cur, m->block, m->count);
+        s_part_samples += m->count;
+
+        // Make the block readable to followers before any split below
+        if (s_followers > 0) {
+            fflush(s_cur);
+            fsync(fileno(s_cur));
+            follow_synced();
+        }
+
+        part_stats_t *st = &s_part_stats;
+        for (size_t i = 0; i < m->count; i++) {
+            int32_t v = m->block[i];
+            uint16_t a = v < 0 ? -v : v;
+            if (a > st->peak) st->peak = a;
+            st->sum_sq += (uint32_t)(v * v);
+        }
+
+        // Keep the on-card header close to the data in case power is lost
+        if (s_part_samples - s_commit_samples >= WRITER_COMMIT_SAMPLES) {
+            wav_commit(s_cur);
+            s_commit_samples = s_part_samples;
+            follow_synced();
+            catalog_current();
+        }
+
+        if (s_event) {
+            // Containers are not split
+        } else if (s_part_samples >= WRITER_PART_SAMPLES) {
+            rollover();
+        } else if (s_part_samples >= WRITER_PART_SAMPLES - WRITER_PREOPEN_SAMPLES) {
+            preopen_next();
+        }
+    }
+}
+
+static void handle_stop(void)
+{
+    finalise_retired();
+
+    if (s_next) {
+        // Unused pre-opened part: close and remove it
+        char path[128];
+        snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, s_next_name);
+        fclose(s_next);
+        unlink(path);
+        s_next = NULL;
+    }
+
+    if (!s_cur) {
+        journal_update();
+        return;
+    }
+    wav_close(s_cur);
+    s_cur = NULL;
+    journal_update();
+
+    follow_lock();
+    s_follow.synced = part_data_bytes();
+    s_follow.part_bytes[s_part % WRITER_FOLLOW_PARTS] = s_follow.synced;
+    s_follow.active = false;
+    follow_unlock();
+
+    if (s_event) {
+        // Index the event and fold its peak into the container's waveform;
+        // a rescan of a day's container would take far too long
+        s_event_rec.num_samples = s_part_samples;
+        s_event_rec.peak = s_part_stats.peak;
+        if (events_append(s_cur_name, &s_event_rec) != ESP_OK) {
+            ESP_LOGW(TAG, "cannot index event in %s", s_cur_name);
+        }
+        catalog_add_file(s_cur_name, s_event_rec.peak, 0, s_event_rec.wall_time);
+        waveform_append(s_cur_name, s_event_rec.start_sample,
+                        s_event_rec.start_sample + s_part_samples, s_event_rec.peak);
+        s_event = false;
+        return;
+    }
+
+    // Catalogue the completed recording. Its waveform cache is a full scan
+    // of the part, so it is left to the background task: the next START and
+    // its audio must not queue behind it.
+    catalog_part(s_cur_name, &s_part_stats, s_part_samples);
+    waveform_request(s_cur_name);
+}
+
+// Open the container here rather than on the caller: the previous event
+// may still be queued for the same file
+static void open_event(bool ulaw)
+{
+    char path[128];
+    strcpy(s_cur_name, s_basename);
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, s_cur_name);
+
+    uint32_t data_size = 0;
+    s_cur = wav_open_append(path, AUDIO_SAMPLE_RATE, ulaw, &data_size);
+    if (!s_cur) {
+        ESP_LOGE(TAG, "cannot open container %s, event dropped", s_cur_name);
+        s_event = false;
+        return;
+    }
+    memset(&s_event_rec, 0, sizeof(s_event_rec));
+    s_event_rec.start_sample = data_size / (ulaw ? 1 : 2);
+    s_event_rec.wall_time = time(NULL);
+    s_follow_base = data_size;
+}
+
+static void follow_start(void)
+{
+    follow_lock();
+    memset(&s_follow, 0, sizeof(s_follow));
+    s_follow.session = s_cur_session;
+    s_follow.active = s_cur != NULL;
+    s_follow.ulaw = s_ulaw;
+    s_follow.event = s_event;
+    snprintf(s_follow.basename, sizeof(s_follow.basename), "%s", s_basename);
+    s_follow.part = 1;
+    s_follow.base = s_follow_base;
+    s_follow.synced = s_follow_base;
+    follow_unlock();
+}
+
+static void writer_task(void *arg)
+{
+    wmsg_t m;
+    while (1) {
+        if (xQueueReceive(s_msg_queue, &m, portMAX_DELAY) != pdTRUE) continue;
+
+        switch (m.type) {
+        case WMSG_START:
+            s_cur = m.file;
+            s_ulaw = m.ulaw;
+            s_part = 1;
+            s_cur_session = m.session;
+            s_part_samples = 0;
+            s_commit_samples = 0;
+            memset(&s_part_stats, 0, sizeof(s_part_stats));
+            s_part_stats.start_time = time(NULL);
+            strncpy(s_basename, m.basename, sizeof(s_basename) - 1);
+            s_basename[sizeof(s_basename) - 1] = '\0';
+            s_event = m.event;
+            s_follow_base = 0;
+            if (s_event) {
+                open_event(m.ulaw);
+            } else {
+                part_filename(1, s_cur_name, sizeof(s_cur_name));
+            }
+            journal_update();
+            catalog_current();
+            follow_start();
+            break;
+        case WMSG_DATA:
+            write_samples(&m);
+            xQueueSend(s_free_queue, &m.block, portMAX_DELAY);
+            break;
+        case WMSG_REF:
+            write_samples(&m);
+            s_refs_done++;
+            break;
+        case WMSG_STOP:
+            handle_stop();
+            break;
+        }
+
+        // Finalise the previous part only when no audio is waiting
+        if (s_retired && uxQueueMessagesWaiting(s_msg_queue) == 0) {
+            finalise_retired();
+        }
+    }
+}
+
+esp_err_t writer_init(void)
+{
+    s_msg_queue = xQueueCreate(WRITER_POOL_BLOCKS + 4, sizeof(wmsg_t));
+    s_free_queue = xQueueCreate(WRITER_POOL_BLOCKS, sizeof(int16_t *));
+    s_follow_mutex = xSemaphoreCreateMutex();
+    if (!s_msg_queue || !s_free_queue || !s_follow_mutex) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < WRITER_POOL_BLOCKS; i++) {
+        int16_t *blk = heap_caps_malloc(WRITER_BLOCK_SAMPLES * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        if (!blk) {
+            ESP_LOGE(TAG, "Failed to allocate write block in PSRAM");
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(s_free_queue, &blk, 0);
+    }
+
+    xTaskCreatePinnedToCore(writer_task, "writer", 4096, NULL, 4, NULL, 0);
+    return ESP_OK;
+}
+
+void writer_recover(void)
+{
+    FILE *j = fopen(JOURNAL_PATH, "r");
+    if (!j) return;
+
+    int repaired = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), j)) {
+        char name[80];
+        unsigned long ev_start;
+        long long ev_time;
+        int ev_bps;
+        int fields = sscanf(line, "%79s %lu %lld %d", name, &ev_start, &ev_time, &ev_bps);
+        if (fields < 1) continue;
+
+        char path[128];
+        snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, name);
+
+        uint32_t data_size = 0;
+        esp_err_t ret = wav_repair(path, &data_size);
+        if (ret == ESP_ERR_NOT_FOUND) continue;
+        if (fields == 4 && ret == ESP_OK) {
+            // Interrupted container event: index what made it to the card
+            uint32_t total = data_size / (ev_bps > 0 ? ev_bps : 1);
+            if (total > ev_start) {
+                event_rec_t rec = {
+                    .start_sample = ev_start,
+                    .num_samples = total - ev_start,
+                    .wall_time = ev_time,
+                };
+                events_append(name, &rec);
+            }
+            catalog_add_file(name, 0, 0, 0);
+            waveform_delete_cache(name);
+            repaired++;
+            continue;
+        }
+        if (ret == ESP_ERR_INVALID_SIZE || (ret == ESP_OK && data_size == 0)) {
+            // Pre-opened part that never received audio
+            ESP_LOGI(TAG, "removing empty part %s", name);
+            unlink(path);
+            waveform_delete_cache(name);
+            catalog_remove(name);
+            continue;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "cannot repair %s: %s", name, esp_err_to_name(ret));
+            continue;
+        }
+
+        catalog_add_file(name, 0, 0, 0);
+        waveform_delete_cache(name);
+        waveform_generate(name);
+        repaired++;
+    }
+    fclose(j);
+    unlink(JOURNAL_PATH);
+
+    ESP_LOGW(TAG, "recovered %d unfinalised recording(s)", repaired);
+}
+
+esp_err_t writer_start(const char *basename, bool ulaw)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s.wav", SD_MOUNT_POINT, basename);
+
+    FILE *f = ulaw ? wav_open_ulaw(path, AUDIO_SAMPLE_RATE, 1)
+                   : wav_open(path, AUDIO_SAMPLE_RATE, 16, 1);
+    if (!f) return ESP_FAIL;
+
+    wmsg_t m = { .type = WMSG_START, .file = f, .ulaw = ulaw, .session = ++s_session };
+    strncpy(m.basename, basename, sizeof(m.basename) - 1);
+    snprintf(s_start_name, sizeof(s_start_name), "%s", basename);
+    s_start_event = false;
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t writer_start_event(const char *container, bool ulaw)
+{
+    wmsg_t m = { .type = WMSG_START, .ulaw = ulaw, .event = true, .session = ++s_session };
+    strncpy(m.basename, container, sizeof(m.basename) - 1);
+    snprintf(s_start_name, sizeof(s_start_name), "%s", container);
+    s_start_event = true;
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+    return ESP_OK;
+}
+
+static void submit_fill(void)
+{
+    if (!s_fill) return;
+    wmsg_t m = { .type = WMSG_DATA, .block = s_fill, .count = s_fill_pos };
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+    s_fill = NULL;
+    s_fill_pos = 0;
+}
+
+void writer_write(const int16_t *samples, size_t num_samples)
+{
+    while (num_samples > 0) {
+        if (!s_fill) {
+            if (xQueueReceive(s_free_queue, &s_fill, 0) != pdTRUE) {
+                ESP_LOGW(TAG, "write pool exhausted, waiting for SD");
+                xQueueReceive(s_free_queue, &s_fill, portMAX_DELAY);
+            }
+            s_fill_pos = 0;
+        }
+
+        size_t n = WRITER_BLOCK_SAMPLES - s_fill_pos;
+        if (n > num_samples) n = num_samples;
+        memcpy(&s_fill[s_fill_pos], samples, n * sizeof(int16_t));
+        s_fill_pos += n;
+        samples += n;
+        num_samples -= n;
+
+        if (s_fill_pos >= WRITER_BLOCK_SAMPLES) submit_fill();
+    }
+}
+
+void writer_write_ref(const int16_t *samples, size_t num_samples)
+{
+    if (num_samples == 0) return;
+
+    // Keep ordering with anything already copied
+    if (s_fill && s_fill_pos > 0) submit_fill();
+
+    wmsg_t m = { .type = WMSG_REF, .block = (int16_t *)samples, .count = num_samples };
+    s_refs_queued++;
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+}
+
+bool writer_refs_pending(void)
+{
+    return s_refs_done != s_refs_queued;
+}
+
+void writer_stop(void)
+{
+    if (s_fill && s_fill_pos > 0) {
+        submit_fill();
+    }
+    wmsg_t m = { .type = WMSG_STOP };
+    xQueueSend(s_msg_queue, &m, portMAX_DELAY);
+}
+
+void writer_current_name(char *out, size_t out_size)
+{
+    if (s_start_event) {
+        snprintf(out, out_size, "%s", s_start_name);
+        return;
+    }
+    uint32_t shown = s_shown_part;
+    int part = (shown >> 16) == s_session ? (int)(shown & 0xffff) : 1;
+    writer_part_name(s_start_name, part, out, out_size);
+}
+
+void writer_follow(bool attach)
+{
+    __atomic_add_fetch(&s_followers, attach ? 1 : -1, __ATOMIC_RELAXED);
+}
+
+void writer_follow_state(writer_follow_t *out)
+{
+    if (!s_follow_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    follow_lock();
+    *out = s_follow;
+    follow_unlock();
+}
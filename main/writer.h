@@ -0,0 +1,78 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "audio.h"
+
+#define WRITER_BLOCK_SAMPLES  8000  // 8000 samples = 16KB = ~400ms @ 20kHz
+#define WRITER_POOL_BLOCKS    4     // blocks in flight between audio and writer task
+#define WRITER_PART_SAMPLES   (5 * 60 * AUDIO_SAMPLE_RATE)  // split every 5 min
+#define WRITER_PREOPEN_SAMPLES (30 * AUDIO_SAMPLE_RATE)     // pre-open next part 30s early
+#define WRITER_COMMIT_SAMPLES  (10 * AUDIO_SAMPLE_RATE)     // header commit + fsync every 10s
+#define WRITER_FOLLOW_PARTS    8    // finished part sizes kept for followers
+
+// Progress of the recording, for readers that stream it while it grows.
+// Byte counts are PCM data bytes from the start of a part's data chunk.
+typedef struct {
+    uint8_t session;        // changes with every start; 0 before the first
+    bool active;            // still recording
+    bool ulaw;
+    bool event;             // appending one event to a day container
+    char basename[48];      // container file name for events
+    int part;               // part being written
+    uint32_t base;          // where this recording starts in part 1 (containers)
+    uint32_t synced;        // bytes of the current part known to be on the card
+    uint32_t part_bytes[WRITER_FOLLOW_PARTS];  // finished parts, at part % WRITER_FOLLOW_PARTS
+} writer_follow_t;
+
+// Allocate the PSRAM block pool and start the writer task (core 0).
+esp_err_t writer_init(void);
+
+// Repair recordings left open by a power loss (listed in the on-card
+// journal) and rebuild their waveform caches. Call once at boot, after
+// sdcard_init() and before recording starts.
+void writer_recover(void);
+
+// Open <basename>.wav on the calling task and hand it to the writer.
+// Later parts (<basename>_pN.wav) are pre-opened in the background, so a
+// split is just a pointer swap on the writer task.
+esp_err_t writer_start(const char *basename, bool ulaw);
+
+// Append one auto-triggered event to a day container (see events.h). The
+// container is not split; the event is indexed when writer_stop() runs.
+esp_err_t writer_start_event(const char *container, bool ulaw);
+
+// Copy samples into the current block; full blocks are queued to the writer.
+// Only blocks if every pool block is still waiting to be written.
+void writer_write(const int16_t *samples, size_t num_samples);
+
+// Queue samples owned by the caller without copying (e.g. pre-roll ring
+// segments). The memory must stay untouched until writer_refs_pending()
+// returns false.
+void writer_write_ref(const int16_t *samples, size_t num_samples);
+
+// True while samples passed to writer_write_ref() are not yet on the card.
+bool writer_refs_pending(void);
+
+// Queue the partial block and finalise the recording in the background
+// (close file, drop unused pre-opened part, queue the waveform cache).
+void writer_stop(void);
+
+// File name of part `part` of a split recording: <basename>.wav for the
+// first, <basename>_pN.wav after that.
+void writer_part_name(const char *basename, int part, char *out, size_t out_size);
+
+// Register a reader of the recording in progress (attach true) or drop one.
+// While any is registered the writer syncs after every block, so new audio
+// is readable from the card within one block (~400 ms) instead of 10 s.
+void writer_follow(bool attach);
+
+// Consistent copy of the recording's progress (any task).
+void writer_follow_state(writer_follow_t *out);
+
+// Name of the part currently being written (e.g. "rec_001_p2.wav"). Call
+// from the task that starts recordings; the result is never torn by a split.
+void writer_current_name(char *out, size_t out_size);
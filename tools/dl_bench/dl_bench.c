@@ -0,0 +1,207 @@
+// Host throughput benchmark for the download engine (main/dl.c).
+//
+//   dl_bench [options]
+//     -s <MB>       file size (default 8)
+//     -r <us>       SD cost per read call (default 300)
+//     -R <KB/s>     SD transfer rate (default 1600)
+//     -n <us>       socket cost per send call (default 150)
+//     -N <KB/s>     socket transfer rate (default 1500)
+//     -o <bytes>    range start for a partial transfer (default 0)
+//
+// Runs the same transfer three ways and prints KB/s for each:
+//   chunked-1k  what the handlers did before: 1 KB read, then one chunk
+//               sent as three socket writes (size line, data, CRLF)
+//   serial-32k  the engine's buffer size, but read and send taking turns
+//   engine      dl_stream: 32 KB double buffers, reads overlapping sends
+//
+// The card and the network are modelled by their per-call and per-byte
+// costs; each side runs on its own clock so they can overlap only where the
+// code lets them. fread is wrapped at link time so main/dl.c is used as-is.
+// Every transfer is checked byte for byte against the file.
+
+#include "dl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+static long s_sd_call_us = 300, s_sd_kbps = 1600;
+static long s_net_call_us = 150, s_net_kbps = 1500;
+
+// --- Cost model ---
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Busy until max(now, previous deadline) + cost, so a device is never
+// charged twice for the same microseconds and small costs add up exactly
+static void spend(double *deadline, long call_us, long kbps, size_t bytes)
+{
+    double t = now_us();
+    if (*deadline < t) *deadline = t;
+    *deadline += call_us + (kbps > 0 ? bytes * 1e6 / (kbps * 1024.0) : 0);
+    double wait = *deadline - now_us();
+    if (wait > 0) {
+        struct timespec ts = { (time_t)(wait / 1e6), (long)((wait - (time_t)(wait / 1e6) * 1e6) * 1e3) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static double s_sd_deadline = 0;  // one reader at a time in every mode
+
+size_t __real_fread(void *ptr, size_t size, size_t n, FILE *f);
+
+size_t __wrap_fread(void *ptr, size_t size, size_t n, FILE *f)
+{
+    size_t got = __real_fread(ptr, size, n, f);
+    spend(&s_sd_deadline, s_sd_call_us, s_sd_kbps, got * size);
+    return got;
+}
+
+// --- Receiving side ---
+
+typedef struct {
+    const uint8_t *expect;  // file contents at the transfer's start
+    size_t pos;
+    size_t skip;            // leading bytes that are not file data (headers)
+    int bad;
+    double deadline;
+} sink_t;
+
+static int sink_send(void *ctx, const uint8_t *data, size_t len)
+{
+    sink_t *k = ctx;
+    spend(&k->deadline, s_net_call_us, s_net_kbps, len);
+    size_t off = 0;
+    if (k->skip) {
+        off = len < k->skip ? len : k->skip;
+        k->skip -= off;
+    }
+    if (len > off) {
+        if (memcmp(data + off, k->expect + k->pos, len - off) != 0) k->bad = 1;
+        k->pos += len - off;
+    }
+    return 0;
+}
+
+// --- Transfers ---
+
+static int run_serial(const char *path, long off, long len, size_t bufsize, int chunked, sink_t *k)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    setvbuf(f, NULL, _IONBF, 0);  // as on the device: each fread is a card access
+    fseek(f, off, SEEK_SET);
+    uint8_t *buf = malloc(bufsize);
+    long left = len;
+    while (left > 0) {
+        size_t want = left < (long)bufsize ? (size_t)left : bufsize;
+        size_t n = fread(buf, 1, want, f);
+        if (n == 0) break;
+        if (chunked) {
+            char line[16];
+            int l = snprintf(line, sizeof(line), "%zx\r\n", n);
+            k->skip += l;
+            sink_send(k, (const uint8_t *)line, l);
+            sink_send(k, buf, n);
+            k->skip += 2;
+            sink_send(k, (const uint8_t *)"\r\n", 2);
+        } else {
+            sink_send(k, buf, n);
+        }
+        left -= n;
+    }
+    free(buf);
+    fclose(f);
+    return left == 0 ? 0 : -1;
+}
+
+static void report(const char *name, long len, double us, const sink_t *k, long expect)
+{
+    int ok = !k->bad && (long)k->pos == expect;
+    printf("%-11s %8.3f s  %7.1f KB/s  %s\n", name, us / 1e6, len / 1024.0 / (us / 1e6),
+           ok ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char **argv)
+{
+    long size_mb = 8, off = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:R:n:N:o:")) != -1) {
+        switch (opt) {
+        case 's': size_mb = atol(optarg); break;
+        case 'r': s_sd_call_us = atol(optarg); break;
+        case 'R': s_sd_kbps = atol(optarg); break;
+        case 'n': s_net_call_us = atol(optarg); break;
+        case 'N': s_net_kbps = atol(optarg); break;
+        case 'o': off = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-s MB] [-r us] [-R KB/s] [-n us] [-N KB/s] [-o offset]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    long size = size_mb * 1024 * 1024;
+    if (off < 0 || off >= size) off = 0;
+    long len = size - off;
+
+    char path[] = "/tmp/dl_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    uint8_t *data = malloc(size);
+    uint32_t x = 12345;
+    for (long i = 0; i < size; i++) {
+        x = x * 1103515245u + 12345u;
+        data[i] = (uint8_t)(x >> 16);
+    }
+    if (write(fd, data, size) != size) {
+        perror("write");
+        return 1;
+    }
+    close(fd);
+
+    if (dl_init() != ESP_OK) {
+        fprintf(stderr, "dl_init failed\n");
+        return 1;
+    }
+
+    printf("%ld KB from offset %ld; SD %ld us/call %ld KB/s, net %ld us/call %ld KB/s\n",
+           len / 1024, off, s_sd_call_us, s_sd_kbps, s_net_call_us, s_net_kbps);
+
+    sink_t k;
+    double t;
+
+    memset(&k, 0, sizeof(k));
+    k.expect = data + off;
+    t = now_us();
+    run_serial(path, off, len, 1024, 1, &k);
+    report("chunked-1k", len, now_us() - t, &k, len);
+
+    memset(&k, 0, sizeof(k));
+    k.expect = data + off;
+    t = now_us();
+    run_serial(path, off, len, DL_BUF_SIZE, 0, &k);
+    report("serial-32k", len, now_us() - t, &k, len);
+
+    static const char head[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    memset(&k, 0, sizeof(k));
+    k.expect = data + off;
+    k.skip = sizeof(head) - 1;
+    t = now_us();
+    esp_err_t err = dl_stream(path, off, len, head, sizeof(head) - 1, sink_send, &k);
+    report("engine", len, now_us() - t, &k, err == ESP_OK ? len : -1);
+
+    unlink(path);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+// Host stand-in for the ESP-IDF error codes used by main/dl.c
+
+typedef int esp_err_t;
+
+#define ESP_OK               0
+#define ESP_FAIL             -1
+#define ESP_ERR_NO_MEM       0x101
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND    0x105
+#define ESP_ERR_TIMEOUT      0x107
@@ -0,0 +1,14 @@
+#pragma once
+// Host stand-in for the FreeRTOS subset main/dl.c uses, on pthreads.
+// One tick is one millisecond.
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          pdTRUE
+#define portMAX_DELAY   ((TickType_t)0xFFFFFFFFu)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t item, cap, head, count;
+    unsigned char data[];
+} shim_queue_t;
+
+typedef shim_queue_t *QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreate(size_t cap, size_t item)
+{
+    shim_queue_t *q = calloc(1, sizeof(*q) + cap * item);
+    if (!q) return NULL;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    q->item = item;
+    q->cap = cap;
+    return q;
+}
+
+// Wait on q->changed until ready() or the timeout; lock held on return
+static inline int shim_wait(shim_queue_t *q, int (*ready)(shim_queue_t *), TickType_t ticks)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += ticks / 1000;
+    until.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) { until.tv_sec++; until.tv_nsec -= 1000000000; }
+    while (!ready(q)) {
+        if (ticks == portMAX_DELAY) pthread_cond_wait(&q->changed, &q->lock);
+        else if (ticks == 0 || pthread_cond_timedwait(&q->changed, &q->lock, &until) != 0)
+            return ready(q);
+    }
+    return 1;
+}
+
+static inline int shim_has_room(shim_queue_t *q) { return q->count < q->cap; }
+static inline int shim_has_item(shim_queue_t *q) { return q->count > 0; }
+
+static inline BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+    if (!shim_wait(q, shim_has_room, ticks)) {
+        pthread_mutex_unlock(&q->lock);
+        return pdFALSE;
+    }
+    memcpy(q->data + ((q->head + q->count) % q->cap) * q->item, item, q->item);
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+    if (!shim_wait(q, shim_has_item, ticks)) {
+        pthread_mutex_unlock(&q->lock);
+        return pdFALSE;
+    }
+    memcpy(item, q->data + q->head * q->item, q->item);
+    q->head = (q->head + 1) % q->cap;
+    q->count--;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef void (*TaskFunction_t)(void *);
+typedef void *TaskHandle_t;
+
+typedef struct {
+    TaskFunction_t fn;
+    void *arg;
+} shim_task_t;
+
+static void *shim_task_main(void *p)
+{
+    shim_task_t t = *(shim_task_t *)p;
+    free(p);
+    t.fn(t.arg);
+    return NULL;
+}
+
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                                 void *arg, unsigned prio, TaskHandle_t *handle, int core)
+{
+    (void)name; (void)stack; (void)prio; (void)core;
+    shim_task_t *t = malloc(sizeof(*t));
+    if (!t) return pdFALSE;
+    t->fn = fn;
+    t->arg = arg;
+    pthread_t th;
+    if (pthread_create(&th, NULL, shim_task_main, t) != 0) {
+        free(t);
+        return pdFALSE;
+    }
+    pthread_detach(th);
+    if (handle) *handle = NULL;
+    return pdPASS;
+}
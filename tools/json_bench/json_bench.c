@@ -0,0 +1,213 @@
+// Throughput and allocation benchmark for the HTTP API's JSON handling
+// (main/jsonw.c, main/jsonr.c).
+//
+//   json_bench [iterations]      (default 200000)
+//
+// Two workloads mirror the busiest handlers: serialising a /api/status
+// document and parsing a POST /api/auto body. For each one it reports
+// requests per second and heap bytes/calls per request. Built with
+// CJSON=<dir>, the same documents go through cJSON for comparison.
+
+#include "jsonw.h"
+#include "jsonr.h"
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --- Allocation counting (linked with --wrap) ---
+
+static size_t s_alloc_calls, s_alloc_bytes;
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t m);
+void *__real_realloc(void *p, size_t n);
+void __real_free(void *p);
+
+void *__wrap_malloc(size_t n)
+{
+    s_alloc_calls++;
+    s_alloc_bytes += n;
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t m)
+{
+    s_alloc_calls++;
+    s_alloc_bytes += n * m;
+    return __real_calloc(n, m);
+}
+
+void *__wrap_realloc(void *p, size_t n)
+{
+    s_alloc_calls++;
+    s_alloc_bytes += n;
+    return __real_realloc(p, n);
+}
+
+void __wrap_free(void *p)
+{
+    __real_free(p);
+}
+
+// --- Workloads ---
+
+// Stands in for httpd_resp_send_chunk
+static size_t s_sent;
+static volatile char s_sink;
+
+static int sink_flush(void *ctx, const char *data, size_t len)
+{
+    (void)ctx;
+    s_sent += len;
+    s_sink = data[len - 1];
+    return 0;
+}
+
+static size_t status_jsonw(int i)
+{
+    char buf[1024];
+    jsonw_t w;
+    jsonw_init(&w, buf, sizeof(buf), sink_flush, NULL);
+    jsonw_object_begin(&w);
+    jsonw_field_fixed(&w, "sd_free_mb", 29871.4 + i, 1);
+    jsonw_field_string(&w, "wifi_mode", "STA");
+    jsonw_field_string(&w, "wifi_ssid", "workshop");
+    jsonw_field_string(&w, "wifi_ip", "192.168.1.42");
+    jsonw_field_int(&w, "rssi", -61);
+    jsonw_field_bool(&w, "recording", true);
+    jsonw_field_string(&w, "filename", "rec_0042.wav");
+    jsonw_field_string(&w, "rec_started_at", "2024-05-01 12:00:00");
+    jsonw_field_string(&w, "rec_source", "auto");
+    jsonw_field_int(&w, "adc_overflows", i & 7);
+    jsonw_field_bool(&w, "auto_mode", true);
+    jsonw_field_int(&w, "auto_threshold", 2000);
+    jsonw_field_int(&w, "preroll", 2);
+    jsonw_field_int(&w, "silence_s", 120);
+    jsonw_field_int(&w, "min_event_ms", 100);
+    jsonw_field_bool(&w, "container", false);
+    jsonw_field_int(&w, "current_rms", 1234 + (i & 255));
+    jsonw_field_bool(&w, "ulaw", false);
+    jsonw_field_fixed(&w, "current_zcr", 0.117, 3);
+    jsonw_field_string(&w, "vad", "spectral");
+    jsonw_field_bool(&w, "vad_voice", i & 1);
+    jsonw_field_int(&w, "vad_us", 412);
+    jsonw_field_int(&w, "vad_us_max", 980);
+    jsonw_field_int(&w, "filter_hp", 100);
+    jsonw_field_int(&w, "filter_lp", 8000);
+    jsonw_object_end(&w);
+    jsonw_finish(&w);
+    jsonw_flush(&w);
+    return w.flushed;
+}
+
+static const char AUTO_BODY[] =
+    "{\"enabled\":true,\"threshold\":2500,\"preroll\":3,\"silence_s\":60,"
+    "\"min_event_ms\":150,\"container\":false,\"vad\":\"spectral\"}";
+
+static size_t auto_jsonr(int i)
+{
+    char buf[192];
+    memcpy(buf, AUTO_BODY, sizeof(AUTO_BODY));
+    jsonr_t r;
+    if (jsonr_parse(&r, buf) != 0) return 0;
+    int v = 0;
+    bool b = false;
+    const char *s = "";
+    jsonr_get_bool(&r, "enabled", &b);
+    jsonr_get_int(&r, "threshold", &v);
+    jsonr_get_string(&r, "vad", &s);
+    return v + b + strlen(s) + (i & 1);
+}
+
+#ifdef HAVE_CJSON
+static size_t status_cjson(int i)
+{
+    cJSON *o = cJSON_CreateObject();
+    cJSON_AddNumberToObject(o, "sd_free_mb", 29871.4 + i);
+    cJSON_AddStringToObject(o, "wifi_mode", "STA");
+    cJSON_AddStringToObject(o, "wifi_ssid", "workshop");
+    cJSON_AddStringToObject(o, "wifi_ip", "192.168.1.42");
+    cJSON_AddNumberToObject(o, "rssi", -61);
+    cJSON_AddBoolToObject(o, "recording", true);
+    cJSON_AddStringToObject(o, "filename", "rec_0042.wav");
+    cJSON_AddStringToObject(o, "rec_started_at", "2024-05-01 12:00:00");
+    cJSON_AddStringToObject(o, "rec_source", "auto");
+    cJSON_AddNumberToObject(o, "adc_overflows", i & 7);
+    cJSON_AddBoolToObject(o, "auto_mode", true);
+    cJSON_AddNumberToObject(o, "auto_threshold", 2000);
+    cJSON_AddNumberToObject(o, "preroll", 2);
+    cJSON_AddNumberToObject(o, "silence_s", 120);
+    cJSON_AddNumberToObject(o, "min_event_ms", 100);
+    cJSON_AddBoolToObject(o, "container", false);
+    cJSON_AddNumberToObject(o, "current_rms", 1234 + (i & 255));
+    cJSON_AddBoolToObject(o, "ulaw", false);
+    cJSON_AddNumberToObject(o, "current_zcr", 0.117);
+    cJSON_AddStringToObject(o, "vad", "spectral");
+    cJSON_AddBoolToObject(o, "vad_voice", i & 1);
+    cJSON_AddNumberToObject(o, "vad_us", 412);
+    cJSON_AddNumberToObject(o, "vad_us_max", 980);
+    cJSON_AddNumberToObject(o, "filter_hp", 100);
+    cJSON_AddNumberToObject(o, "filter_lp", 8000);
+    char *s = cJSON_PrintUnformatted(o);
+    cJSON_Delete(o);
+    size_t n = strlen(s);
+    sink_flush(NULL, s, n);
+    free(s);
+    return n;
+}
+
+static size_t auto_cjson(int i)
+{
+    cJSON *j = cJSON_Parse(AUTO_BODY);
+    if (!j) return 0;
+    cJSON *t = cJSON_GetObjectItem(j, "threshold");
+    cJSON *e = cJSON_GetObjectItem(j, "enabled");
+    cJSON *v = cJSON_GetObjectItem(j, "vad");
+    size_t r = (t ? t->valueint : 0) + cJSON_IsTrue(e) + (v ? strlen(v->valuestring) : 0) + (i & 1);
+    cJSON_Delete(j);
+    return r;
+}
+#endif
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, size_t (*fn)(int), int iters)
+{
+    size_t check = 0;
+    s_alloc_calls = s_alloc_bytes = 0;
+    double t0 = now_s();
+    for (int i = 0; i < iters; i++) check += fn(i);
+    double dt = now_s() - t0;
+    if (check == 0) fprintf(stderr, "%s: produced nothing\n", name);
+    printf("%-14s %10.0f req/s  %8.1f bytes  %5.2f allocs per request\n",
+           name, iters / dt, (double)s_alloc_bytes / iters, (double)s_alloc_calls / iters);
+}
+
+int main(int argc, char **argv)
+{
+    int iters = argc > 1 ? atoi(argv[1]) : 200000;
+    if (iters <= 0) {
+        fprintf(stderr, "usage: json_bench [iterations]\n");
+        return 1;
+    }
+
+    run("status/jsonw", status_jsonw, iters);
+#ifdef HAVE_CJSON
+    run("status/cJSON", status_cjson, iters);
+#endif
+    run("auto/jsonr", auto_jsonr, iters);
+#ifdef HAVE_CJSON
+    run("auto/cJSON", auto_cjson, iters);
+#endif
+    return 0;
+}
@@ -0,0 +1,358 @@
+// Offline replay of the auto-record trigger (main/trigger.c, main/vad.c) over
+// WAV files.
+//
+//   trigger_replay [options] <file.wav|dir> ...
+//     -m <mode>    detector: rms (default) or spectral
+//     -t <rms>     absolute trigger threshold (default 2000)
+//     -s <sec>     silence timeout in seconds (default 120)
+//     -e <ms>      minimum event length before triggering (default 100)
+//     -f <n>       samples per chunk (default 20 ms worth)
+//     -p <sec>     pre-roll credited before each trigger (default 1)
+//     -l <csv>     labelled events: file,start_s,end_s (one per line)
+//     -v           print every trigger/stop as it happens
+//
+// Each file starts with a fresh detector, as after a reboot. Recordings from
+// the device (PCM16 or u-law) can be replayed directly. With -l, a detected
+// event counts as a true positive if [start - preroll, stop] overlaps a
+// labelled event of the same file; recall counts labels hit by any detection.
+
+#include "trigger.h"
+#include "vad.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <time.h>
+
+typedef struct {
+    char file[128];
+    double start, end;
+    int hit;
+} label_t;
+
+typedef struct {
+    double start, end;
+} event_t;
+
+static label_t *s_labels = NULL;
+static int s_num_labels = 0;
+
+static trigger_config_t s_cfg;
+static size_t s_frame = 0;      // 0: 20 ms
+static double s_preroll_s = 1.0;
+static int s_verbose = 0;
+
+// Totals over all files
+static int s_events = 0;
+static int s_true_pos = 0;
+static double s_audio_s = 0;
+static uint64_t s_frames = 0;
+static double s_vad_s = 0;      // time spent in vad_process()
+
+static int16_t ulaw_to_linear(uint8_t u)
+{
+    u = ~u;
+    int t = ((u & 0x0F) << 3) + 0x84;
+    t <<= (u & 0x70) >> 4;
+    return (u & 0x80) ? (int16_t)(0x84 - t) : (int16_t)(t - 0x84);
+}
+
+static int load_labels(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int cap = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        double a, b;
+        if (line[0] == '#') continue;
+        if (sscanf(line, " %127[^,],%lf,%lf", name, &a, &b) != 3) continue;  // header/blank
+        if (s_num_labels == cap) {
+            cap = cap ? cap * 2 : 64;
+            s_labels = realloc(s_labels, cap * sizeof(label_t));
+        }
+        label_t *l = &s_labels[s_num_labels++];
+        snprintf(l->file, sizeof(l->file), "%s", name);
+        l->start = a;
+        l->end = b;
+        l->hit = 0;
+    }
+    fclose(f);
+    return 0;
+}
+
+// Match a detection against the labels of one file
+static int score_event(const char *name, const event_t *ev)
+{
+    int tp = 0;
+    double start = ev->start - s_preroll_s;
+    for (int i = 0; i < s_num_labels; i++) {
+        label_t *l = &s_labels[i];
+        if (strcmp(l->file, name) != 0) continue;
+        if (start < l->end && ev->end > l->start) {
+            l->hit = 1;
+            tp = 1;
+        }
+    }
+    return tp;
+}
+
+static void report_event(const char *name, const event_t *ev)
+{
+    int tp = s_num_labels ? score_event(name, ev) : 0;
+    s_events++;
+    s_true_pos += tp;
+    printf("%s,%.2f,%.2f%s\n", name, ev->start, ev->end,
+           s_num_labels ? (tp ? ",tp" : ",fp") : "");
+}
+
+static int replay_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    // Walk the RIFF chunks for "fmt " and "data"
+    uint8_t riff[12];
+    if (fread(riff, 1, 12, f) != 12 || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        fclose(f);
+        return -1;
+    }
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0, data_size = 0;
+    for (;;) {
+        uint8_t ck[8];
+        if (fread(ck, 1, 8, f) != 8) {
+            fprintf(stderr, "%s: no data chunk\n", path);
+            fclose(f);
+            return -1;
+        }
+        uint32_t size = ck[4] | ck[5] << 8 | ck[6] << 16 | (uint32_t)ck[7] << 24;
+        if (!memcmp(ck, "fmt ", 4)) {
+            uint8_t fmt[16];
+            if (size < 16 || fread(fmt, 1, 16, f) != 16) break;
+            format = fmt[0] | fmt[1] << 8;
+            channels = fmt[2] | fmt[3] << 8;
+            rate = fmt[4] | fmt[5] << 8 | fmt[6] << 16 | (uint32_t)fmt[7] << 24;
+            bits = fmt[14] | fmt[15] << 8;
+            fseek(f, (size - 16 + 1) & ~1u, SEEK_CUR);
+        } else if (!memcmp(ck, "data", 4)) {
+            data_size = size;
+            break;
+        } else {
+            fseek(f, (size + 1) & ~1u, SEEK_CUR);
+        }
+    }
+
+    int ulaw = (format == 7 && bits == 8);
+    if (channels != 1 || rate == 0 || !(ulaw || (format == 1 && bits == 16))) {
+        fprintf(stderr, "%s: unsupported format %u/%u-bit/%u ch\n", path, format, bits, channels);
+        fclose(f);
+        return -1;
+    }
+
+    // The device typically delivers 20 ms per update; timing does not depend on it
+    size_t frame = s_frame ? s_frame : rate / 50;
+    trigger_config_t cfg = s_cfg;
+    cfg.sample_rate = rate;
+    trigger_t trig;
+    trigger_init(&trig, &cfg);
+    static vad_t vad;
+    vad_config_t vad_cfg;
+    vad_default_config(&vad_cfg);
+    vad_init(&vad, &vad_cfg, (int)rate);
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    const char *name = basename(tmp);
+
+    int16_t *pcm = malloc(frame * sizeof(int16_t));
+    uint8_t *raw = malloc(frame * 2);
+    size_t bps = ulaw ? 1 : 2;
+    uint64_t pos = 0;
+    uint64_t total = data_size / bps;
+    event_t ev = {0};
+
+    while (pos < total) {
+        size_t n = frame;
+        if (n > total - pos) n = total - pos;
+        size_t got = fread(raw, bps, n, f);
+        if (got == 0) break;
+        for (size_t i = 0; i < got; i++) {
+            pcm[i] = ulaw ? ulaw_to_linear(raw[i])
+                          : (int16_t)(raw[2 * i] | raw[2 * i + 1] << 8);
+        }
+        pos += got;
+
+        float rms, zcr;
+        trigger_frame_stats(pcm, got, &rms, &zcr, NULL);
+        bool voice = false;
+        if (cfg.mode == TRIGGER_MODE_SPECTRAL) {
+            struct timespec a, b;
+            clock_gettime(CLOCK_MONOTONIC, &a);
+            voice = vad_process(&vad, pcm, got);
+            clock_gettime(CLOCK_MONOTONIC, &b);
+            s_vad_s += (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+        }
+        s_frames++;
+        double t = (double)pos / rate;
+        switch (trigger_update(&trig, got, rms, zcr, voice)) {
+        case TRIGGER_EV_START:
+            ev.start = t;
+            if (s_verbose)
+                fprintf(stderr, "%s %8.2fs trigger rms=%.0f noise=%.0f trig=%.0f zcr=%.2f\n",
+                        name, t, trig.rms_smooth, trig.noise_floor, trig.trig_level, trig.zcr_smooth);
+            break;
+        case TRIGGER_EV_STOP:
+            ev.end = t;
+            if (s_verbose) fprintf(stderr, "%s %8.2fs stop\n", name, t);
+            report_event(name, &ev);
+            break;
+        default:
+            break;
+        }
+    }
+    // Still recording at end of file: close the event there
+    if (trig.state == TRIGGER_RECORDING) {
+        ev.end = (double)pos / rate;
+        report_event(name, &ev);
+    }
+
+    s_audio_s += (double)pos / rate;
+    free(pcm);
+    free(raw);
+    fclose(f);
+    return 0;
+}
+
+static int has_wav_ext(const char *name)
+{
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".wav") == 0;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void replay_path(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        replay_file(path);
+        return;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        return;
+    }
+    char **names = NULL;
+    int count = 0, cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.' || !has_wav_ext(ent->d_name)) continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            names = realloc(names, cap * sizeof(char *));
+        }
+        names[count++] = strdup(ent->d_name);
+    }
+    closedir(dir);
+
+    // Chronological order for the device's rec_NNN / timestamp names
+    qsort(names, count, sizeof(char *), cmp_str);
+    for (int i = 0; i < count; i++) {
+        char full[1024];
+        snprintf(full, sizeof(full), "%s/%s", path, names[i]);
+        replay_file(full);
+        free(names[i]);
+    }
+    free(names);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-m rms|spectral] [-t threshold] [-s silence_s] [-e min_event_ms]"
+            " [-f chunk] [-p preroll_s] [-l labels.csv] [-v]"
+            " <file.wav|dir> ...\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    trigger_default_config(&s_cfg, 20000);
+    const char *labels = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:t:s:e:f:p:l:vh")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (strcmp(optarg, "spectral") == 0) {
+                s_cfg.mode = TRIGGER_MODE_SPECTRAL;
+            } else if (strcmp(optarg, "rms") != 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 't': s_cfg.threshold = (uint16_t)atoi(optarg); break;
+        case 's': s_cfg.silence_ms = (uint32_t)(atof(optarg) * 1000.0); break;
+        case 'e': s_cfg.min_event_ms = (uint32_t)atoi(optarg); break;
+        case 'f': s_frame = (size_t)atoi(optarg); break;
+        case 'p': s_preroll_s = atof(optarg); break;
+        case 'l': labels = optarg; break;
+        case 'v': s_verbose = 1; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (labels && load_labels(labels) != 0) return 1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    printf("file,start_s,end_s%s\n", s_num_labels ? ",match" : "");
+    for (int i = optind; i < argc; i++) replay_path(argv[i]);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    fprintf(stderr, "\n%d event(s) in %.1f s of audio, replayed in %.2f s (%.0fx real time)\n",
+            s_events, s_audio_s, wall, wall > 0 ? s_audio_s / wall : 0);
+    if (s_cfg.mode == TRIGGER_MODE_SPECTRAL && s_frames)
+        fprintf(stderr, "VAD %.2f us/frame on this host\n", s_vad_s * 1e6 / s_frames);
+    if (s_num_labels) {
+        int hit = 0;
+        for (int i = 0; i < s_num_labels; i++) hit += s_labels[i].hit;
+        double precision = s_events ? (double)s_true_pos / s_events : 0;
+        double recall = (double)hit / s_num_labels;
+        fprintf(stderr, "precision %.3f (%d/%d)  recall %.3f (%d/%d)\n",
+                precision, s_true_pos, s_events, recall, hit, s_num_labels);
+    }
+    free(s_labels);
+    return 0;
+}